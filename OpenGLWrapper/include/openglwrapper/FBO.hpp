@@ -84,9 +84,6 @@ namespace gl {
 		glm::vec4 clearColor;
 		
 		std::vector<FboAttachmentType> attachmentBuffers;
-		
-		
-		static FBO* currentlyBoundFBO;
 	};
 }
 
@@ -20,6 +20,8 @@
 #define OPEN_GL_ENGINE_H
 
 #include <vector>
+#include <deque>
+#include <string>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -80,11 +82,18 @@ namespace gl {
 		
 	public:
 		
+		// code of errors reported by KHR_debug callback, which does not
+		// pass GL error enum
+		static const int DEBUG_OUTPUT_ERROR = -1;
+		
 		struct ErrorStruct {
+			// GL error enum or DEBUG_OUTPUT_ERROR
 			int code;
 			const char* msg;
 			const char* file;
 			int line;
+			// implementation defined KHR_debug message id, 0 when polled
+			unsigned debugId = 0;
 		};
 		
 		void FaceCulling(bool showFront=true, bool showBack=true);
@@ -118,10 +127,39 @@ namespace gl {
 		unsigned int GetWidth() const;
 		unsigned int GetHeight() const;
 		
-		int InitHeadless(int majorOpenglVersion=4, int minorOpenglVersion=5);
+		// debugContext requests debug context and routes GL errors through
+		// KHR_debug callback into error stack with code DEBUG_OUTPUT_ERROR,
+		// GL_CHECK_PUSH_ERROR then only attaches its location without
+		// calling glGetError. Context shares buffers and programs with
+		// shareWith when given. Created context is made current on calling
+		// thread.
+		int InitHeadless(int majorOpenglVersion=4, int minorOpenglVersion=5,
+				bool debugContext=false, OpenGL* shareWith=nullptr);
+		// Same as InitHeadless without any window system: EGL display of
+		// EGL_PLATFORM_SURFACELESS_MESA or first enumerated EGL device and
+		// surfaceless context. shareWith has to be EGL context too.
+		int InitHeadlessEGL(int majorOpenglVersion=4, int minorOpenglVersion=5,
+				bool debugContext=false, OpenGL* shareWith=nullptr);
 		int Init(const char* windowName, unsigned int width, unsigned int height,
 				bool resizable, bool fullscreen, bool limitFrames = true,
-				int majorOpenglVersion=4, int minorOpenglVersion=5);
+				int majorOpenglVersion=4, int minorOpenglVersion=5,
+				bool debugContext=false);
+		
+		inline bool IsDebugOutputEnabled() const { return debugOutput; }
+		
+		/*
+		 * Every thread driving GL has its own instance. GLFW requires
+		 * contexts to be created on main thread, worker then takes its
+		 * context with MakeCurrent. Current() is instance made current on
+		 * calling thread, global openGL when there is none.
+		 */
+		void MakeCurrent();
+		static void DoneCurrent();
+		static OpenGL* Current();
+		
+		// per context state caches
+		unsigned currentProgram;
+		class FBO* currentlyBoundFBO;
 		
 		void SetKeyCallback(void (GLFWwindow*, int, int, int, int));
 		void SetScrollCallback(void (GLFWwindow*, double, double));
@@ -142,15 +180,37 @@ namespace gl {
 		
 	private:
 		
+		void EnableDebugOutput();
+		static void GLAPIENTRY DebugMessageCallback(GLenum source, GLenum type,
+				GLuint id, GLenum severity, GLsizei length,
+				const GLchar* message, const void* userParam);
+		
 		std::vector<ErrorStruct> errors;
+		
+		// owns msg of errors reported by debug callback
+		std::deque<std::string> debugMessages;
+		bool debugOutput;
+		
+		// EGLDisplay and EGLContext, not null when created by InitHeadlessEGL
+		void* eglDisplay;
+		void* eglContext;
+		// errors from this index on have no location yet
+		size_t firstUnlocatedError;
 	};
 
 	extern OpenGL openGL;
 }
 
-#define GL_CHECK_PUSH_PRINT_ERROR {if(gl::openGL.StackError(__LINE__, __FILE__)){gl::openGL.PrintError(gl::openGL.GetLastError());}}
-#define GL_CHECK_PUSH_ERROR gl::openGL.StackError(__LINE__, __FILE__)
-#define GL_PUSH_CUSTOM_ERROR(code, msg) gl::openGL.PushCustomError({code, msg, __FILE__, __LINE__})
+// Polling glGetError may synchronize with driver, release builds rely on
+// debug context callback instead.
+#ifdef NDEBUG
+#define GL_CHECK_PUSH_PRINT_ERROR {}
+#define GL_CHECK_PUSH_ERROR ((void)0)
+#else
+#define GL_CHECK_PUSH_PRINT_ERROR {if(gl::OpenGL::Current()->StackError(__LINE__, __FILE__)){gl::OpenGL::Current()->PrintError(gl::OpenGL::Current()->GetLastError());}}
+#define GL_CHECK_PUSH_ERROR gl::OpenGL::Current()->StackError(__LINE__, __FILE__)
+#endif
+#define GL_PUSH_CUSTOM_ERROR(code, msg) gl::OpenGL::Current()->PushCustomError({code, msg, __FILE__, __LINE__})
 
 #endif
 
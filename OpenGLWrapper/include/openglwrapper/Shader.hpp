@@ -21,6 +21,7 @@
 
 #include <vector>
 #include <string>
+#include <utility>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -36,9 +37,17 @@ namespace gl {
 	class Shader {
 	public:
 		
+		using Defines = std::vector<std::pair<std::string, std::string>>;
+		
 		int Compile(const std::string& vertexCode, const std::string& geometryCode,
 				const std::string& fragmentCode);		// return 0 if no errors
 		int Compile(const std::string& computeCode);	// return 0 if no errors
+		int Compile(const std::string& computeCode,
+				const Defines& defines);				// return 0 if no errors
+		
+		// Inserts #define lines right after #version directive
+		static std::string InjectDefines(const std::string& code,
+				const Defines& defines);
 		
 		int Load(const std::string& vertexPath, const std::string& geometryPath,
 				const std::string& fragmentPath);		// return 0 if no errors
@@ -80,14 +89,24 @@ namespace gl {
 		
 		int32_t workgroupSize[3];
 		
+		// Linked programs are stored in and loaded from this directory as
+		// driver binaries. Empty path (default) disables the cache.
+		static void SetProgramBinaryCacheDirectory(const std::string& directory);
+		
 	private:
 		
+		std::string ProgramBinaryCachePath(const std::string& sources) const;
+		bool LoadProgramBinary(const std::string& path,
+				const std::string& sources);
+		void StoreProgramBinary(const std::string& path,
+				const std::string& sources);
+		
+		static std::string programBinaryCacheDirectory;
+		
 		std::string LoadFile(const std::string& filePath);
 		
 		unsigned CheckBuildStatus();
 		
-		static unsigned currentProgram;
-		
 		static unsigned CompileGLSL(const std::string& code, gl::ShaderType type);
 		static void PrintCode(const std::string& code);
 		
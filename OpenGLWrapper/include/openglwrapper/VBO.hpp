@@ -68,6 +68,15 @@ namespace gl {
 		void FetchAll(std::vector<uint8_t>& data);
 		void Update(const void* data, uint32_t offset, uint32_t bytes);
 		
+		// Makes this a view of other's buffer, e.g. to read it from context
+		// sharing objects with the one that created it. View never deletes
+		// the buffer; Generate and Resize detach view into own buffer.
+		void ShareFrom(const VBO& other);
+		inline bool IsView() const { return !owner; }
+		// Copies contents of viewed buffer into own buffer, so that Update
+		// and Copy stop writing into buffer of other. No-op for owner.
+		void Detach();
+		
 		void Resize(uint32_t newVertices);
 		void Copy(VBO* sourceBuffer, uint32_t sourceOffset, uint32_t destinyOffset, uint32_t bytes);
 		
@@ -85,6 +94,7 @@ namespace gl {
 		gl::BufferUsage usage;
 		uint32_t vboID;
 		uint32_t vertexSize, vertices;
+		bool owner;
 	};
 }
 
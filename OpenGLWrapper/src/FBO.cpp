@@ -27,7 +27,7 @@ namespace gl {
 	}
 	
 	void FBO::Destroy() {
-		if(currentlyBoundFBO == this) {
+		if(OpenGL::Current()->currentlyBoundFBO == this) {
 			Unbind();
 		}
 		glDeleteFramebuffers(1, &fbo);
@@ -94,15 +94,14 @@ namespace gl {
 
 	
 	
-	FBO* FBO::currentlyBoundFBO = NULL;
-	
 	void FBO::SimpleBind() {
 		if(fbo == 0) {
 			glCreateFramebuffers(1, &fbo);
 		}
-		if(currentlyBoundFBO != this) {
+		OpenGL* context = OpenGL::Current();
+		if(context->currentlyBoundFBO != this) {
 			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-			currentlyBoundFBO = this;
+			context->currentlyBoundFBO = this;
 		}
 	}
 	
@@ -112,9 +111,10 @@ namespace gl {
 	}
 	
 	void FBO::Unbind() {
-		if(currentlyBoundFBO) {
+		OpenGL* context = OpenGL::Current();
+		if(context->currentlyBoundFBO) {
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-			currentlyBoundFBO = NULL;
+			context->currentlyBoundFBO = NULL;
 		}
 	}
 	
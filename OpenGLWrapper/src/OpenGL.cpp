@@ -22,13 +22,43 @@
 #include "../include/openglwrapper/OpenGL.hpp"
 
 #include <cstdio>
+#include <cstring>
 
-#include <cstdio>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <atomic>
 
 namespace gl {
 
 OpenGL openGL;
 
+static thread_local OpenGL* currentOpenGL = nullptr;
+static std::atomic<int> openGLInstances(0);
+
+void OpenGL::MakeCurrent() {
+	if(eglContext)
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				eglContext);
+	else
+		glfwMakeContextCurrent(window);
+	currentOpenGL = this;
+}
+
+void OpenGL::DoneCurrent() {
+	if(currentOpenGL && currentOpenGL->eglContext)
+		eglMakeCurrent(currentOpenGL->eglDisplay, EGL_NO_SURFACE,
+				EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	else
+		glfwMakeContextCurrent(NULL);
+	currentOpenGL = nullptr;
+}
+
+OpenGL* OpenGL::Current() {
+	return currentOpenGL ? currentOpenGL : &openGL;
+}
+
 void OpenGL::FaceCulling(bool showFront, bool showBack) {
 	glEnable(GL_CULL_FACE);
 	if(showFront) {
@@ -143,13 +173,14 @@ unsigned int OpenGL::GetHeight() const {
 
 int OpenGL::Init(const char* windowName, unsigned int width,
 		unsigned int height, bool resizable, bool fullscreen, bool limitFrames,
-		int majorOpenglVersion, int minorOpenglVersion) {
+		int majorOpenglVersion, int minorOpenglVersion, bool debugContext) {
 	firstMouse = true;
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, majorOpenglVersion);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minorOpenglVersion);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext);
     glfwWindowHint(GLFW_RESIZABLE, resizable);
 	window = glfwCreateWindow(width, height, windowName,
 			fullscreen ? glfwGetPrimaryMonitor() : NULL, NULL);
@@ -168,7 +199,7 @@ int OpenGL::Init(const char* windowName, unsigned int width,
 	
 	
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwMakeContextCurrent(window);
+	MakeCurrent();
 	
 	{
 		double x, y;
@@ -191,10 +222,13 @@ int OpenGL::Init(const char* windowName, unsigned int width,
 	    return 2;
 	}
 	GL_CHECK_PUSH_ERROR;
+	if(debugContext)
+		EnableDebugOutput();
 	return 0;
 }
 
-int OpenGL::InitHeadless(int majorOpenglVersion, int minorOpenglVersion) {
+int OpenGL::InitHeadless(int majorOpenglVersion, int minorOpenglVersion,
+		bool debugContext, OpenGL* shareWith) {
 	width = 320;
 	height = 240;
 	firstMouse = true;
@@ -203,15 +237,17 @@ int OpenGL::InitHeadless(int majorOpenglVersion, int minorOpenglVersion) {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minorOpenglVersion);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext);
     glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-	window = glfwCreateWindow(width, height, "", NULL, NULL);
+	window = glfwCreateWindow(width, height, "", NULL,
+			shareWith ? shareWith->window : NULL);
 	if(window == NULL) {
 		printf("Failed to create GLFW window!\n");
 		GL_CHECK_PUSH_ERROR;
 		return 1;
 	}
 	
-	glfwMakeContextCurrent(window);
+	MakeCurrent();
 	
 	glewExperimental = GL_TRUE;
 	if(GLEW_OK != glewInit()) {
@@ -220,9 +256,161 @@ int OpenGL::InitHeadless(int majorOpenglVersion, int minorOpenglVersion) {
 	    return 2;
 	}
 	GL_CHECK_PUSH_ERROR;
+	if(debugContext)
+		EnableDebugOutput();
+	return 0;
+}
+
+static bool HasEGLExtension(EGLDisplay display, const char* name) {
+	const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if(extensions == NULL)
+		return false;
+	size_t length = strlen(name);
+	for(const char* it=strstr(extensions, name); it;
+			it=strstr(it+length, name))
+		if((it == extensions || it[-1] == ' ')
+				&& (it[length] == ' ' || it[length] == 0))
+			return true;
+	return false;
+}
+
+// Display is shared by all contexts of process and never terminated, other
+// instances may still use it.
+static EGLDisplay GetHeadlessEGLDisplay() {
+	static EGLDisplay display = []() -> EGLDisplay {
+		if(!HasEGLExtension(EGL_NO_DISPLAY, "EGL_EXT_platform_base"))
+			return EGL_NO_DISPLAY;
+		auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+			eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if(getPlatformDisplay == NULL)
+			return EGL_NO_DISPLAY;
+		EGLint major, minor;
+		if(HasEGLExtension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+			EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+					EGL_DEFAULT_DISPLAY, NULL);
+			if(d != EGL_NO_DISPLAY && eglInitialize(d, &major, &minor))
+				return d;
+		}
+		auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)
+			eglGetProcAddress("eglQueryDevicesEXT");
+		if(queryDevices == NULL)
+			return EGL_NO_DISPLAY;
+		EGLDeviceEXT devices[16];
+		EGLint count = 0;
+		if(!queryDevices(16, devices, &count))
+			return EGL_NO_DISPLAY;
+		for(EGLint i=0; i<count; ++i) {
+			EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT,
+					devices[i], NULL);
+			if(d != EGL_NO_DISPLAY && eglInitialize(d, &major, &minor))
+				return d;
+		}
+		return EGL_NO_DISPLAY;
+	}();
+	return display;
+}
+
+int OpenGL::InitHeadlessEGL(int majorOpenglVersion, int minorOpenglVersion,
+		bool debugContext, OpenGL* shareWith) {
+	width = 320;
+	height = 240;
+	firstMouse = true;
+	EGLDisplay display = GetHeadlessEGLDisplay();
+	if(display == EGL_NO_DISPLAY) {
+		printf("Failed to get surfaceless EGL display!\n");
+		return 1;
+	}
+	if(!HasEGLExtension(display, "EGL_KHR_surfaceless_context")) {
+		printf("EGL_KHR_surfaceless_context is not supported!\n");
+		return 1;
+	}
+	if(shareWith && shareWith->eglContext == NULL) {
+		printf("EGL context can be shared only with EGL context!\n");
+		return 1;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	if(!HasEGLExtension(display, "EGL_KHR_no_config_context")) {
+		const EGLint configAttribs[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		EGLint count = 0;
+		if(!eglChooseConfig(display, configAttribs, &config, 1, &count)
+				|| count == 0) {
+			printf("Failed to choose EGL config!\n");
+			return 1;
+		}
+	}
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, majorOpenglVersion,
+		EGL_CONTEXT_MINOR_VERSION, minorOpenglVersion,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+		EGL_CONTEXT_OPENGL_DEBUG, debugContext ? EGL_TRUE : EGL_FALSE,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config,
+			shareWith ? shareWith->eglContext : EGL_NO_CONTEXT,
+			contextAttribs);
+	if(context == EGL_NO_CONTEXT) {
+		printf("Failed to create EGL context: 0x%X\n", eglGetError());
+		return 1;
+	}
+	eglDisplay = display;
+	eglContext = context;
+	
+	MakeCurrent();
+	
+	// glewInit queries window system extensions of current GLX context
+	glewExperimental = GL_TRUE;
+	if(GLEW_OK != glewContextInit()) {
+	    printf("Failed to initialize GLEW!\n");
+		GL_CHECK_PUSH_ERROR;
+	    return 2;
+	}
+	GL_CHECK_PUSH_ERROR;
+	if(debugContext)
+		EnableDebugOutput();
 	return 0;
 }
 
+void OpenGL::EnableDebugOutput() {
+	if(!GLEW_KHR_debug) {
+		printf("GL_KHR_debug is not supported, errors are polled\n");
+		return;
+	}
+	// errors from before callback was installed
+	while(glGetError() != GL_NO_ERROR) {
+	}
+	glEnable(GL_DEBUG_OUTPUT);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0,
+			nullptr, GL_FALSE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0,
+			nullptr, GL_TRUE);
+	glDebugMessageCallback(DebugMessageCallback, this);
+	debugOutput = true;
+	firstUnlocatedError = errors.size();
+}
+
+void GLAPIENTRY OpenGL::DebugMessageCallback(GLenum source, GLenum type,
+		GLuint id, GLenum severity, GLsizei length, const GLchar* message,
+		const void* userParam) {
+	if(type != GL_DEBUG_TYPE_ERROR)
+		return;
+	OpenGL* gl = (OpenGL*)userParam;
+	gl->debugMessages.emplace_back(message, length >= 0 ? length
+			: strlen(message));
+	ErrorStruct err;
+	err.code = DEBUG_OUTPUT_ERROR;
+	err.debugId = id;
+	err.msg = gl->debugMessages.back().c_str();
+	err.file = nullptr;
+	err.line = 0;
+	gl->errors.emplace_back(err);
+}
+
 
 
 void OpenGL::SetKeyCallback(void (callback)(GLFWwindow*, int, int, int, int)) {
@@ -259,14 +447,30 @@ void OpenGL::SwapBuffer() {
 }
 
 void OpenGL::Destroy() {
-	glfwDestroyWindow(window);
+	if(currentOpenGL == this)
+		DoneCurrent();
+	if(eglContext) {
+		eglDestroyContext(eglDisplay, eglContext);
+		eglContext = NULL;
+		eglDisplay = NULL;
+	}
+	if(window)
+		glfwDestroyWindow(window);
 	window = NULL;
 	width = height = 0;
 }
 
 OpenGL::OpenGL() {
+	++openGLInstances;
+	window = NULL;
+	eglDisplay = NULL;
+	eglContext = NULL;
+	currentProgram = 0;
+	currentlyBoundFBO = NULL;
 	mouseLastX = mouseLastY = mouseCurrentX = mouseCurrentY = scrollLast
 		= scrollCurrent = 0.0;
+	debugOutput = false;
+	firstUnlocatedError = 0;
 	keys.resize(1024);
 	for(auto it : keys)
 		it = false;
@@ -275,7 +479,8 @@ OpenGL::OpenGL() {
 
 OpenGL::~OpenGL() {
 	Destroy();
-	glfwTerminate();
+	if(--openGLInstances == 0)
+		glfwTerminate();
 }
 
 void OpenGLKeyCallback(GLFWwindow* window, int key, int scancode, int action,
@@ -334,6 +539,20 @@ void OpenGL::PushCustomError(ErrorStruct err) {
 }
 
 int OpenGL::StackError(int line, const char* file) {
+	if(debugOutput) {
+		// callback already pushed errors of preceding calls
+		int code = GL_NO_ERROR;
+		firstUnlocatedError = std::min(firstUnlocatedError, errors.size());
+		for(; firstUnlocatedError<errors.size(); ++firstUnlocatedError) {
+			ErrorStruct& err = errors[firstUnlocatedError];
+			if(err.file == nullptr) {
+				err.file = file;
+				err.line = line;
+			}
+			code = err.code;
+		}
+		return code;
+	}
 	ErrorStruct err;
 	err.code = glGetError();
 	if(err.code != GL_NO_ERROR) {
@@ -346,8 +565,13 @@ int OpenGL::StackError(int line, const char* file) {
 }
 
 void OpenGL::PrintError(ErrorStruct err) {
-	fprintf(stderr, "%s:%i -> OpenGL error [%i]: %s\n", err.file, err.line,
-			err.code, err.msg);
+	if(err.code == DEBUG_OUTPUT_ERROR) {
+		fprintf(stderr, "%s:%i -> OpenGL debug error [id %u]: %s\n",
+				err.file ? err.file : "unknown", err.line, err.debugId, err.msg);
+	} else {
+		fprintf(stderr, "%s:%i -> OpenGL error [%i]: %s\n",
+				err.file ? err.file : "unknown", err.line, err.code, err.msg);
+	}
 	fflush(stderr);
 }
 
@@ -381,6 +605,8 @@ std::vector<OpenGL::ErrorStruct>& OpenGL::GetErrors() {
 
 void OpenGL::ClearErrors() {
 	errors.clear();
+	debugMessages.clear();
+	firstUnlocatedError = 0;
 }
 
 
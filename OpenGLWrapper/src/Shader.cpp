@@ -20,6 +20,8 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <fstream>
+#include <filesystem>
+#include <random>
 #include <cstdio>
 
 #include "../include/openglwrapper/Texture.hpp"
@@ -28,12 +30,18 @@
 
 namespace gl {
 
-unsigned Shader::currentProgram = 0;
+std::string Shader::programBinaryCacheDirectory;
 
 int Shader::Compile(const std::string& vertexCode, const std::string& geometryCode,
 		const std::string& fragmentCode) {
 	Destroy();
 	
+	const std::string sources = vertexCode + '\0' + geometryCode + '\0'
+		+ fragmentCode;
+	const std::string cachePath = ProgramBinaryCachePath(sources);
+	if(LoadProgramBinary(cachePath, sources))
+		return 0;
+	
 	unsigned vertex   = Shader::CompileGLSL(vertexCode, gl::VERTEX_SHADER);
 	unsigned geometry = Shader::CompileGLSL(geometryCode, gl::GEOMETRY_SHADER);
 	unsigned fragment = Shader::CompileGLSL(fragmentCode, gl::FRAGMENT_SHADER);
@@ -48,6 +56,9 @@ int Shader::Compile(const std::string& vertexCode, const std::string& geometryCo
 	
 	GL_CHECK_PUSH_ERROR;
 	
+	if(cachePath != "")
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+				GL_TRUE);
 	glLinkProgram(program);
 	
 	GL_CHECK_PUSH_ERROR;
@@ -61,16 +72,29 @@ int Shader::Compile(const std::string& vertexCode, const std::string& geometryCo
 	
 	GL_CHECK_PUSH_ERROR;
 	
-	return CheckBuildStatus();
+	int ret = CheckBuildStatus();
+	if(ret == 0)
+		StoreProgramBinary(cachePath, sources);
+	return ret;
 }
 
 int Shader::Compile(const std::string& computeCode) {
 	Destroy();
 	
+	const std::string cachePath = ProgramBinaryCachePath(computeCode);
+	if(LoadProgramBinary(cachePath, computeCode)) {
+		glGetProgramiv(program, GL_COMPUTE_WORK_GROUP_SIZE, workgroupSize);
+		GL_CHECK_PUSH_ERROR;
+		return 0;
+	}
+	
 	unsigned compute = Shader::CompileGLSL(computeCode, gl::COMPUTE_SHADER);
 	
 	program = glCreateProgram();
 	glAttachShader(program, compute);
+	if(cachePath != "")
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+				GL_TRUE);
 	glLinkProgram(program);
 	
 	if(compute)
@@ -79,9 +103,147 @@ int Shader::Compile(const std::string& computeCode) {
 	int ret = CheckBuildStatus();
 	if(ret == 0) {
 		glGetProgramiv(program, GL_COMPUTE_WORK_GROUP_SIZE, workgroupSize);
+		StoreProgramBinary(cachePath, computeCode);
+	}
+	GL_CHECK_PUSH_ERROR;
+	return ret;
+}
+
+int Shader::Compile(const std::string& computeCode, const Defines& defines) {
+	return Compile(InjectDefines(computeCode, defines));
+}
+
+std::string Shader::InjectDefines(const std::string& code,
+		const Defines& defines) {
+	std::string lines;
+	for(const auto& define : defines)
+		lines += "#define " + define.first + " " + define.second + "\n";
+	size_t version = code.find("#version");
+	if(version == std::string::npos)
+		return lines + code;
+	size_t end = code.find('\n', version);
+	if(end == std::string::npos)
+		return code + "\n" + lines;
+	return code.substr(0, end+1) + lines + code.substr(end+1);
+}
+
+void Shader::SetProgramBinaryCacheDirectory(const std::string& directory) {
+	programBinaryCacheDirectory = directory;
+}
+
+static std::string DriverIdentifier() {
+	std::string id;
+	for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+		const char* str = (const char*)glGetString(name);
+		id += str ? str : "";
+		id += '\n';
+	}
+	return id;
+}
+
+static uint64_t HashFNV1a(const std::string& data, uint64_t hash) {
+	for(unsigned char c : data) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string Shader::ProgramBinaryCachePath(const std::string& sources) const {
+	if(programBinaryCacheDirectory == "")
+		return "";
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if(formats <= 0)
+		return "";
+	uint64_t hash = HashFNV1a(sources, 14695981039346656037ull);
+	hash = HashFNV1a(DriverIdentifier(), hash);
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+	return programBinaryCacheDirectory + "/" + name;
+}
+
+/*
+ * Cache file layout: driver identifier and source lengths are stored
+ * before binary to reject hash collisions and driver updates.
+ */
+bool Shader::LoadProgramBinary(const std::string& path,
+		const std::string& sources) {
+	if(path == "")
+		return false;
+	std::ifstream file(path, std::ios::binary|std::ios::in);
+	if(!file.good())
+		return false;
+	
+	const std::string driver = DriverIdentifier();
+	uint32_t header[4];
+	if(!file.read((char*)header, sizeof(header)))
+		return false;
+	if(header[0] != driver.size() || header[1] != sources.size())
+		return false;
+	std::string storedDriver(header[0], 0), storedSources(header[1], 0);
+	file.read(storedDriver.data(), header[0]);
+	file.read(storedSources.data(), header[1]);
+	if(!file || storedDriver != driver || storedSources != sources)
+		return false;
+	
+	std::vector<char> binary(header[3]);
+	if(!file.read(binary.data(), binary.size()))
+		return false;
+	
+	program = glCreateProgram();
+	glProgramBinary(program, header[2], binary.data(), binary.size());
+	int success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if(!success) {
+		glDeleteProgram(program);
+		program = 0;
+		// rejected binary is expected after driver change, not an error
+		glGetError();
+		return false;
 	}
 	GL_CHECK_PUSH_ERROR;
-	return CheckBuildStatus();
+	return true;
+}
+
+void Shader::StoreProgramBinary(const std::string& path,
+		const std::string& sources) {
+	if(path == "")
+		return;
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	GL_CHECK_PUSH_ERROR;
+	
+	std::error_code ec;
+	std::filesystem::create_directories(programBinaryCacheDirectory, ec);
+	
+	const std::string driver = DriverIdentifier();
+	const uint32_t header[4] = {(uint32_t)driver.size(),
+		(uint32_t)sources.size(), format, (uint32_t)length};
+	// written to temporary file first, so concurrent workers never read
+	// half written binary
+	const std::string tmpPath = path + "."
+		+ std::to_string(std::random_device()()) + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary|std::ios::trunc);
+		if(!file.good())
+			return;
+		file.write((const char*)header, sizeof(header));
+		file.write(driver.data(), driver.size());
+		file.write(sources.data(), sources.size());
+		file.write(binary.data(), length);
+		if(!file.good()) {
+			file.close();
+			std::filesystem::remove(tmpPath, ec);
+			return;
+		}
+	}
+	std::filesystem::rename(tmpPath, path, ec);
 }
 
 int Shader::Load(const std::string& vertexPath, const std::string& geometryPath,
@@ -106,9 +268,9 @@ void Shader::DispatchRoundGroupNumbers(uint32_t numGroupsX, uint32_t numGroupsY,
 	if(numGroupsX==0 || numGroupsY==0 || numGroupsZ==0)
 		return;
 	glDispatchCompute(
-			this->workgroupSize[0]*((numGroupsX-1+this->workgroupSize[0])/this->workgroupSize[0]),
-			this->workgroupSize[1]*((numGroupsY-1+this->workgroupSize[1])/this->workgroupSize[1]),
-			this->workgroupSize[2]*((numGroupsZ-1+this->workgroupSize[2])/this->workgroupSize[2])
+			(numGroupsX-1+this->workgroupSize[0])/this->workgroupSize[0],
+			(numGroupsY-1+this->workgroupSize[1])/this->workgroupSize[1],
+			(numGroupsZ-1+this->workgroupSize[2])/this->workgroupSize[2]
 			);
 	GL_CHECK_PUSH_ERROR;
 }
@@ -224,10 +386,11 @@ void Shader::PrintCode(const std::string& code) {
 
 void Shader::Use() {
 	if(program) {
-		if(currentProgram != program)
+		OpenGL* context = OpenGL::Current();
+		if(context->currentProgram != program)
 			glUseProgram(program);
 		GL_CHECK_PUSH_ERROR;
-		currentProgram = program;
+		context->currentProgram = program;
 	}
 }
 
@@ -379,7 +542,7 @@ void Shader::SetMat4(int location, const std::vector<glm::mat4>& array) {
 void Shader::Destroy() {
 	if(program) {
 	GL_CHECK_PUSH_ERROR;
-		currentProgram = 0;
+		OpenGL::Current()->currentProgram = 0;
 		glUseProgram(0);
 		glDeleteProgram(program);
 		program = 0;
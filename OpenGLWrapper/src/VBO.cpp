@@ -25,6 +25,7 @@ namespace gl {
 VBO::VBO(uint32_t vertexSize, gl::BufferTarget target, gl::BufferUsage usage) :
 		target(target), usage(usage), vertexSize(vertexSize) {
 	vboID = 0;
+	owner = true;
 	this->vertexSize = vertexSize;
 	this->target = target;
 	this->usage = usage;
@@ -48,14 +49,40 @@ void VBO::Init() {
 
 void VBO::Destroy() {
 	if(vboID) {
-		glDeleteBuffers(1, &vboID);
+		if(owner)
+			glDeleteBuffers(1, &vboID);
 		vboID = 0;
+		owner = true;
 		GL_CHECK_PUSH_ERROR;
 	}
 }
 
+void VBO::ShareFrom(const VBO& other) {
+	Destroy();
+	vboID = other.vboID;
+	vertexSize = other.vertexSize;
+	vertices = other.vertices;
+	owner = vboID == 0;
+}
+
+void VBO::Detach() {
+	if(owner || vboID == 0)
+		return;
+	const uint32_t source = vboID;
+	const uint32_t count = vertices;
+	vboID = 0;
+	owner = true;
+	Generate(nullptr, count);
+	glCopyNamedBufferSubData(source, vboID, 0, 0, vertexSize*count);
+	GL_CHECK_PUSH_ERROR;
+}
+
 void VBO::Generate(const void* data, uint32_t vertexCount) {
 	GL_CHECK_PUSH_ERROR;
+	if(!owner) {
+		vboID = 0;
+		owner = true;
+	}
 	Init();
 	GL_CHECK_PUSH_ERROR;
 	vertices = vertexCount;
@@ -108,7 +135,7 @@ void VBO::BindBufferBase(gl::BufferTarget target, int location) {
 }
 
 void VBO::Resize(uint32_t newVertices) {
-	if(vertices == newVertices) {
+	if(vertices == newVertices && owner) {
 		return;
 	}
 	uint32_t toCopyBytes = std::min(newVertices, vertices)*vertexSize;
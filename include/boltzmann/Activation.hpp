@@ -0,0 +1,207 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BOLTZMANNNN_ACTIVATION_HPP
+#define BOLTZMANNNN_ACTIVATION_HPP
+
+#include <cstdint>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+namespace bn {
+	/*
+	 * Function applied to weighted sum of neuron. Max absolute error of
+	 * tanh approximations over whole float range, float evaluation against
+	 * double tanh:
+	 *   TANH             library (CPU) or driver (GLSL) tanh
+	 *   TANH_PADE        [7/6] Pade approximant, input clamped to +-4.97,
+	 *                    error 9.6e-5
+	 *   TANH_POLYNOMIAL  odd degree 9 minimax polynomial on [-3, 3],
+	 *                    input clamped, error 5.5e-3
+	 * Other units:
+	 *   SIGMOID            1/(1+exp(-v))
+	 *   RELU               max(v, 0)
+	 *   HARD_TANH          clamp(v, -1, 1)
+	 *   LOGISTIC_SAMPLING  1 with probability sigmoid(v), otherwise 0,
+	 *                      drawn from hash of neuron index and step seed so
+	 *                      CPU and GPU draw the same numbers
+	 */
+	enum class Activation : uint32_t {
+		TANH = 0,
+		TANH_PADE = 1,
+		TANH_POLYNOMIAL = 2,
+		SIGMOID = 3,
+		RELU = 4,
+		HARD_TANH = 5,
+		LOGISTIC_SAMPLING = 6
+	};
+	
+	const static uint32_t ACTIVATION_COUNT = 7;
+	
+	/*
+	 * Neurons [begin, end) use activation instead of network default.
+	 * Each group gets its own kernel variant, so keeping neurons of one
+	 * type contiguous keeps every dispatch free of activation branches.
+	 */
+	struct ActivationGroup {
+		uint32_t begin;
+		uint32_t end;
+		Activation activation;
+	};
+	
+	// Sorts groups by begin and drops empty ones, returns false when groups
+	// overlap or activation is unknown.
+	bool NormalizeActivationGroups(std::vector<ActivationGroup>& groups);
+	
+	// Calls f(begin, end, activation) for consecutive ranges covering
+	// [begin, end), neurons outside of normalized groups use
+	// defaultActivation.
+	template<typename F>
+	inline void ForEachActivationRange(
+			const std::vector<ActivationGroup>& groups,
+			Activation defaultActivation, uint32_t begin, uint32_t end, F&& f) {
+		for(const ActivationGroup& g : groups) {
+			if(begin >= end)
+				return;
+			if(g.end <= begin)
+				continue;
+			if(g.begin >= end)
+				break;
+			if(g.begin > begin)
+				f(begin, g.begin, defaultActivation);
+			begin = std::max(begin, g.begin);
+			const uint32_t e = std::min(end, g.end);
+			f(begin, e, g.activation);
+			begin = e;
+		}
+		if(begin < end)
+			f(begin, end, defaultActivation);
+	}
+	
+	const char* ActivationName(Activation activation);
+	bool ActivationFromName(const std::string& name, Activation& activation);
+	
+	// documented bound of absolute error against exact function, 0 for
+	// library implementations
+	float ActivationMaxError(Activation activation);
+	
+	// seed hashed with neuron index gives uniform number of sampling units
+	inline uint32_t SamplingHash(uint32_t v) {
+		v = v*747796405u + 2891336453u;
+		v = ((v >> ((v >> 28) + 4)) ^ v) * 277803737u;
+		return (v >> 22) ^ v;
+	}
+	
+	namespace cpu {
+		// For LOGISTIC_SAMPLING returns firing probability, sample is drawn
+		// by ActivateNeuron.
+		template<Activation ACTIVATION>
+		inline float Activate(float v);
+		
+		template<>
+		inline float Activate<Activation::TANH>(float v) {
+			return std::tanh(v);
+		}
+		
+		template<>
+		inline float Activate<Activation::TANH_PADE>(float v) {
+			v = std::min(std::max(v, -4.97f), 4.97f);
+			const float v2 = v*v;
+			const float p = v*(135135.0f + v2*(17325.0f + v2*(378.0f + v2)));
+			const float q = 135135.0f + v2*(62370.0f + v2*(3150.0f
+						+ v2*28.0f));
+			return std::min(std::max(p/q, -1.0f), 1.0f);
+		}
+		
+		template<>
+		inline float Activate<Activation::TANH_POLYNOMIAL>(float v) {
+			v = std::min(std::max(v, -3.0f), 3.0f);
+			const float v2 = v*v;
+			const float p = v*(0.975854818f + v2*(-0.253494945f
+						+ v2*(0.0490969892f + v2*(-0.00494697699f
+								+ v2*0.000193352928f))));
+			return std::min(std::max(p, -1.0f), 1.0f);
+		}
+		
+		template<>
+		inline float Activate<Activation::SIGMOID>(float v) {
+			return 1.0f / (1.0f + std::exp(-v));
+		}
+		
+		template<>
+		inline float Activate<Activation::RELU>(float v) {
+			return std::max(v, 0.0f);
+		}
+		
+		template<>
+		inline float Activate<Activation::HARD_TANH>(float v) {
+			return std::min(std::max(v, -1.0f), 1.0f);
+		}
+		
+		template<>
+		inline float Activate<Activation::LOGISTIC_SAMPLING>(float v) {
+			return Activate<Activation::SIGMOID>(v);
+		}
+		
+		// value stored in state of neuron, seed changes every step
+		template<Activation ACTIVATION>
+		inline float ActivateNeuron(float v, uint32_t neuron, uint32_t seed) {
+			if(ACTIVATION == Activation::LOGISTIC_SAMPLING) {
+				const uint32_t h = SamplingHash(neuron ^ SamplingHash(seed));
+				const float u = (h >> 8) * (1.0f / 16777216.0f);
+				return u < Activate<ACTIVATION>(v) ? 1.0f : 0.0f;
+			}
+			return Activate<ACTIVATION>(v);
+		}
+	}
+	
+	// Calls f(std::integral_constant<Activation, A>()) for A equal to
+	// activation, used to pick template instantiation at runtime.
+	template<typename F>
+	inline auto VisitActivation(Activation activation, F&& f) {
+		switch(activation) {
+			case Activation::TANH_PADE:
+				return f(std::integral_constant<Activation,
+						Activation::TANH_PADE>());
+			case Activation::TANH_POLYNOMIAL:
+				return f(std::integral_constant<Activation,
+						Activation::TANH_POLYNOMIAL>());
+			case Activation::SIGMOID:
+				return f(std::integral_constant<Activation,
+						Activation::SIGMOID>());
+			case Activation::RELU:
+				return f(std::integral_constant<Activation,
+						Activation::RELU>());
+			case Activation::HARD_TANH:
+				return f(std::integral_constant<Activation,
+						Activation::HARD_TANH>());
+			case Activation::LOGISTIC_SAMPLING:
+				return f(std::integral_constant<Activation,
+						Activation::LOGISTIC_SAMPLING>());
+			default:
+				return f(std::integral_constant<Activation,
+						Activation::TANH>());
+		}
+	}
+}
+
+#endif
+
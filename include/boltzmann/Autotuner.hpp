@@ -0,0 +1,65 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_AUTOTUNER_HPP
+#define BOLTZMANNNN_AUTOTUNER_HPP
+
+#include <string>
+#include <vector>
+
+#include "NeuralNetwork.hpp"
+
+namespace bn {
+	/*
+	 * Picks the fastest calculation kernel variant for given network on
+	 * current device. Variants are timed with GL timer queries and winners
+	 * are cached on disk per device and network shape.
+	 */
+	class Autotuner {
+	public:
+		
+		// empty path neither reads nor writes cache
+		Autotuner(const std::string& cacheFilePath = "boltzmann_autotune.cache");
+		
+		// Applies and returns best config. Only stateNext of network is
+		// modified while measuring.
+		KernelConfig Tune(NeuralNetwork& nn, uint32_t iterations=8,
+				bool useCache=true);
+		
+		// returns GPU time in nanoseconds of single PerformCalculation
+		static double Measure(NeuralNetwork& nn, uint32_t iterations);
+		
+		static std::vector<KernelConfig> Candidates();
+		
+		static std::string DeviceKey();
+		static std::string NetworkShapeKey(const NeuralNetwork& nn);
+		
+		static std::string ToString(const KernelConfig& config);
+		static bool FromString(const std::string& str, KernelConfig& config);
+		
+	private:
+		
+		bool LoadCached(const std::string& key, KernelConfig& config) const;
+		void StoreCached(const std::string& key, const KernelConfig& config);
+		
+		std::string cacheFilePath;
+	};
+}
+
+#endif
+
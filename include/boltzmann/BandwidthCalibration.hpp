@@ -0,0 +1,81 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BOLTZMANNNN_BANDWIDTH_CALIBRATION_HPP
+#define BOLTZMANNNN_BANDWIDTH_CALIBRATION_HPP
+
+#include <cstdint>
+
+#include <vector>
+
+#include "../../OpenGLWrapper/include/openglwrapper/Shader.hpp"
+
+#include "SimpleVBO.hpp"
+
+namespace bn {
+	// achievable read bandwidth in GB/s, counting only useful bytes
+	struct BandwidthCeilings {
+		double stream = 0;
+		double strided = 0;
+		double gather = 0;
+	};
+	
+	/*
+	 * Memory microbenchmarks giving roofline ceilings for the calculation
+	 * kernel: sequential read, read with fixed stride in elements and
+	 * random gather through index buffer (same pattern as reading inputs
+	 * through connection indices).
+	 */
+	class BandwidthCalibration {
+	public:
+		
+		// elements is rounded down to power of two (at least 4096), stride
+		// to power of two smaller than elements. Gathered indices are drawn
+		// from [0, gatherRange), 0 means whole buffer.
+		BandwidthCalibration(uint32_t elements, uint32_t stride=16,
+				uint32_t gatherRange=0, uint64_t seed=1);
+		~BandwidthCalibration();
+		
+		BandwidthCeilings MeasureGpu(uint32_t iterations);
+		BandwidthCeilings MeasureCpu(uint32_t iterations);
+		
+		inline uint32_t GetElements() const { return elements; }
+		
+	private:
+		
+		double MeasureGpuKernel(gl::Shader& shader, uint32_t iterations);
+		
+		uint32_t elements;
+		uint32_t stride;
+		
+		std::vector<float> dataHost;
+		std::vector<uint32_t> indicesHost;
+		
+		gl::SimpleVBO<float> *data, *result;
+		gl::SimpleVBO<uint32_t> *indices;
+		
+		// stream, strided and gather kernels, each in interleaved and
+		// chunked layout
+		std::vector<gl::Shader*> shaders;
+		
+		const static uint32_t ELEMENTS_PER_INVOCATION;
+		const static char* CALIBRATION_SOURCE_CODE;
+	};
+}
+
+#endif
+
@@ -0,0 +1,314 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_CPU_KERNELS_HPP
+#define BOLTZMANNNN_CPU_KERNELS_HPP
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <type_traits>
+
+#include "NetworkStructure.hpp"
+#include "Activation.hpp"
+
+namespace bn {
+	namespace cpu {
+		struct NetworkView {
+			const PerNeuronStatic* perNeuronStatic;
+			const uint32_t* connections;
+			const float* weights;
+			const float* bias;
+			
+			EdgeLayout layout;
+			// used by interleaved layouts, starts counted in connections
+			const PerNeuronStatic* packedStatic;
+			const uint32_t* packedEdges;
+			
+			Activation activation;
+			// changes every step, used by LOGISTIC_SAMPLING
+			uint32_t samplingSeed;
+			
+			// leak rate of every neuron or nullptr to use leakRate
+			const float* leakRates;
+			float leakRate;
+			
+			// index hashed with samplingSeed for every neuron or nullptr to
+			// hash neuron's own index
+			const uint32_t* samplingIndices;
+			
+			// connection positions in stream of indices read by kernel
+			// (connections or packedEdges), prefetching stops at its end
+			uint32_t streamLength;
+			// states of connections this many positions ahead are
+			// prefetched, 0 is plain gather
+			uint32_t prefetchDistance;
+		};
+		
+		/*
+		 * Cache blocked copy of connections. Connections of every block of
+		 * blockNeurons neurons are grouped by tile of source neurons, so
+		 * that gathers of block go over one slice of x at a time and add
+		 * to partial sums of whole block.
+		 */
+		struct TiledView {
+			// connections of block b are [blockStarts[b], blockStarts[b+1])
+			const uint32_t* blockStarts;
+			const uint32_t* sources;
+			// neuron of connection, counted from first neuron of block
+			const uint16_t* targets;
+			const float* weights;
+			uint32_t blockNeurons;
+			uint32_t neuronsCount;
+		};
+		
+		// targets are 16 bit
+		const uint32_t TILED_MAX_BLOCK = 65536;
+		
+		// Distances with kernel instantiations, other distances are rounded
+		// down to one of them.
+		const uint32_t PREFETCH_DISTANCES[] = {0, 8, 16, 32, 64};
+		
+		template<typename F>
+		inline auto VisitPrefetch(uint32_t distance, F&& f) {
+			if(distance >= 64)
+				return f(std::integral_constant<uint32_t, 64>());
+			if(distance >= 32)
+				return f(std::integral_constant<uint32_t, 32>());
+			if(distance >= 16)
+				return f(std::integral_constant<uint32_t, 16>());
+			if(distance >= 8)
+				return f(std::integral_constant<uint32_t, 8>());
+			return f(std::integral_constant<uint32_t, 0>());
+		}
+		
+		inline void PrefetchRead(const void* ptr) {
+#if defined(__GNUC__)
+			__builtin_prefetch(ptr, 0, 3);
+#endif
+		}
+		
+		// Prefetches state of connection DISTANCE positions ahead of
+		// position. Index of position p is indices[p*STRIDE], stream goes
+		// on over following neurons. Prefetch does not fault, only index
+		// has to be inside stream.
+		template<uint32_t DISTANCE, uint32_t STRIDE=1>
+		inline void PrefetchState(const float* x, const uint32_t* indices,
+				size_t position, uint32_t streamLength) {
+			if(DISTANCE && position+DISTANCE < streamLength)
+				PrefetchRead(x + indices[(position+DISTANCE)*STRIDE]);
+		}
+		
+		inline float FloatFromBits(uint32_t bits) {
+			float v;
+			memcpy(&v, &bits, sizeof(v));
+			return v;
+		}
+		
+		// branchless binary16 decode, rescales exponent with one multiply
+		// which also normalizes subnormals
+		inline float HalfBitsToFloat(uint32_t h) {
+			float v = FloatFromBits((h & 0x7FFF) << 13) * FloatFromBits(
+					(254-15) << 23);
+			uint32_t bits;
+			memcpy(&bits, &v, sizeof(bits));
+			if(v >= 65536.0f)
+				bits |= 255 << 23;
+			return FloatFromBits(bits | ((h & 0x8000) << 16));
+		}
+		
+		// Activated sum mixed with previous state, y = (1-a)*x + a*f(sum),
+		// state is overwritten when there is single leak rate of 1.
+		template<Activation ACTIVATION>
+		inline float Output(const NetworkView& net, const float* x,
+				uint32_t n, float sum) {
+			const uint32_t index = ACTIVATION == Activation::LOGISTIC_SAMPLING
+				&& net.samplingIndices ? net.samplingIndices[n] : n;
+			const float v = ActivateNeuron<ACTIVATION>(sum, index,
+					net.samplingSeed);
+			if(net.leakRates == nullptr && net.leakRate == 1.0f)
+				return v;
+			const float a = net.leakRates ? net.leakRates[n] : net.leakRate;
+			return x[n]*(1.0f-a) + v*a;
+		}
+		
+		// Any degree, UNROLL independent accumulators per neuron.
+		template<Activation ACTIVATION, uint32_t UNROLL, uint32_t PREFETCH>
+		inline void CalculateGeneric(const NetworkView& net, const float* x,
+				float* y, uint32_t begin, uint32_t end) {
+			for(uint32_t n=begin; n<end; ++n) {
+				const PerNeuronStatic info = net.perNeuronStatic[n];
+				if(info.weights_count == 0) {
+					y[n] = x[n];
+					continue;
+				}
+				const float* w = net.weights + info.weights_start;
+				const uint32_t* c = net.connections + info.weights_start;
+				const size_t start = info.weights_start;
+				float acc[UNROLL] = {};
+				uint32_t i = 0;
+				for(; i+UNROLL <= info.weights_count; i+=UNROLL) {
+					for(uint32_t j=0; j<UNROLL; ++j) {
+						PrefetchState<PREFETCH>(x, net.connections, start+i+j,
+								net.streamLength);
+						acc[j] += w[i+j] * x[c[i+j]];
+					}
+				}
+				float sum = net.bias[n];
+				for(; i<info.weights_count; ++i) {
+					PrefetchState<PREFETCH>(x, net.connections, start+i,
+							net.streamLength);
+					sum += w[i] * x[c[i]];
+				}
+				for(uint32_t j=0; j<UNROLL; ++j)
+					sum += acc[j];
+				y[n] = Output<ACTIVATION>(net, x, n, sum);
+			}
+		}
+		
+		// Every neuron from firstNeuron on has exactly DEGREE inputs stored
+		// at (n-firstNeuron)*DEGREE, no perNeuronStatic lookup. WIDTH
+		// neurons are accumulated side by side so compiler can vectorize
+		// across them.
+		template<Activation ACTIVATION, uint32_t DEGREE, uint32_t WIDTH,
+			uint32_t PREFETCH>
+		inline void CalculateFixedDegree(const NetworkView& net,
+				const float* x, float* y, uint32_t begin, uint32_t end,
+				uint32_t firstNeuron) {
+			uint32_t n = begin;
+			for(; n<end && n<firstNeuron; ++n)
+				y[n] = x[n];
+			for(; n+WIDTH <= end; n+=WIDTH) {
+				const size_t base = (size_t)(n-firstNeuron)*DEGREE;
+				const float* w = net.weights + base;
+				const uint32_t* c = net.connections + base;
+				float sum[WIDTH];
+				for(uint32_t l=0; l<WIDTH; ++l)
+					sum[l] = net.bias[n+l];
+				for(uint32_t i=0; i<DEGREE; ++i) {
+					for(uint32_t l=0; l<WIDTH; ++l) {
+						PrefetchState<PREFETCH>(x, net.connections,
+								base+l*DEGREE+i, net.streamLength);
+						sum[l] += w[l*DEGREE+i] * x[c[l*DEGREE+i]];
+					}
+				}
+				for(uint32_t l=0; l<WIDTH; ++l)
+					y[n+l] = Output<ACTIVATION>(net, x, n+l, sum[l]);
+			}
+			if(WIDTH > 1 && n < end)
+				CalculateFixedDegree<ACTIVATION, DEGREE, 1, PREFETCH>(net, x, y,
+						n, end, firstNeuron);
+		}
+		
+		// Reads connections from packedEdges, LAYOUT is one of interleaved
+		// layouts.
+		template<Activation ACTIVATION, EdgeLayout LAYOUT, uint32_t PREFETCH>
+		inline void CalculateInterleaved(const NetworkView& net,
+				const float* x, float* y, uint32_t begin, uint32_t end) {
+			for(uint32_t n=begin; n<end; ++n) {
+				const PerNeuronStatic info = net.packedStatic[n];
+				if(info.weights_count == 0) {
+					y[n] = x[n];
+					continue;
+				}
+				float acc[2] = {net.bias[n], 0.0f};
+				if(LAYOUT == EdgeLayout::INTERLEAVED_FP32) {
+					const size_t start = info.weights_start;
+					const uint32_t* e = net.packedEdges + start*2;
+					uint32_t i = 0;
+					for(; i+2 <= info.weights_count; i+=2) {
+						PrefetchState<PREFETCH, 2>(x, net.packedEdges, start+i,
+								net.streamLength);
+						PrefetchState<PREFETCH, 2>(x, net.packedEdges,
+								start+i+1, net.streamLength);
+						acc[0] += FloatFromBits(e[i*2+1]) * x[e[i*2]];
+						acc[1] += FloatFromBits(e[i*2+3]) * x[e[i*2+2]];
+					}
+					if(i < info.weights_count)
+						acc[0] += FloatFromBits(e[i*2+1]) * x[e[i*2]];
+				} else {
+					const uint32_t* e = net.packedEdges
+						+ info.weights_start/2*3;
+					const uint32_t pairs = (info.weights_count+1)/2;
+					// pair of connections shares 3 words, indices first
+					const size_t start = info.weights_start/2;
+					for(uint32_t p=0; p<pairs; ++p, e+=3) {
+						if(PREFETCH
+								&& (start+p)*2+PREFETCH < net.streamLength) {
+							const uint32_t* a = net.packedEdges
+								+ (start+p+PREFETCH/2)*3;
+							PrefetchRead(x + a[0]);
+							PrefetchRead(x + a[1]);
+						}
+						acc[0] += HalfBitsToFloat(e[2] & 0xFFFF) * x[e[0]];
+						acc[1] += HalfBitsToFloat(e[2] >> 16) * x[e[1]];
+					}
+				}
+				y[n] = Output<ACTIVATION>(net, x, n, acc[0] + acc[1]);
+			}
+		}
+		
+		// Calculates whole block, sums has blockNeurons elements.
+		template<Activation ACTIVATION, uint32_t PREFETCH>
+		inline void CalculateTiledBlock(const NetworkView& net,
+				const TiledView& tiles, const float* x, float* y,
+				uint32_t block, float* sums) {
+			const uint32_t first = block*tiles.blockNeurons;
+			const uint32_t count = std::min(tiles.blockNeurons,
+					tiles.neuronsCount-first);
+			std::fill(sums, sums+count, 0.0f);
+			const uint32_t end = tiles.blockStarts[block+1];
+			const uint32_t streamLength = tiles.blockStarts[
+				(tiles.neuronsCount + tiles.blockNeurons-1)/tiles.blockNeurons];
+			for(uint32_t e=tiles.blockStarts[block]; e<end; ++e) {
+				PrefetchState<PREFETCH>(x, tiles.sources, e, streamLength);
+				sums[tiles.targets[e]] += tiles.weights[e]
+					* x[tiles.sources[e]];
+			}
+			for(uint32_t l=0; l<count; ++l) {
+				const uint32_t n = first+l;
+				if(net.perNeuronStatic[n].weights_count == 0)
+					y[n] = x[n];
+				else
+					y[n] = Output<ACTIVATION>(net, x, n, net.bias[n] + sums[l]);
+			}
+		}
+		
+		// Picks template instantiation for runtime degree, width,
+		// net.activation and net.prefetchDistance, returns false when there
+		// is none.
+		bool DispatchFixedDegree(uint32_t degree, uint32_t width,
+				const NetworkView& net, const float* x, float* y,
+				uint32_t begin, uint32_t end, uint32_t firstNeuron);
+		
+		// any degree, any layout
+		void DispatchGeneric(const NetworkView& net, const float* x, float* y,
+				uint32_t begin, uint32_t end);
+		
+		// Blocks wholly inside [begin, end) use tiled connections, neurons
+		// of blocks cut by range use DispatchGeneric. sums is scratch of
+		// tiles.blockNeurons floats owned by calling thread.
+		void DispatchTiled(const NetworkView& net, const TiledView& tiles,
+				const float* x, float* y, uint32_t begin, uint32_t end,
+				float* sums);
+	}
+}
+
+#endif
+
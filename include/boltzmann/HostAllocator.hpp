@@ -0,0 +1,128 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BOLTZMANNNN_HOST_ALLOCATOR_HPP
+#define BOLTZMANNNN_HOST_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bn {
+	/*
+	 * Pages backing large host arrays. TRANSPARENT asks kernel for
+	 * transparent huge pages with madvise on 2 MiB aligned mapping,
+	 * HUGE_2M and HUGE_1G map explicit hugetlbfs pages, which have to be
+	 * reserved by administrator (vm.nr_hugepages). Request that cannot be
+	 * satisfied falls back to next smaller kind, page larger than array is
+	 * never used.
+	 */
+	enum class HostPages : uint32_t {
+		SMALL = 0,
+		TRANSPARENT = 1,
+		HUGE_2M = 2,
+		HUGE_1G = 3
+	};
+	
+	const char* HostPagesName(HostPages pages);
+	bool HostPagesFromName(const std::string& name, HostPages& pages);
+	
+	// Pages requested by later allocations, default SMALL.
+	void SetHostPages(HostPages pages);
+	HostPages GetHostPages();
+	// Pages actually backing allocation containing ptr.
+	HostPages HostPagesOf(const void* ptr);
+	
+	// Fresh pages of anonymous mapping for large arrays, so that first
+	// write to every page decides its NUMA node. Returns nullptr on failure.
+	void* HostAllocate(size_t bytes);
+	void HostFree(void* ptr, size_t bytes);
+	
+	/*
+	 * Placement of host arrays of network computed by thread pool. NONE
+	 * leaves pages where they were first written. FIRST_TOUCH copies every
+	 * array into fresh pages written by threads whose tasks read them.
+	 * BIND moves pages of every task's share to node of its home thread
+	 * with mbind, INTERLEAVE spreads pages over all nodes.
+	 */
+	enum class NumaPolicy : uint32_t {
+		NONE = 0,
+		FIRST_TOUCH = 1,
+		BIND = 2,
+		INTERLEAVE = 3
+	};
+	
+	const char* NumaPolicyName(NumaPolicy policy);
+	bool NumaPolicyFromName(const std::string& name, NumaPolicy& policy);
+	
+	// Sets memory policy of whole pages inside range and moves pages
+	// already there, huge pages are never split. Return 0 if no errors.
+	int HostBindToNode(void* ptr, size_t bytes, uint32_t node);
+	int HostInterleave(void* ptr, size_t bytes, uint32_t nodes);
+	
+	/*
+	 * Allocator of host network arrays. Elements are default initialized,
+	 * so resize leaves memory untouched and pages can be first touched by
+	 * threads that process them.
+	 */
+	template<typename T>
+	class HostAllocator {
+	public:
+		
+		using value_type = T;
+		
+		HostAllocator() = default;
+		template<typename U>
+		HostAllocator(const HostAllocator<U>&) {}
+		
+		T* allocate(size_t n) {
+			void* ptr = HostAllocate(n*sizeof(T));
+			if(ptr == nullptr)
+				throw std::bad_alloc();
+			return (T*)ptr;
+		}
+		
+		void deallocate(T* ptr, size_t n) {
+			HostFree(ptr, n*sizeof(T));
+		}
+		
+		template<typename U>
+		void construct(U* ptr) {
+			::new((void*)ptr) U;
+		}
+		
+		template<typename U, typename... Args>
+		void construct(U* ptr, Args&&... args) {
+			::new((void*)ptr) U(std::forward<Args>(args)...);
+		}
+		
+		template<typename U>
+		bool operator==(const HostAllocator<U>&) const { return true; }
+		template<typename U>
+		bool operator!=(const HostAllocator<U>&) const { return false; }
+	};
+	
+	template<typename T>
+	using HostVector = std::vector<T, HostAllocator<T>>;
+}
+
+#endif
+
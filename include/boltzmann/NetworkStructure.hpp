@@ -0,0 +1,109 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_NETWORK_STRUCTURE_HPP
+#define BOLTZMANNNN_NETWORK_STRUCTURE_HPP
+
+#include <cstdint>
+
+#include <vector>
+
+namespace bn {
+	struct PerNeuronStatic {
+		uint32_t weights_start;
+		uint32_t weights_count;
+	};
+	
+	// change of states made by single step
+	struct StateDelta {
+		float max = 0;
+		float l2 = 0;
+	};
+	
+	struct ConvergenceResult {
+		uint32_t steps = 0;
+		// last measured delta, may be older than last step
+		StateDelta delta;
+		bool converged = false;
+	};
+	
+	/*
+	 * Storage of connections read by calculation kernels. SEPARATE reads
+	 * weight and input index from two buffers. INTERLEAVED_FP32 stores
+	 * {index, weight bits} pair per connection. INTERLEAVED_FP16 stores
+	 * {index0, index1, half2(weight0, weight1)} per two connections of a
+	 * neuron, every neuron padded to even count with zero weight.
+	 */
+	enum class EdgeLayout : uint32_t {
+		SEPARATE = 0,
+		INTERLEAVED_FP32 = 1,
+		INTERLEAVED_FP16 = 2
+	};
+	
+	void RandomBuffer(std::vector<float>& buf, uint32_t count, float min,
+			float max);
+	void RandomBuffer(float* buf, uint32_t count, float min, float max);
+	
+	// Sorts and deduplicates inputs of every neuron, drops out of range
+	// indices and lays out connections of consecutive neurons one after
+	// another. Returns number of all connections.
+	uint32_t BuildNetworkStructure(
+			const std::vector<std::vector<uint32_t>>& input,
+			std::vector<std::vector<uint32_t>>& structure,
+			std::vector<PerNeuronStatic>& perNeuronStatic);
+	
+	// Returns K when every neuron after leading input-only neurons has
+	// exactly K inputs, 0 otherwise. firstNeuron is set to the first
+	// neuron with inputs.
+	uint32_t DetectFixedDegree(const PerNeuronStatic* perNeuronStatic,
+			uint32_t neurons, uint32_t& firstNeuron);
+	inline uint32_t DetectFixedDegree(
+			const std::vector<PerNeuronStatic>& perNeuronStatic,
+			uint32_t& firstNeuron) {
+		return DetectFixedDegree(perNeuronStatic.data(),
+				perNeuronStatic.size(), firstNeuron);
+	}
+	
+	// Fills start of every neuron's connections inside packed buffer
+	// (counted in connections, padding included) and returns size of
+	// packed buffer in 32 bit words.
+	uint32_t PackedEdgeStructure(EdgeLayout layout,
+			const std::vector<PerNeuronStatic>& perNeuronStatic,
+			std::vector<PerNeuronStatic>& packedStatic);
+	
+	// packed holds as many words as PackedEdgeStructure returns
+	void PackEdges(EdgeLayout layout, const PerNeuronStatic* perNeuronStatic,
+			const PerNeuronStatic* packedStatic, uint32_t neurons,
+			const uint32_t* connections, const float* weights,
+			uint32_t* packed);
+	inline void PackEdges(EdgeLayout layout,
+			const std::vector<PerNeuronStatic>& perNeuronStatic,
+			const std::vector<PerNeuronStatic>& packedStatic,
+			const uint32_t* connections, const float* weights,
+			uint32_t* packed) {
+		PackEdges(layout, perNeuronStatic.data(), packedStatic.data(),
+				perNeuronStatic.size(), connections, weights, packed);
+	}
+	
+	// IEEE 754 binary16, round to nearest even
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+}
+
+#endif
+
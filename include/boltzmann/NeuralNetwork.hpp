@@ -20,46 +20,67 @@
 #define BOLTZMANNNN_NEURAL_NETWORK_HPP
 
 #include <vector>
+#include <string>
 
-#include "../../OpenGLWrapper/include/openglwrapper/VBO.hpp"
 #include "../../OpenGLWrapper/include/openglwrapper/Shader.hpp"
 
-namespace gl {
-	template<typename T>
-	class SimpleVBO : public gl::VBO {
-	public:
-		SimpleVBO() : gl::VBO(sizeof(T), gl::ARRAY_BUFFER, gl::DYNAMIC_DRAW) {
-			this->Init();
-		}
-		
-		void UpdateElements(const T* data, uint32_t start, uint32_t count) {
-			if(start+count > this->GetVertexCount())
-				count = this->GetVertexCount()-start;
-			Update(data, start*sizeof(T), count*sizeof(T));
-		}
-		
-		void FetchElements(T* data, uint32_t start, uint32_t count) {
-			if(start+count > this->GetVertexCount())
-				count = this->GetVertexCount()-start;
-			Fetch(data, start*sizeof(T), count*sizeof(T));
-		}
-	};
-}
+#include "SimpleVBO.hpp"
+#include "NetworkStructure.hpp"
+#include "Profiler.hpp"
+#include "Activation.hpp"
 
 namespace bn {
-	void RandomBuffer(std::vector<float>& buf, uint32_t count, float min,
-			float max);
-	
 	void FillBufferWithRandom(gl::SimpleVBO<float>& vbo, float min, float max);
 	
+	// how invocations are assigned to neurons in calculation kernel
+	enum class KernelMapping : uint32_t {
+		THREAD_PER_NEURON = 0,
+		// subgroup sums one neuron with subgroupAdd (GL_KHR_shader_subgroup)
+		SUBGROUP_PER_NEURON = 1,
+		// `lanes` invocations sum one neuron with shared memory reduction
+		LANES_PER_NEURON = 2
+	};
+	
+	struct KernelConfig {
+		uint32_t workgroupSize = 256;
+		uint32_t unroll = 4;
+		bool vectorAccumulate = true;
+		KernelMapping mapping = KernelMapping::THREAD_PER_NEURON;
+		uint32_t lanes = 32;
+		// When non zero, workgroup whose inputs span at most xWindow
+		// consecutive neurons stages that slice of states in shared memory
+		// and gathers from it, other workgroups read global memory.
+		uint32_t xWindow = 0;
+		
+		bool operator==(const KernelConfig& o) const {
+			return workgroupSize == o.workgroupSize && unroll == o.unroll
+				&& vectorAccumulate == o.vectorAccumulate
+				&& mapping == o.mapping && lanes == o.lanes
+				&& xWindow == o.xWindow;
+		}
+		bool operator!=(const KernelConfig& o) const { return !(*this == o); }
+	};
+	
 	class NeuralNetwork {
 	public:
 		
-		NeuralNetwork();
+		NeuralNetwork(EdgeLayout edgeLayout = EdgeLayout::SEPARATE);
 		~NeuralNetwork();
 		
 		void InitEmptyNetwork(const std::vector<std::vector<uint32_t>>& structure);
 		
+		// Replica for another thread: calling thread's context has to share
+		// objects with context of source and source has to be idle
+		// (glFinish). Structure, weights and leak rates are views of source
+		// buffers, so weight updates of source are visible; states and
+		// kernels are own. Replica is meant for inference. Its writes never
+		// reach source: UpdateBiasWeights detaches weights and bias,
+		// pruning detaches structure and weights, SetLeakRates, packing of
+		// edges and input windows generate own buffers. Detached buffers
+		// stop following source. Source must not be pruned or
+		// reinitialized while replicas exist.
+		void InitShared(const NeuralNetwork& source);
+		
 		void SwapStates();
 		
 		void UpdateStates(const float* data, uint32_t start, uint32_t elements);
@@ -67,14 +88,88 @@ namespace bn {
 		
 		void PerformCalculation(uint32_t start, uint32_t count);
 		
+		// Reduces |stateNext - statePrevious| over whole network on device
+		// into small buffer, call after PerformCalculation and before
+		// SwapStates.
+		void ReduceStateDelta();
+		// waits for result of last ReduceStateDelta
+		StateDelta FetchStateDelta();
+		
+		// Steps whole network until largest change of a step is at most
+		// tolerance. Delta is reduced every pollInterval steps and read only
+		// once its fence is signaled, so GPU is never drained while
+		// waiting and up to a few pollIntervals of extra steps may run.
+		// Newest states are in statePrevious on return, as after
+		// SwapStates.
+		ConvergenceResult RunUntilConverged(float tolerance, uint32_t maxSteps,
+				uint32_t pollInterval=8);
+		
+		// Return 0 if no errors, previous kernel is kept on failure. Config
+		// set here or by Autotuner is kept by later InitEmptyNetwork; until
+		// then InitEmptyNetwork picks THREAD_PER_NEURON when network has
+		// fixed degree (its unrolled sum exists only for that mapping),
+		// otherwise DefaultKernelConfig of mean fan-in.
+		int SetKernelConfig(const KernelConfig& config);
+		inline const KernelConfig& GetKernelConfig() const {
+			return kernelConfig;
+		}
+		gl::Shader::Defines CalculationDefines(const KernelConfig& config) const;
+		gl::Shader::Defines CalculationDefines(const KernelConfig& config,
+				Activation activation) const;
+		
+		inline EdgeLayout GetEdgeLayout() const { return edgeLayout; }
+		
+		// return 0 if no errors, previous activation is kept on failure
+		int SetActivation(Activation activation);
+		inline Activation GetActivation() const { return activation; }
+		
+		// Leaky integrator fused into calculation kernel,
+		// y = (1-a)*x + a*f(sum), rate 1 overwrites state. Per neuron rates
+		// override single rate, nullptr removes them. Return 0 if no errors.
+		int SetLeakRate(float rate);
+		inline float GetLeakRate() const { return leakRate; }
+		int SetLeakRates(const float* rates);
+		
+		// Index of every neuron hashed by LOGISTIC_SAMPLING units instead of
+		// its own, so that network holding part of other network draws the
+		// same samples. nullptr hashes own indices. Return 0 if no errors.
+		int SetSamplingIndices(const uint32_t* indices);
+		
+		// Compiles kernel variant for every activation used by groups.
+		// Return 0 if no errors, previous groups are kept on failure.
+		int SetActivationGroups(const std::vector<ActivationGroup>& groups);
+		inline const std::vector<ActivationGroup>& GetActivationGroups() const {
+			return activationGroups;
+		}
+		
+		// 0 when GL_KHR_shader_subgroup arithmetic is unavailable in compute
+		// shaders
+		static uint32_t SubgroupSize();
+		// cooperative mapping for mean fan-in in [64, 4096], used by
+		// InitEmptyNetwork unless config was set or degree is fixed
+		static KernelConfig DefaultKernelConfig(uint32_t meanDegree);
+		
+		// states staged in shared memory when network is local enough
+		const static uint32_t DEFAULT_X_WINDOW = 4096;
+		
 		void UpdateBiasWeights(float* bias, float* weight);
 		
+		struct PruneStatistics {
+			uint32_t edgesBefore;
+			uint32_t edgesAfter;
+		};
+		
+		// Compaction runs on device, every neuron that had inputs keeps at
+		// least its strongest connection.
+		PruneStatistics PruneByThreshold(float threshold);
+		// Keeps k strongest connections of every neuron, ties broken by
+		// lower connection index. k of 0 is rejected, network is left
+		// unchanged and edgesAfter equals edgesBefore.
+		PruneStatistics PruneTopK(uint32_t k);
+		
 	public:
 		
-		struct PerNeuronStatic {
-			uint32_t weights_start;
-			uint32_t weights_count;
-		};
+		using PerNeuronStatic = bn::PerNeuronStatic;
 		
 		uint32_t weightsCount, neuronsCount;
 		
@@ -95,11 +190,98 @@ namespace bn {
 		
 		std::vector<PerNeuronStatic> perNeuronStaticInfoHost;
 		
+		// Copy of weights and weightsStructure in edgeLayout read by
+		// calculation kernel, rebuilt on device when weights change.
+		// Separate buffers stay canonical for updates and pruning.
+		gl::SimpleVBO<uint32_t> packedEdges;
+		gl::SimpleVBO<PerNeuronStatic> packedStatic;
+		std::vector<PerNeuronStatic> packedStaticHost;
+		
+		// non zero when kernel is specialized for every computed neuron
+		// having exactly fixedDegree inputs
+		uint32_t fixedDegree = 0;
+		uint32_t fixedDegreeFirstNeuron = 0;
+		
+		// fraction of workgroups of default kernel whose inputs fit in
+		// DEFAULT_X_WINDOW, computed at init
+		float inputWindowCoverage = 0;
+		
+		// kernel of default activation
 		gl::Shader calculationShader;
 		
+		// seed of LOGISTIC_SAMPLING units, advanced by SwapStates
+		uint32_t samplingSeed = 0;
+		
+		// not owned, operations are timed when set
+		Profiler* profiler = nullptr;
+		
 	private:
 		
+		PruneStatistics Prune(float threshold, uint32_t topK);
+		
+		void UpdateFixedDegree();
+		
+		void PackEdges();
+		
+		// compiles calculationShader and variants of activation groups,
+		// returns first error
+		int CompileKernels(const KernelConfig& config);
+		// SetKernelConfig without marking config as chosen by caller
+		int ApplyKernelConfig(const KernelConfig& config);
+		gl::Shader& KernelFor(Activation activation);
+		
+		// 0 - state overwritten, 1 - single leakRate, 2 - leakRates buffer
+		uint32_t LeakMode() const;
+		
+		// invocations summing single neuron
+		static uint32_t LanesPerNeuron(const KernelConfig& config);
+		
+		// Uploads [min, max] input index of every block of neuronsPerGroup
+		// neurons. Returns fraction of blocks with inputs spanning at most
+		// window neurons.
+		float UpdateInputWindows(uint32_t neuronsPerGroup, uint32_t window);
+		
+		KernelConfig kernelConfig;
+		// set by SetKernelConfig, InitEmptyNetwork keeps config then
+		bool kernelConfigSet = false;
+		
+		EdgeLayout edgeLayout;
+		Activation activation = Activation::TANH;
+		std::vector<ActivationGroup> activationGroups;
+		// indexed by activation, used only for activations of groups other
+		// than default
+		gl::Shader groupShaders[ACTIVATION_COUNT];
+		
+		float leakRate = 1.0f;
+		bool perNeuronLeak = false;
+		gl::SimpleVBO<float> leakRates;
+		
+		bool perNeuronSampling = false;
+		gl::SimpleVBO<uint32_t> samplingIndices;
+		
+		gl::SimpleVBO<uint32_t> inputWindows;
+		// neurons per block of uploaded inputWindows, 0 when outdated
+		uint32_t inputWindowsBlock = 0;
+		
+		gl::Shader pruneMarkShader;
+		gl::Shader pruneCompactShader;
+		gl::Shader packEdgesShader;
+		gl::Shader stateDeltaShader;
+		gl::Shader stateDeltaFinalShader;
+		
+		// per workgroup (max, sum of squares) and final (max, l2)
+		gl::SimpleVBO<float> stateDeltaPartials;
+		gl::SimpleVBO<float> stateDelta;
+		
+		const static uint32_t MAX_UNROLLED_DEGREE = 256;
+		
 		const static char* CALCULATIONS_SOURCE_CODE;
+		const static char* PRUNE_MARK_SOURCE_CODE;
+		const static char* PRUNE_COMPACT_SOURCE_CODE;
+		const static char* PACK_EDGES_SOURCE_CODE;
+		const static char* STATE_DELTA_SOURCE_CODE;
+		
+		const static uint32_t MAX_STATE_DELTA_GROUPS = 1024;
 	};
 }
 
@@ -0,0 +1,246 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_NEURAL_NETWORK_CPU_HPP
+#define BOLTZMANNNN_NEURAL_NETWORK_CPU_HPP
+
+#include <vector>
+
+#include "NetworkStructure.hpp"
+#include "CpuKernels.hpp"
+#include "HostAllocator.hpp"
+
+namespace bn {
+	class SharedNetworkImage;
+	class ThreadPool;
+	
+	/*
+	 * Host implementation with the same interface and state semantics as
+	 * NeuralNetwork: PerformCalculation reads statePrevious and writes
+	 * stateNext, UpdateStates writes statePrevious, FetchStates reads
+	 * stateNext.
+	 */
+	class NeuralNetworkCPU {
+	public:
+		
+		NeuralNetworkCPU(EdgeLayout edgeLayout = EdgeLayout::SEPARATE);
+		~NeuralNetworkCPU();
+		
+		void InitEmptyNetwork(const std::vector<std::vector<uint32_t>>& structure);
+		
+		// Network reading structure, weights, bias and leak rates from
+		// image, which has to outlive it. Only states (and leak rates when
+		// set later) are own, structure vectors stay empty and weights are
+		// read only. Return 0 if no errors.
+		int AttachImage(const SharedNetworkImage& image);
+		inline const SharedNetworkImage* GetImage() const { return image; }
+		
+		// PerformCalculation splits range into tasks of similar count of
+		// connections and runs them on pool, nullptr calculates on calling
+		// thread. Arrays are moved to fresh pages first touched by threads
+		// whose home tasks use them, again after every InitEmptyNetwork.
+		// Pool is not owned.
+		void SetThreadPool(ThreadPool* pool);
+		inline ThreadPool* GetThreadPool() const { return pool; }
+		
+		// Placement of arrays for thread pool, FIRST_TOUCH by default.
+		// With replicateStates every NUMA node of pool gets own copy of
+		// statePrevious, refreshed once per step by threads of that node,
+		// and gathers read copy of their node.
+		void SetNumaPolicy(NumaPolicy policy, bool replicateStates=false);
+		inline NumaPolicy GetNumaPolicy() const { return numaPolicy; }
+		inline bool GetReplicateStates() const { return replicateStates; }
+		
+		// Connections ahead in stream whose states kernels prefetch, 0
+		// (default) is plain gather. Rounded down to one of
+		// cpu::PREFETCH_DISTANCES.
+		inline void SetPrefetchDistance(uint32_t distance) {
+			prefetchDistance = distance;
+		}
+		inline uint32_t GetPrefetchDistance() const { return prefetchDistance; }
+		// Times whole network step with every distance of
+		// cpu::PREFETCH_DISTANCES on this machine, applies and returns the
+		// fastest. Only stateNext is modified while measuring.
+		uint32_t TunePrefetchDistance(uint32_t iterations=4);
+		
+		// Cache blocked execution for states larger than caches.
+		// Connections of every block of blockNeurons neurons are grouped
+		// by tile of tileNeurons source neurons, so gathers of block go over
+		// one slice of statePrevious at a time into partial sums. Tasks
+		// are aligned to blocks and weights are read in full precision
+		// whatever the edge layout. 0 tileNeurons turns it off. blockNeurons
+		// is multiple of 16 up to cpu::TILED_MAX_BLOCK. Not available for
+		// network attached to image. Return 0 if no errors.
+		int SetTiling(uint32_t tileNeurons, uint32_t blockNeurons=16384);
+		inline uint32_t GetTileNeurons() const { return tileNeurons; }
+		inline uint32_t GetTileBlockNeurons() const { return tileBlockNeurons; }
+		cpu::TiledView GetTiledView() const;
+		
+		void SwapStates();
+		
+		void UpdateStates(const float* data, uint32_t start, uint32_t elements);
+		void FetchStates(float* data, uint32_t start, uint32_t elements);
+		
+		void PerformCalculation(uint32_t start, uint32_t count);
+		
+		// |stateNext - statePrevious| over whole network
+		StateDelta ComputeStateDelta() const;
+		
+		// Same semantics as NeuralNetwork::RunUntilConverged, delta is
+		// checked every pollInterval steps.
+		ConvergenceResult RunUntilConverged(float tolerance, uint32_t maxSteps,
+				uint32_t pollInterval=8);
+		
+		void UpdateBiasWeights(float* bias, float* weight);
+		
+		cpu::NetworkView GetView() const;
+		
+		inline EdgeLayout GetEdgeLayout() const { return edgeLayout; }
+		
+		inline void SetActivation(Activation activation) {
+			this->activation = activation;
+		}
+		inline Activation GetActivation() const { return activation; }
+		
+		// Leaky integrator, y = (1-a)*x + a*f(sum), rate 1 overwrites
+		// state. Per neuron rates override single rate, nullptr removes
+		// them.
+		inline void SetLeakRate(float rate) { leakRate = rate; }
+		inline float GetLeakRate() const { return leakRate; }
+		void SetLeakRates(const float* rates);
+		
+		// Index of every neuron hashed by LOGISTIC_SAMPLING units instead of
+		// its own, so that network holding part of other network draws the
+		// same samples. nullptr hashes own indices.
+		void SetSamplingIndices(const uint32_t* indices);
+		
+		// return 0 if no errors, previous groups are kept on failure
+		int SetActivationGroups(const std::vector<ActivationGroup>& groups);
+		inline const std::vector<ActivationGroup>& GetActivationGroups() const {
+			return activationGroups;
+		}
+		
+	public:
+		
+		using PerNeuronStatic = bn::PerNeuronStatic;
+		
+		uint32_t weightsCount, neuronsCount;
+		
+		std::vector<std::vector<uint32_t>> structure;
+		
+		float *statePrevious, *stateNext;
+		
+		HostVector<PerNeuronStatic> perNeuronStatic;
+		HostVector<float> states[2];
+		
+		HostVector<uint32_t> weightsStructure;
+		HostVector<float> weights;
+		
+		HostVector<float> bias;
+		
+		// copy of weights and weightsStructure in edgeLayout, rebuilt when
+		// weights change
+		HostVector<PerNeuronStatic> packedStatic;
+		HostVector<uint32_t> packedEdges;
+		
+		// copy of weights and weightsStructure ordered by blocks of
+		// tileBlockNeurons neurons and tiles of tileNeurons sources, empty
+		// when tiling is off, rebuilt when weights change
+		uint32_t tileNeurons, tileBlockNeurons;
+		std::vector<uint32_t> tiledBlockStarts;
+		HostVector<uint32_t> tiledSources;
+		HostVector<uint16_t> tiledTargets;
+		HostVector<float> tiledWeights;
+		// partial sums of tiled blocks, tileBlockNeurons floats for every
+		// thread of pool, first touched by its thread
+		HostVector<float> tileScratch;
+		
+		// non zero when every computed neuron has exactly fixedDegree inputs
+		uint32_t fixedDegree;
+		uint32_t fixedDegreeFirstNeuron;
+		
+		// neurons accumulated together by fixed degree kernels: 1, 4 or 8
+		uint32_t batchWidth;
+		
+		uint32_t prefetchDistance;
+		uint32_t streamLength;
+		
+		// seed of LOGISTIC_SAMPLING units, advanced by SwapStates
+		uint32_t samplingSeed;
+		// empty when neurons hash own indices
+		HostVector<uint32_t> samplingIndices;
+		
+		// empty when single leakRate is used
+		HostVector<float> leakRates;
+		
+		// tasks per pool thread, more tasks balance better
+		const static uint32_t TASKS_PER_THREAD = 8;
+		// work of neuron besides its connections, in connections
+		const static uint32_t NEURON_COST = 4;
+		
+	private:
+		
+		void PackEdges();
+		void PackTiles();
+		// end of connection stream read by kernels, bounds prefetching
+		void UpdateStreamLength();
+		
+		// x is statePrevious or its replica, thread indexes tileScratch
+		void CalculateRange(uint32_t begin, uint32_t end, const float* x,
+				uint32_t thread);
+		
+		// copies statePrevious to replica of every node
+		void RefreshReplicas();
+		
+		// sizes tileScratch for tiling and pool
+		void UpdateTileScratch();
+		
+		// prefix of work and placement of arrays, called at init
+		void UpdateWorkPrefix();
+		void PlaceMemory();
+		
+		// bounds of tasks of similar work covering [begin, end), aligned to
+		// cache lines of states
+		void Partition(uint32_t begin, uint32_t end, uint32_t tasks,
+				std::vector<uint32_t>& bounds) const;
+		
+		ThreadPool* pool;
+		// workPrefix[i] is work of neurons [0, i)
+		std::vector<uint64_t> workPrefix;
+		std::vector<uint32_t> taskBounds;
+		uint32_t taskBegin, taskEnd;
+		
+		NumaPolicy numaPolicy;
+		bool replicateStates;
+		// indexed by node, valid until states change
+		std::vector<HostVector<float>> stateReplicas;
+		bool replicasValid;
+		
+		EdgeLayout edgeLayout;
+		Activation activation;
+		std::vector<ActivationGroup> activationGroups;
+		float leakRate;
+		
+		const SharedNetworkImage* image;
+		// per neuron rates of image are used
+		bool imageLeakRates;
+	};
+}
+
+#endif
+
@@ -0,0 +1,60 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_PREFIX_SUM_HPP
+#define BOLTZMANNNN_PREFIX_SUM_HPP
+
+#include <vector>
+
+#include "../../OpenGLWrapper/include/openglwrapper/Shader.hpp"
+
+#include "SimpleVBO.hpp"
+
+namespace bn {
+	/*
+	 * On-device exclusive prefix sum over uint32 buffers. Every workgroup
+	 * scans 256 elements in shared memory, block totals are scanned
+	 * recursively and added back.
+	 */
+	class PrefixSum {
+	public:
+		
+		PrefixSum();
+		~PrefixSum();
+		
+		// returns sum of all first count elements before scan
+		uint32_t ExclusiveScan(gl::SimpleVBO<uint32_t>& data, uint32_t count);
+		
+	private:
+		
+		uint32_t ScanLevel(gl::SimpleVBO<uint32_t>& data, uint32_t count,
+				uint32_t level);
+		
+		gl::Shader scanShader;
+		gl::Shader addShader;
+		
+		std::vector<gl::SimpleVBO<uint32_t>*> blockSums;
+		
+		const static uint32_t BLOCK_SIZE;
+		const static char* SCAN_SOURCE_CODE;
+		const static char* ADD_SOURCE_CODE;
+	};
+}
+
+#endif
+
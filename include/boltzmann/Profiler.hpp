@@ -0,0 +1,129 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_PROFILER_HPP
+#define BOLTZMANNNN_PROFILER_HPP
+
+#include <cstdint>
+
+#include <vector>
+#include <string>
+
+#include <GL/glew.h>
+
+namespace bn {
+	/*
+	 * Measures GPU time of network operations with GL_TIME_ELAPSED queries.
+	 * Queries live in a ring and results are only read once available, so
+	 * profiling never waits for GPU. When the ring is full of pending
+	 * queries a sample is dropped instead.
+	 */
+	class Profiler {
+	public:
+		
+		enum Operation {
+			PERFORM_CALCULATION = 0,
+			UPDATE_STATES,
+			FETCH_STATES,
+			UPDATE_BIAS_WEIGHTS,
+			OPERATIONS_COUNT
+		};
+		
+		// Log-linear histogram with 8 buckets per power of two nanoseconds.
+		class Histogram {
+		public:
+			
+			Histogram();
+			
+			void Record(uint64_t nanoseconds);
+			void Clear();
+			
+			// p in range [0, 1], returns nanoseconds
+			double Percentile(double p) const;
+			
+			inline uint64_t Count() const { return count; }
+			inline double Mean() const { return count ? sum/(double)count : 0; }
+			inline uint64_t Min() const { return count ? min : 0; }
+			inline uint64_t Max() const { return max; }
+			
+		private:
+			
+			static uint32_t Bucket(uint64_t nanoseconds);
+			static double BucketValue(uint32_t bucket);
+			
+			const static uint32_t SUB_BUCKETS = 8;
+			const static uint32_t BUCKETS = 64*SUB_BUCKETS;
+			
+			std::vector<uint64_t> buckets;
+			uint64_t count, min, max;
+			double sum;
+		};
+		
+		struct TraceEvent {
+			Operation operation;
+			uint64_t start;
+			uint64_t duration;
+		};
+		
+		Profiler(uint32_t ringSize=64, uint32_t maxTraceEvents=65536);
+		~Profiler();
+		
+		void Begin(Operation operation);
+		void End(Operation operation);
+		
+		// reads results of all finished queries without waiting
+		void Collect();
+		
+		void Clear();
+		
+		const Histogram& GetHistogram(Operation operation) const;
+		inline uint64_t DroppedSamples() const { return dropped; }
+		
+		std::string StatisticsJSON() const;
+		std::string ChromeTraceJSON() const;
+		bool DumpChromeTrace(const std::string& filePath) const;
+		
+		static const char* OperationName(Operation operation);
+		
+	private:
+		
+		struct Slot {
+			GLuint elapsedQuery;
+			GLuint timestampQuery;
+			GLuint endTimestampQuery;
+			Operation operation;
+			bool pending;
+		};
+		
+		bool Retire(Slot& slot);
+		
+		std::vector<Slot> ring;
+		uint32_t head, tail;
+		bool active;
+		
+		Histogram histograms[OPERATIONS_COUNT];
+		
+		std::vector<TraceEvent> trace;
+		uint32_t maxTraceEvents;
+		uint32_t traceNext;
+		uint64_t dropped;
+	};
+}
+
+#endif
+
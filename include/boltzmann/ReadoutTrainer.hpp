@@ -0,0 +1,94 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BOLTZMANNNN_READOUT_TRAINER_HPP
+#define BOLTZMANNNN_READOUT_TRAINER_HPP
+
+#include <cstdint>
+
+#include <vector>
+
+#include "../../OpenGLWrapper/include/openglwrapper/Shader.hpp"
+
+#include "SimpleVBO.hpp"
+#include "NeuralNetwork.hpp"
+
+namespace bn {
+	/*
+	 * Trains linear readout of reservoir by ridge regression without
+	 * downloading state history. Every Accumulate gathers chosen neurons of
+	 * network into a block of rows on device; full blocks are folded into
+	 * fp64 matrices X^T X and X^T Y by tiled kernel. Solve downloads only
+	 * those matrices and runs Cholesky decomposition on host.
+	 */
+	class ReadoutTrainer {
+	public:
+		
+		ReadoutTrainer();
+		~ReadoutTrainer();
+		
+		// Features are states of given neurons, with constant 1 appended
+		// when bias is set. Clears accumulated samples.
+		void Init(const std::vector<uint32_t>& features, uint32_t outputs,
+				bool bias=true, uint32_t blockRows=256);
+		
+		// Adds sample of stateNext of network (call after
+		// PerformCalculation, before SwapStates) with `outputs` targets.
+		void Accumulate(NeuralNetwork& network, const float* targets);
+		
+		// folds buffered rows into matrices, called by Solve
+		void Flush();
+		
+		void Clear();
+		
+		// Solves (X^T X + ridge*I) W = X^T Y, bias weight is not
+		// regularized. Weights are stored per output, GetDimension() each,
+		// bias last. Returns -1 when matrix is not positive definite.
+		int Solve(double ridge, std::vector<float>& weights);
+		
+		inline uint32_t GetDimension() const { return dimension; }
+		inline uint32_t GetOutputs() const { return outputs; }
+		inline uint64_t GetSamples() const { return samples; }
+		
+	private:
+		
+		uint32_t featuresCount, dimension, outputs;
+		uint32_t blockRows, rows;
+		uint64_t samples;
+		bool bias;
+		
+		std::vector<float> targetsHost;
+		
+		gl::SimpleVBO<uint32_t> features;
+		gl::SimpleVBO<float> rowsBlock;
+		gl::SimpleVBO<float> targetsBlock;
+		// dimension x (dimension+outputs), upper triangle of X^T X followed
+		// by X^T Y in every row
+		gl::SimpleVBO<double> gram;
+		
+		gl::Shader gatherShader;
+		gl::Shader gramShader;
+		
+		const static uint32_t TILE = 16;
+		
+		const static char* GATHER_SOURCE_CODE;
+		const static char* GRAM_SOURCE_CODE;
+	};
+}
+
+#endif
+
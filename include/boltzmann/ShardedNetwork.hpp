@@ -0,0 +1,174 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BOLTZMANNNN_SHARDED_NETWORK_HPP
+#define BOLTZMANNNN_SHARDED_NETWORK_HPP
+
+#include <cstdint>
+
+#include <vector>
+#include <memory>
+
+#include "NetworkStructure.hpp"
+#include "Activation.hpp"
+
+namespace gl {
+	class OpenGL;
+}
+
+namespace bn {
+	class ThreadPool;
+	
+	/*
+	 * Network partitioned by neuron ranges into shards, each a separate
+	 * Network (NeuralNetwork or NeuralNetworkCPU). Shard holds its own
+	 * neurons and copies (halo) of neurons of other shards it reads.
+	 * Exchange lists are built from structure at init: after every step
+	 * only owned neurons read by other shards are fetched, and every shard
+	 * receives only those it reads. Interface and state semantics are the
+	 * same as of single network, with global neuron indices; connections
+	 * and weights are in order of BuildNetworkStructure of whole network.
+	 *
+	 * Local order of shard is: halo grouped by source shard, owned input
+	 * only neurons, owned neurons read by other shards, remaining owned
+	 * neurons, so that sent neurons are contiguous and fixed degree
+	 * detection still sees leading input only neurons. Shards hash global
+	 * indices of their neurons in LOGISTIC_SAMPLING units, so samples are
+	 * the same as of single network.
+	 *
+	 * Host shards run in parallel on pool with thread per shard, created
+	 * at init and kept for lifetime of network.
+	 */
+	template<typename Network>
+	class ShardedNetwork {
+	public:
+		
+		ShardedNetwork(EdgeLayout edgeLayout = EdgeLayout::SEPARATE);
+		~ShardedNetwork();
+		
+		// Splits into shardCount ranges with similar connection counts.
+		// Structure should be ordered for locality beforehand, halo grows
+		// with connections crossing ranges. For NeuralNetwork contexts
+		// holds context of every shard (objects of shard are created and
+		// used with it current) or is empty to use current context for all.
+		void InitEmptyNetwork(const std::vector<std::vector<uint32_t>>& structure,
+				uint32_t shardCount,
+				const std::vector<gl::OpenGL*>& contexts = {});
+		// rangeEnds are exclusive ends of shard ranges, last one is number of
+		// neurons
+		void InitEmptyNetwork(const std::vector<std::vector<uint32_t>>& structure,
+				const std::vector<uint32_t>& rangeEnds,
+				const std::vector<gl::OpenGL*>& contexts = {});
+		
+		// exchanges halo and swaps states of every shard
+		void SwapStates();
+		
+		void UpdateStates(const float* data, uint32_t start, uint32_t elements);
+		void FetchStates(float* data, uint32_t start, uint32_t elements);
+		
+		void PerformCalculation(uint32_t start, uint32_t count);
+		
+		void UpdateBiasWeights(float* bias, float* weight);
+		
+		void SetActivation(Activation activation);
+		void SetLeakRate(float rate);
+		void SetLeakRates(const float* rates);
+		
+		inline uint32_t GetShardCount() const { return shards.size(); }
+		inline Network& GetShard(uint32_t shard) {
+			return *shards[shard].network;
+		}
+		inline uint32_t GetShardBegin(uint32_t shard) const {
+			return shards[shard].begin;
+		}
+		inline uint32_t GetShardEnd(uint32_t shard) const {
+			return shards[shard].end;
+		}
+		// copies of other shards' neurons held by shard
+		inline uint32_t GetHaloSize(uint32_t shard) const {
+			return shards[shard].haloCount;
+		}
+		// neurons sent by shard after every step
+		inline uint32_t GetSendSize(uint32_t shard) const {
+			return shards[shard].sendCount;
+		}
+		
+	public:
+		
+		uint32_t weightsCount, neuronsCount;
+		
+	private:
+		
+		// consecutive local neurons
+		struct Run {
+			uint32_t local;
+			uint32_t count;
+		};
+		
+		struct Halo {
+			uint32_t source;
+			// first local neuron of halo segment
+			uint32_t local;
+			// position of every neuron in send buffer of source
+			std::vector<uint32_t> positions;
+		};
+		
+		struct Shard {
+			std::unique_ptr<Network> network;
+			gl::OpenGL* context = nullptr;
+			uint32_t begin = 0, end = 0;
+			uint32_t haloCount = 0;
+			uint32_t sendLocal = 0, sendCount = 0;
+			// owned neurons in global order
+			std::vector<uint32_t> localOfOwned;
+			std::vector<uint32_t> globalOfLocal;
+			// global connection index of every local connection
+			std::vector<uint32_t> weightSource;
+			std::vector<Halo> halos;
+			std::vector<float> sendBuffer;
+			std::vector<float> buffer;
+			// runs of last PerformCalculation range
+			uint32_t runsStart = 0, runsCount = 0;
+			std::vector<Run> runs;
+		};
+		
+		// Local runs of global range [start, start+count) of owned neurons
+		// in order of local index. Halo copies are included when halo is
+		// set.
+		static void CollectRuns(const Shard& shard, uint32_t start,
+				uint32_t count, bool halo, std::vector<Run>& runs);
+		
+		// Calls f for every shard with context of shard current, host
+		// shards run in parallel when allowed.
+		template<typename F>
+		void ForEachShard(F&& f, bool parallel=true);
+		
+		EdgeLayout edgeLayout;
+		// runs host shards, nullptr for single shard or GPU shards
+		std::unique_ptr<ThreadPool> pool;
+		std::vector<Shard> shards;
+	};
+	
+	class NeuralNetwork;
+	class NeuralNetworkCPU;
+	
+	extern template class ShardedNetwork<NeuralNetwork>;
+	extern template class ShardedNetwork<NeuralNetworkCPU>;
+}
+
+#endif
+
@@ -0,0 +1,101 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BOLTZMANNNN_SHARED_NETWORK_IMAGE_HPP
+#define BOLTZMANNNN_SHARED_NETWORK_IMAGE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <string>
+#include <vector>
+
+#include "NetworkStructure.hpp"
+#include "Activation.hpp"
+
+namespace bn {
+	class NeuralNetworkCPU;
+	
+	/*
+	 * Read only part of NeuralNetworkCPU (structure, weights, bias, packed
+	 * edges, leak rates and activation groups) in POSIX shared memory
+	 * segment, in the same layout as host backend uses. Owner process
+	 * creates image once, workers attach to it read only and run
+	 * NeuralNetworkCPU::AttachImage networks with private states, so every
+	 * worker adds only O(neurons) memory.
+	 */
+	class SharedNetworkImage {
+	public:
+		
+		SharedNetworkImage();
+		~SharedNetworkImage();
+		
+		// Name is POSIX shared memory name, like "/network". Existing
+		// segment of the same name is replaced. Return 0 if no errors.
+		int Create(const char* name, const NeuralNetworkCPU& network);
+		// Maps existing segment read only. Sizes of arrays, ranges of
+		// neurons and input indices are checked against counts in header,
+		// so truncated or mismatched segment is refused. Return 0 if no
+		// errors.
+		int Attach(const char* name);
+		// unmaps segment, owner also removes its name, attached processes
+		// keep their mappings
+		void Close();
+		
+		inline bool IsOpen() const { return header != nullptr; }
+		inline bool IsOwner() const { return owner; }
+		inline size_t GetSize() const { return size; }
+		
+		uint32_t GetNeuronsCount() const;
+		uint32_t GetWeightsCount() const;
+		EdgeLayout GetEdgeLayout() const;
+		Activation GetActivation() const;
+		float GetLeakRate() const;
+		uint32_t GetFixedDegree() const;
+		uint32_t GetFixedDegreeFirstNeuron() const;
+		
+		const PerNeuronStatic* GetPerNeuronStatic() const;
+		const uint32_t* GetConnections() const;
+		const float* GetWeights() const;
+		const float* GetBias() const;
+		// nullptr for SEPARATE layout
+		const PerNeuronStatic* GetPackedStatic() const;
+		const uint32_t* GetPackedEdges() const;
+		// nullptr when network used single leak rate
+		const float* GetLeakRates() const;
+		// normalized groups of network, empty when it had none
+		std::vector<ActivationGroup> GetActivationGroups() const;
+		
+	private:
+		
+		struct Header;
+		
+		template<typename T>
+		const T* Array(int index) const;
+		
+		static bool Validate(const Header* header, const void* mapping);
+		
+		const Header* header;
+		void* data;
+		size_t size;
+		std::string name;
+		bool owner;
+	};
+}
+
+#endif
+
@@ -0,0 +1,47 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_SIMPLE_VBO_HPP
+#define BOLTZMANNNN_SIMPLE_VBO_HPP
+
+#include "../../OpenGLWrapper/include/openglwrapper/VBO.hpp"
+
+namespace gl {
+	template<typename T>
+	class SimpleVBO : public gl::VBO {
+	public:
+		SimpleVBO() : gl::VBO(sizeof(T), gl::ARRAY_BUFFER, gl::DYNAMIC_DRAW) {
+			this->Init();
+		}
+		
+		void UpdateElements(const T* data, uint32_t start, uint32_t count) {
+			if(start+count > this->GetVertexCount())
+				count = this->GetVertexCount()-start;
+			Update(data, start*sizeof(T), count*sizeof(T));
+		}
+		
+		void FetchElements(T* data, uint32_t start, uint32_t count) {
+			if(start+count > this->GetVertexCount())
+				count = this->GetVertexCount()-start;
+			Fetch(data, start*sizeof(T), count*sizeof(T));
+		}
+	};
+}
+
+#endif
+
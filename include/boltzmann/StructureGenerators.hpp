@@ -0,0 +1,52 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOLTZMANNNN_STRUCTURE_GENERATORS_HPP
+#define BOLTZMANNNN_STRUCTURE_GENERATORS_HPP
+
+#include <cstdint>
+
+#include <vector>
+
+namespace bn {
+	/*
+	 * Synthetic network topologies. First inputNeurons neurons have no
+	 * inputs, every other neuron gets distinct inputs from whole network.
+	 */
+	
+	// every computed neuron has exactly fanIn inputs
+	void GenerateUniformStructure(std::vector<std::vector<uint32_t>>& structure,
+			uint32_t neurons, uint32_t fanIn, uint32_t inputNeurons,
+			uint64_t seed);
+	
+	// fan-in follows Pareto distribution with given mean and exponent
+	// (alpha > 1), few hub neurons get most of connections
+	void GeneratePowerLawStructure(
+			std::vector<std::vector<uint32_t>>& structure, uint32_t neurons,
+			uint32_t meanFanIn, float exponent, uint32_t inputNeurons,
+			uint64_t seed);
+	
+	// inputs are drawn from window of +-radius neurons around every neuron
+	void GenerateClusteredStructure(
+			std::vector<std::vector<uint32_t>>& structure, uint32_t neurons,
+			uint32_t fanIn, uint32_t radius, uint32_t inputNeurons,
+			uint64_t seed);
+}
+
+#endif
+
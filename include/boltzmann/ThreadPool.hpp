@@ -0,0 +1,104 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BOLTZMANNNN_THREAD_POOL_HPP
+#define BOLTZMANNNN_THREAD_POOL_HPP
+
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bn {
+	/*
+	 * Work stealing pool for host kernels. Run splits task indices into
+	 * contiguous home blocks, thread t starts with block t and takes tasks
+	 * from its front; thread which runs out steals back half of remaining
+	 * tasks of next thread that has any. Threads are pinned to CPUs
+	 * ordered by NUMA node, so home block of a thread always runs on the
+	 * same node and memory first touched by it stays local.
+	 */
+	class ThreadPool {
+	public:
+		
+		using Task = std::function<void(uint32_t task, uint32_t thread)>;
+		
+		// threads 0 uses every CPU
+		ThreadPool(uint32_t threads=0, bool pin=true);
+		~ThreadPool();
+		
+		// Calls f for every task in [0, tasks) and waits for all. Without
+		// steal every task runs on thread of its home block.
+		void Run(uint32_t tasks, const Task& f, bool steal=true);
+		
+		inline uint32_t GetThreadCount() const { return threadsCount; }
+		inline uint32_t GetNodeCount() const { return nodesCount; }
+		// NUMA node of CPU thread is pinned to, 0 when not pinned
+		inline uint32_t GetNode(uint32_t thread) const {
+			return workers[thread].node;
+		}
+		// tasks taken from other threads' blocks since construction
+		inline uint64_t GetStolenTasks() const { return stolen; }
+		
+		// first task of home block of thread
+		static inline uint32_t HomeBegin(uint32_t tasks, uint32_t threads,
+				uint32_t thread) {
+			return (uint64_t)tasks * thread / threads;
+		}
+		
+		// CPUs of every NUMA node read from sysfs, single node with every
+		// CPU when unavailable
+		static std::vector<std::vector<int>> NumaTopology();
+		
+	private:
+		
+		struct alignas(64) Worker {
+			// remaining tasks, begin in high and end in low 32 bits
+			std::atomic<uint64_t> range;
+			std::thread thread;
+			int cpu = -1;
+			uint32_t node = 0;
+		};
+		
+		void WorkerLoop(uint32_t index);
+		bool Pop(uint32_t index, uint32_t& task);
+		bool Steal(uint32_t index, uint32_t& task);
+		
+		std::unique_ptr<Worker[]> workers;
+		uint32_t threadsCount;
+		uint32_t nodesCount;
+		
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		uint64_t generation;
+		uint32_t running;
+		bool stop;
+		const Task* task;
+		bool steal;
+		
+		std::atomic<uint64_t> stolen;
+	};
+}
+
+#endif
+
@@ -0,0 +1,69 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "../include/boltzmann/Activation.hpp"
+
+namespace bn {
+	static const char* ACTIVATION_NAMES[] = {"tanh", "tanh_pade",
+		"tanh_polynomial", "sigmoid", "relu", "hard_tanh",
+		"logistic_sampling"};
+	
+	const char* ActivationName(Activation activation) {
+		const uint32_t i = (uint32_t)activation;
+		return i < sizeof(ACTIVATION_NAMES)/sizeof(*ACTIVATION_NAMES) ?
+			ACTIVATION_NAMES[i] : "unknown";
+	}
+	
+	bool ActivationFromName(const std::string& name, Activation& activation) {
+		for(uint32_t i=0; i<sizeof(ACTIVATION_NAMES)/sizeof(*ACTIVATION_NAMES);
+				++i) {
+			if(name == ACTIVATION_NAMES[i]) {
+				activation = (Activation)i;
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	float ActivationMaxError(Activation activation) {
+		switch(activation) {
+			case Activation::TANH_PADE:
+				return 9.6e-5f;
+			case Activation::TANH_POLYNOMIAL:
+				return 5.5e-3f;
+			default:
+				return 0.0f;
+		}
+	}
+	
+	bool NormalizeActivationGroups(std::vector<ActivationGroup>& groups) {
+		groups.erase(std::remove_if(groups.begin(), groups.end(),
+					[](const ActivationGroup& g) { return g.begin >= g.end; }),
+				groups.end());
+		std::sort(groups.begin(), groups.end(),
+				[](const ActivationGroup& a, const ActivationGroup& b) {
+					return a.begin < b.begin;
+				});
+		for(uint32_t i=0; i<groups.size(); ++i) {
+			if((uint32_t)groups[i].activation >= ACTIVATION_COUNT)
+				return false;
+			if(i && groups[i].begin < groups[i-1].end)
+				return false;
+		}
+		return true;
+	}
+}
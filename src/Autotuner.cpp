@@ -0,0 +1,226 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "../include/boltzmann/Autotuner.hpp"
+
+namespace bn {
+	Autotuner::Autotuner(const std::string& cacheFilePath) :
+		cacheFilePath(cacheFilePath) {
+	}
+	
+	KernelConfig Autotuner::Tune(NeuralNetwork& nn, uint32_t iterations,
+			bool useCache) {
+		const std::string key = DeviceKey() + "\t" + NetworkShapeKey(nn);
+		KernelConfig best;
+		if(useCache && LoadCached(key, best)) {
+			if(nn.SetKernelConfig(best) == 0)
+				return best;
+		}
+		
+		const KernelConfig previous = nn.GetKernelConfig();
+		best = previous;
+		double bestTime = INFINITY;
+		for(const KernelConfig& config : Candidates()) {
+			if(nn.SetKernelConfig(config) != 0)
+				continue;
+			Measure(nn, 1);
+			double t = std::min(Measure(nn, iterations),
+					Measure(nn, iterations));
+			if(t < bestTime) {
+				bestTime = t;
+				best = config;
+			}
+		}
+		
+		if(nn.SetKernelConfig(best) != 0) {
+			nn.SetKernelConfig(previous);
+			return previous;
+		}
+		if(bestTime != INFINITY)
+			StoreCached(key, best);
+		return best;
+	}
+	
+	double Autotuner::Measure(NeuralNetwork& nn, uint32_t iterations) {
+		GLuint queries[2];
+		GLuint64 start = 0, end = 0;
+		Profiler* profiler = nn.profiler;
+		nn.profiler = nullptr;
+		glGenQueries(2, queries);
+		glQueryCounter(queries[0], GL_TIMESTAMP);
+		for(uint32_t i=0; i<iterations; ++i)
+			nn.PerformCalculation(0, nn.neuronsCount);
+		glQueryCounter(queries[1], GL_TIMESTAMP);
+		glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+		glDeleteQueries(2, queries);
+		GL_CHECK_PUSH_ERROR;
+		nn.profiler = profiler;
+		return (double)(end-start) / std::max<uint32_t>(iterations, 1);
+	}
+	
+	std::vector<KernelConfig> Autotuner::Candidates() {
+		std::vector<KernelConfig> candidates;
+		for(uint32_t workgroupSize : {64, 128, 256, 512}) {
+			for(uint32_t unroll : {1, 2, 4, 8}) {
+				KernelConfig config;
+				config.workgroupSize = workgroupSize;
+				config.unroll = unroll;
+				config.vectorAccumulate = false;
+				candidates.emplace_back(config);
+				if(unroll >= 4) {
+					config.vectorAccumulate = true;
+					candidates.emplace_back(config);
+				}
+			}
+		}
+		for(uint32_t workgroupSize : {64, 128, 256}) {
+			KernelConfig config;
+			config.workgroupSize = workgroupSize;
+			config.unroll = 1;
+			config.vectorAccumulate = false;
+			config.mapping = KernelMapping::SUBGROUP_PER_NEURON;
+			if(NeuralNetwork::SubgroupSize())
+				candidates.emplace_back(config);
+			config.mapping = KernelMapping::LANES_PER_NEURON;
+			for(uint32_t lanes : {4, 8, 16, 32, 64}) {
+				config.lanes = lanes;
+				candidates.emplace_back(config);
+			}
+		}
+		// shared memory state window, only applied to workgroups with local
+		// inputs so it is cheap to try on any network
+		const size_t count = candidates.size();
+		for(size_t i=0; i<count; ++i) {
+			const KernelConfig& c = candidates[i];
+			if((c.workgroupSize == 64 || c.workgroupSize == 256)
+					&& (c.unroll == 1 || c.unroll == 4)
+					&& (c.lanes == 8 || c.lanes == 32)) {
+				KernelConfig config = c;
+				config.xWindow = NeuralNetwork::DEFAULT_X_WINDOW;
+				candidates.emplace_back(config);
+			}
+		}
+		return candidates;
+	}
+	
+	std::string Autotuner::DeviceKey() {
+		std::string key;
+		for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+			const char* str = (const char*)glGetString(name);
+			key += str ? str : "";
+			key += "|";
+		}
+		std::replace(key.begin(), key.end(), '\t', ' ');
+		std::replace(key.begin(), key.end(), '\n', ' ');
+		return key;
+	}
+	
+	std::string Autotuner::NetworkShapeKey(const NeuralNetwork& nn) {
+		uint32_t maxDegree = 0;
+		for(const auto& info : nn.perNeuronStaticInfoHost)
+			maxDegree = std::max(maxDegree, info.weights_count);
+		const uint32_t meanDegree = nn.neuronsCount ?
+			nn.weightsCount/nn.neuronsCount : 0;
+		auto log2bucket = [](uint32_t v) {
+			uint32_t b = 0;
+			for(; v > 1; v >>= 1)
+				++b;
+			return b;
+		};
+		return "n" + std::to_string(log2bucket(nn.neuronsCount))
+			+ "_mean" + std::to_string(log2bucket(meanDegree))
+			+ "_max" + std::to_string(log2bucket(maxDegree))
+			+ "_layout" + std::to_string((uint32_t)nn.GetEdgeLayout());
+	}
+	
+	std::string Autotuner::ToString(const KernelConfig& config) {
+		return std::to_string(config.workgroupSize) + " "
+			+ std::to_string(config.unroll) + " "
+			+ std::to_string(config.vectorAccumulate ? 1 : 0) + " "
+			+ std::to_string((uint32_t)config.mapping) + " "
+			+ std::to_string(config.lanes) + " "
+			+ std::to_string(config.xWindow);
+	}
+	
+	bool Autotuner::FromString(const std::string& str, KernelConfig& config) {
+		std::istringstream in(str);
+		int vectorAccumulate = 0;
+		if(!(in >> config.workgroupSize >> config.unroll >> vectorAccumulate))
+			return false;
+		config.vectorAccumulate = vectorAccumulate != 0;
+		uint32_t mapping = 0;
+		if(in >> mapping >> config.lanes) {
+			if(mapping > (uint32_t)KernelMapping::LANES_PER_NEURON)
+				return false;
+			config.mapping = (KernelMapping)mapping;
+			if(!(in >> config.xWindow))
+				config.xWindow = 0;
+		} else {
+			config.mapping = KernelMapping::THREAD_PER_NEURON;
+		}
+		return config.workgroupSize != 0 && config.unroll != 0;
+	}
+	
+	bool Autotuner::LoadCached(const std::string& key,
+			KernelConfig& config) const {
+		if(cacheFilePath.empty())
+			return false;
+		std::ifstream file(cacheFilePath);
+		std::string line;
+		while(std::getline(file, line)) {
+			size_t sep = line.rfind('\t');
+			if(sep != std::string::npos && line.compare(0, sep, key) == 0
+					&& sep == key.size()) {
+				return FromString(line.substr(sep+1), config);
+			}
+		}
+		return false;
+	}
+	
+	void Autotuner::StoreCached(const std::string& key,
+			const KernelConfig& config) {
+		if(cacheFilePath.empty())
+			return;
+		std::vector<std::string> lines;
+		{
+			std::ifstream file(cacheFilePath);
+			std::string line;
+			while(std::getline(file, line)) {
+				if(line.compare(0, key.size()+1, key+"\t") != 0)
+					lines.emplace_back(line);
+			}
+		}
+		lines.emplace_back(key + "\t" + ToString(config));
+		std::ofstream file(cacheFilePath, std::ios::trunc);
+		if(!file.good()) {
+			printf(" Cannot write autotuner cache: %s\n", cacheFilePath.c_str());
+			return;
+		}
+		for(const std::string& line : lines)
+			file << line << "\n";
+	}
+}
+
@@ -0,0 +1,212 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "../include/boltzmann/BandwidthCalibration.hpp"
+
+namespace bn {
+	const uint32_t BandwidthCalibration::ELEMENTS_PER_INVOCATION = 64;
+	
+	BandwidthCalibration::BandwidthCalibration(uint32_t elements,
+			uint32_t stride, uint32_t gatherRange, uint64_t seed) :
+		data(nullptr), result(nullptr), indices(nullptr) {
+		// at least one full workgroup of invocations
+		this->elements = 256*ELEMENTS_PER_INVOCATION;
+		while(this->elements*2 <= elements && this->elements < (1u<<30))
+			this->elements <<= 1;
+		this->stride = 1;
+		while(this->stride*2 <= stride && this->stride*2 < this->elements)
+			this->stride <<= 1;
+		
+		std::mt19937_64 gen(seed);
+		if(gatherRange == 0 || gatherRange > this->elements)
+			gatherRange = this->elements;
+		std::uniform_int_distribution<uint32_t> dist(0, gatherRange-1);
+		dataHost.resize(this->elements);
+		indicesHost.resize(this->elements);
+		for(uint32_t i=0; i<this->elements; ++i) {
+			dataHost[i] = (i&255) * (1.0f/256.0f);
+			indicesHost[i] = dist(gen);
+		}
+	}
+	
+	BandwidthCalibration::~BandwidthCalibration() {
+		delete data;
+		delete result;
+		delete indices;
+		for(gl::Shader* shader : shaders)
+			delete shader;
+	}
+	
+	BandwidthCeilings BandwidthCalibration::MeasureGpu(uint32_t iterations) {
+		if(data == nullptr) {
+			data = new gl::SimpleVBO<float>();
+			data->Generate(dataHost.data(), elements);
+			indices = new gl::SimpleVBO<uint32_t>();
+			indices->Generate(indicesHost.data(), elements);
+			result = new gl::SimpleVBO<float>();
+			result->Generate(nullptr, elements/ELEMENTS_PER_INVOCATION);
+			
+			for(const char* kernel : {"STREAM", "STRIDED", "GATHER"}) {
+				for(const char* layout : {"INTERLEAVED", "CHUNKED"}) {
+					shaders.push_back(new gl::Shader());
+					shaders.back()->Compile(CALIBRATION_SOURCE_CODE,
+							{{kernel, "1"}, {layout, "1"}});
+				}
+			}
+		}
+		
+		// Consecutive invocations reading consecutive elements suits
+		// hardware with coalescing, contiguous chunk per invocation suits
+		// SIMD-on-CPU drivers. Ceiling is the better of the two.
+		double ns[3];
+		for(int i=0; i<3; ++i)
+			ns[i] = std::min(MeasureGpuKernel(*shaders[i*2], iterations),
+					MeasureGpuKernel(*shaders[i*2+1], iterations));
+		
+		const double bytes = elements * (double)sizeof(float);
+		BandwidthCeilings ceilings;
+		ceilings.stream = bytes / ns[0];
+		ceilings.strided = bytes / ns[1];
+		ceilings.gather = 2*bytes / ns[2];
+		return ceilings;
+	}
+	
+	// returns nanoseconds of single pass
+	double BandwidthCalibration::MeasureGpuKernel(gl::Shader& shader,
+			uint32_t iterations) {
+		iterations = std::max(iterations, 1u);
+		shader.Use();
+		shader.SetUInt(1, elements);
+		shader.SetUInt(2, stride);
+		data->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 1);
+		indices->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
+		result->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 3);
+		const uint32_t invocations = elements/ELEMENTS_PER_INVOCATION;
+		
+		// warm up caches and driver state
+		shader.DispatchRoundGroupNumbers(invocations, 1, 1);
+		
+		GLuint queries[2];
+		GLuint64 start = 0, end = 0;
+		glGenQueries(2, queries);
+		glQueryCounter(queries[0], GL_TIMESTAMP);
+		for(uint32_t i=0; i<iterations; ++i)
+			shader.DispatchRoundGroupNumbers(invocations, 1, 1);
+		glQueryCounter(queries[1], GL_TIMESTAMP);
+		glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+		glDeleteQueries(2, queries);
+		GL_CHECK_PUSH_ERROR;
+		return std::max<double>(end-start, 1) / iterations;
+	}
+	
+	BandwidthCeilings BandwidthCalibration::MeasureCpu(uint32_t iterations) {
+		iterations = std::max(iterations, 1u);
+		const float* d = dataHost.data();
+		const uint32_t* idx = indicesHost.data();
+		const uint32_t mask = elements-1;
+		const uint32_t rowsMask = elements/stride - 1;
+		uint32_t rowsShift = 0;
+		while((1u<<rowsShift) <= rowsMask)
+			++rowsShift;
+		volatile float sink = 0;
+		
+		auto measure = [&](auto&& pass) {
+			sink = sink + pass();
+			auto t1 = std::chrono::steady_clock::now();
+			for(uint32_t it=0; it<iterations; ++it)
+				sink = sink + pass();
+			auto t2 = std::chrono::steady_clock::now();
+			return std::max<double>(std::chrono::duration<double,
+					std::nano>(t2-t1).count(), 1) / iterations;
+		};
+		
+		const double bytes = elements * (double)sizeof(float);
+		BandwidthCeilings ceilings;
+		ceilings.stream = bytes / measure([&]() {
+				float s[4] = {0, 0, 0, 0};
+				for(uint32_t i=0; i<elements; i+=4) {
+					s[0] += d[i];
+					s[1] += d[i+1];
+					s[2] += d[i+2];
+					s[3] += d[i+3];
+				}
+				return s[0]+s[1]+s[2]+s[3];
+			});
+		ceilings.strided = bytes / measure([&]() {
+				float s = 0;
+				for(uint32_t i=0; i<elements; ++i)
+					s += d[(((i&rowsMask)*stride) | (i>>rowsShift)) & mask];
+				return s;
+			});
+		ceilings.gather = 2*bytes / measure([&]() {
+				float s = 0;
+				for(uint32_t i=0; i<elements; ++i)
+					s += d[idx[i]];
+				return s;
+			});
+		return ceilings;
+	}
+	
+	
+	
+	const char* BandwidthCalibration::CALIBRATION_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint elements;
+layout (location=2) uniform uint stride;
+
+layout (std430, binding=1) readonly buffer Data {
+	float data[];
+};
+
+layout (std430, binding=2) readonly buffer Indices {
+	uint indices[];
+};
+
+layout (std430, binding=3) writeonly buffer Result {
+	float result[];
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+	const uint id = gl_GlobalInvocationID.x;
+	const uint invocations = gl_NumWorkGroups.x * 256;
+	const uint rowsMask = elements / stride - 1;
+	const int rowsShift = findMSB(rowsMask) + 1;
+	float sum = 0.0;
+#if defined(CHUNKED)
+	const uint chunk = elements / invocations;
+	for(uint i=id*chunk; i<(id+1)*chunk; ++i) {
+#else
+	for(uint i=id; i<elements; i+=invocations) {
+#endif
+#if defined(STREAM)
+		sum += data[i];
+#elif defined(STRIDED)
+		sum += data[(((i&rowsMask)*stride) | (i>>rowsShift)) & (elements-1)];
+#else
+		sum += data[indices[i]];
+#endif
+	}
+	result[id] = sum;
+})";
+}
+
@@ -0,0 +1,147 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/boltzmann/CpuKernels.hpp"
+
+namespace bn {
+	namespace cpu {
+		template<Activation ACTIVATION, uint32_t DEGREE, uint32_t PREFETCH>
+		static bool DispatchWidth(uint32_t width, const NetworkView& net,
+				const float* x, float* y, uint32_t begin, uint32_t end,
+				uint32_t firstNeuron) {
+			switch(width) {
+				case 1:
+					CalculateFixedDegree<ACTIVATION, DEGREE, 1, PREFETCH>(net,
+							x, y, begin, end, firstNeuron);
+					return true;
+				case 4:
+					CalculateFixedDegree<ACTIVATION, DEGREE, 4, PREFETCH>(net,
+							x, y, begin, end, firstNeuron);
+					return true;
+				case 8:
+					CalculateFixedDegree<ACTIVATION, DEGREE, 8, PREFETCH>(net,
+							x, y, begin, end, firstNeuron);
+					return true;
+			}
+			return false;
+		}
+		
+		template<Activation ACTIVATION, uint32_t PREFETCH>
+		static bool DispatchDegree(uint32_t degree, uint32_t width,
+				const NetworkView& net, const float* x, float* y,
+				uint32_t begin, uint32_t end, uint32_t firstNeuron) {
+			switch(degree) {
+				case 2:
+					return DispatchWidth<ACTIVATION, 2, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+				case 4:
+					return DispatchWidth<ACTIVATION, 4, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+				case 8:
+					return DispatchWidth<ACTIVATION, 8, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+				case 16:
+					return DispatchWidth<ACTIVATION, 16, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+				case 32:
+					return DispatchWidth<ACTIVATION, 32, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+				case 64:
+					return DispatchWidth<ACTIVATION, 64, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+				case 128:
+					return DispatchWidth<ACTIVATION, 128, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+				case 256:
+					return DispatchWidth<ACTIVATION, 256, PREFETCH>(width, net,
+							x, y, begin, end, firstNeuron);
+			}
+			return false;
+		}
+		
+		bool DispatchFixedDegree(uint32_t degree, uint32_t width,
+				const NetworkView& net, const float* x, float* y,
+				uint32_t begin, uint32_t end, uint32_t firstNeuron) {
+			return VisitActivation(net.activation, [&](auto activation) {
+					return VisitPrefetch(net.prefetchDistance,
+							[&](auto prefetch) {
+							return DispatchDegree<decltype(activation)::value,
+								decltype(prefetch)::value>(degree, width, net,
+									x, y, begin, end, firstNeuron);
+						});
+				});
+		}
+		
+		template<Activation ACTIVATION, uint32_t PREFETCH>
+		static void DispatchLayout(const NetworkView& net, const float* x,
+				float* y, uint32_t begin, uint32_t end) {
+			switch(net.layout) {
+				case EdgeLayout::INTERLEAVED_FP32:
+					CalculateInterleaved<ACTIVATION,
+						EdgeLayout::INTERLEAVED_FP32, PREFETCH>(net, x, y,
+								begin, end);
+					break;
+				case EdgeLayout::INTERLEAVED_FP16:
+					CalculateInterleaved<ACTIVATION,
+						EdgeLayout::INTERLEAVED_FP16, PREFETCH>(net, x, y,
+								begin, end);
+					break;
+				default:
+					CalculateGeneric<ACTIVATION, 4, PREFETCH>(net, x, y, begin,
+							end);
+			}
+		}
+		
+		void DispatchGeneric(const NetworkView& net, const float* x, float* y,
+				uint32_t begin, uint32_t end) {
+			VisitActivation(net.activation, [&](auto activation) {
+					VisitPrefetch(net.prefetchDistance, [&](auto prefetch) {
+							DispatchLayout<decltype(activation)::value,
+								decltype(prefetch)::value>(net, x, y, begin,
+									end);
+						});
+				});
+		}
+		
+		void DispatchTiled(const NetworkView& net, const TiledView& tiles,
+				const float* x, float* y, uint32_t begin, uint32_t end,
+				float* sums) {
+			const uint32_t size = tiles.blockNeurons;
+			const uint32_t firstBlock = (begin + size-1) / size;
+			// last block may be shorter
+			const uint32_t endBlock = end == tiles.neuronsCount
+				? (end + size-1) / size : end / size;
+			if(firstBlock >= endBlock) {
+				DispatchGeneric(net, x, y, begin, end);
+				return;
+			}
+			if(begin < firstBlock*size)
+				DispatchGeneric(net, x, y, begin, firstBlock*size);
+			VisitActivation(net.activation, [&](auto activation) {
+					VisitPrefetch(net.prefetchDistance, [&](auto prefetch) {
+							for(uint32_t b=firstBlock; b<endBlock; ++b)
+								CalculateTiledBlock<decltype(activation)::value,
+									decltype(prefetch)::value>(net, tiles, x, y,
+											b, sums);
+						});
+				});
+			if(endBlock*size < end)
+				DispatchGeneric(net, x, y, endBlock*size, end);
+		}
+	}
+}
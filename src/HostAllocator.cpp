@@ -0,0 +1,284 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "../include/boltzmann/HostAllocator.hpp"
+
+namespace bn {
+	// smaller arrays come from malloc, mapping would waste most of a page
+	static const size_t HOST_MAPPING_THRESHOLD = 64*1024;
+	static const size_t HUGE_2M_BYTES = 2*1024*1024;
+	static const size_t HUGE_1G_BYTES = 1024*1024*1024;
+	
+	struct HostMapping {
+		size_t length;
+		HostPages pages;
+	};
+	
+	// large allocations by start address, to know length and pages of
+	// mapping when freeing it or binding its part
+	static std::mutex mappingsMutex;
+	static std::map<uintptr_t, HostMapping> mappings;
+	static std::atomic<uint32_t> requestedPages((uint32_t)HostPages::SMALL);
+	
+	static const char* HOST_PAGES_NAMES[] = {
+		"small",
+		"transparent",
+		"2m",
+		"1g"
+	};
+	
+	const char* HostPagesName(HostPages pages) {
+		return HOST_PAGES_NAMES[(uint32_t)pages];
+	}
+	
+	bool HostPagesFromName(const std::string& name, HostPages& pages) {
+		const uint32_t count = sizeof(HOST_PAGES_NAMES)
+			/ sizeof(*HOST_PAGES_NAMES);
+		for(uint32_t i=0; i<count; ++i) {
+			if(name == HOST_PAGES_NAMES[i]) {
+				pages = (HostPages)i;
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	void SetHostPages(HostPages pages) {
+		requestedPages = (uint32_t)pages;
+	}
+	
+	HostPages GetHostPages() {
+		return (HostPages)requestedPages.load();
+	}
+	
+	static size_t PageBytes(HostPages pages) {
+		switch(pages) {
+			case HostPages::HUGE_1G:
+				return HUGE_1G_BYTES;
+			case HostPages::HUGE_2M:
+			case HostPages::TRANSPARENT:
+				return HUGE_2M_BYTES;
+			default:
+				return sysconf(_SC_PAGESIZE);
+		}
+	}
+	
+	// madvise succeeds even when transparent huge pages are disabled
+	static bool TransparentHugePagesEnabled() {
+		static const bool enabled = []() {
+			FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled",
+					"r");
+			if(file == nullptr)
+				return false;
+			char line[128] = {0};
+			bool result = fgets(line, sizeof(line), file)
+				&& strstr(line, "[never]") == nullptr;
+			fclose(file);
+			return result;
+		}();
+		return enabled;
+	}
+	
+	static void* MapHugeTLB(size_t length, uint32_t shift) {
+#if defined(MAP_HUGETLB)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+		void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+				| (shift << MAP_HUGE_SHIFT), -1, 0);
+		return ptr == MAP_FAILED ? nullptr : ptr;
+#else
+		return nullptr;
+#endif
+	}
+	
+	// over-maps by one huge page and trims it, so that every 2 MiB of array
+	// can be backed by one huge page
+	static void* MapTransparent(size_t length) {
+#if defined(MADV_HUGEPAGE)
+		if(!TransparentHugePagesEnabled())
+			return nullptr;
+		void* ptr = mmap(nullptr, length+HUGE_2M_BYTES, PROT_READ
+				| PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(ptr == MAP_FAILED)
+			return nullptr;
+		const uintptr_t base = (uintptr_t)ptr;
+		const uintptr_t aligned = (base + HUGE_2M_BYTES-1) / HUGE_2M_BYTES
+			* HUGE_2M_BYTES;
+		if(aligned > base)
+			munmap(ptr, aligned-base);
+		if(base+HUGE_2M_BYTES > aligned)
+			munmap((void*)(aligned+length), base+HUGE_2M_BYTES-aligned);
+		if(madvise((void*)aligned, length, MADV_HUGEPAGE) != 0) {
+			munmap((void*)aligned, length);
+			return nullptr;
+		}
+		return (void*)aligned;
+#else
+		return nullptr;
+#endif
+	}
+	
+	static void* Map(size_t bytes, HostMapping& mapping) {
+		for(uint32_t p=requestedPages; p>(uint32_t)HostPages::SMALL; --p) {
+			const HostPages pages = (HostPages)p;
+			const size_t page = PageBytes(pages);
+			if(bytes < page)
+				continue;
+			const size_t length = (bytes + page-1) / page * page;
+			void* ptr = nullptr;
+			if(pages == HostPages::HUGE_1G)
+				ptr = MapHugeTLB(length, 30);
+			else if(pages == HostPages::HUGE_2M)
+				ptr = MapHugeTLB(length, 21);
+			else
+				ptr = MapTransparent(length);
+			if(ptr) {
+				mapping = {length, pages};
+				return ptr;
+			}
+		}
+		void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		mapping = {bytes, HostPages::SMALL};
+		return ptr == MAP_FAILED ? nullptr : ptr;
+	}
+	
+	void* HostAllocate(size_t bytes) {
+		if(bytes < HOST_MAPPING_THRESHOLD) {
+			void* ptr = nullptr;
+			if(posix_memalign(&ptr, 64, bytes ? bytes : 1) != 0)
+				return nullptr;
+			return ptr;
+		}
+		HostMapping mapping;
+		void* ptr = Map(bytes, mapping);
+		if(ptr) {
+			std::lock_guard<std::mutex> lock(mappingsMutex);
+			mappings[(uintptr_t)ptr] = mapping;
+		}
+		return ptr;
+	}
+	
+	void HostFree(void* ptr, size_t bytes) {
+		if(ptr == nullptr)
+			return;
+		if(bytes < HOST_MAPPING_THRESHOLD) {
+			free(ptr);
+			return;
+		}
+		size_t length = bytes;
+		{
+			std::lock_guard<std::mutex> lock(mappingsMutex);
+			auto it = mappings.find((uintptr_t)ptr);
+			if(it != mappings.end()) {
+				length = it->second.length;
+				mappings.erase(it);
+			}
+		}
+		munmap(ptr, length);
+	}
+	
+	HostPages HostPagesOf(const void* ptr) {
+		std::lock_guard<std::mutex> lock(mappingsMutex);
+		auto it = mappings.upper_bound((uintptr_t)ptr);
+		if(it == mappings.begin())
+			return HostPages::SMALL;
+		--it;
+		if((uintptr_t)ptr >= it->first + it->second.length)
+			return HostPages::SMALL;
+		return it->second.pages;
+	}
+	
+	static const char* NUMA_POLICY_NAMES[] = {
+		"none",
+		"first_touch",
+		"bind",
+		"interleave"
+	};
+	
+	const char* NumaPolicyName(NumaPolicy policy) {
+		return NUMA_POLICY_NAMES[(uint32_t)policy];
+	}
+	
+	bool NumaPolicyFromName(const std::string& name, NumaPolicy& policy) {
+		const uint32_t count = sizeof(NUMA_POLICY_NAMES)
+			/ sizeof(*NUMA_POLICY_NAMES);
+		for(uint32_t i=0; i<count; ++i) {
+			if(name == NUMA_POLICY_NAMES[i]) {
+				policy = (NumaPolicy)i;
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	// from <numaif.h>, which is part of libnuma headers
+	static const int NUMA_MPOL_BIND = 2;
+	static const int NUMA_MPOL_INTERLEAVE = 3;
+	static const unsigned NUMA_MPOL_MF_MOVE = 1 << 1;
+	static const uint32_t NUMA_MAX_NODES = 1024;
+	
+	static int Mbind(void* ptr, size_t bytes, int mode,
+			const std::vector<unsigned long>& mask) {
+#ifdef SYS_mbind
+		const uintptr_t page = PageBytes(HostPagesOf(ptr));
+		const uintptr_t begin = ((uintptr_t)ptr + page-1) / page * page;
+		const uintptr_t end = ((uintptr_t)ptr + bytes) / page * page;
+		if(end <= begin)
+			return 0;
+		return syscall(SYS_mbind, begin, end-begin, mode, mask.data(),
+				mask.size()*sizeof(unsigned long)*8, NUMA_MPOL_MF_MOVE) == 0
+			? 0 : -1;
+#else
+		return -1;
+#endif
+	}
+	
+	int HostBindToNode(void* ptr, size_t bytes, uint32_t node) {
+		if(node >= NUMA_MAX_NODES)
+			return -1;
+		const uint32_t bits = sizeof(unsigned long)*8;
+		std::vector<unsigned long> mask(node/bits+1, 0);
+		mask[node/bits] |= 1ul << (node%bits);
+		return Mbind(ptr, bytes, NUMA_MPOL_BIND, mask);
+	}
+	
+	int HostInterleave(void* ptr, size_t bytes, uint32_t nodes) {
+		nodes = std::min(std::max(nodes, 1u), NUMA_MAX_NODES);
+		const uint32_t bits = sizeof(unsigned long)*8;
+		std::vector<unsigned long> mask((nodes-1)/bits+1, 0);
+		for(uint32_t n=0; n<nodes; ++n)
+			mask[n/bits] |= 1ul << (n%bits);
+		return Mbind(ptr, bytes, NUMA_MPOL_INTERLEAVE, mask);
+	}
+}
@@ -0,0 +1,192 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <ctime>
+#include <cmath>
+#include <cstring>
+
+#include <set>
+#include <algorithm>
+#include <random>
+
+#include "../include/boltzmann/NetworkStructure.hpp"
+
+namespace bn {
+	void RandomBuffer(std::vector<float>& buf, uint32_t count, float min,
+			float max) {
+		buf.resize(count);
+		RandomBuffer(buf.data(), count, min, max);
+	}
+	
+	void RandomBuffer(float* buf, uint32_t count, float min, float max) {
+		static std::mt19937_64 mt(time(NULL));
+		std::uniform_real_distribution<float> dist(min/5, max/5.0);
+		for(uint32_t i=0; i<count; ++i) {
+			buf[i] =
+				+dist(mt)
+				+dist(mt)
+				+dist(mt)
+				+dist(mt)
+				+dist(mt);
+		}
+	}
+	
+	uint32_t BuildNetworkStructure(
+			const std::vector<std::vector<uint32_t>>& input,
+			std::vector<std::vector<uint32_t>>& structure,
+			std::vector<PerNeuronStatic>& perNeuronStatic) {
+		const uint32_t neuronsCount = input.size();
+		structure.resize(neuronsCount);
+		std::set<uint32_t> tmp;
+		for(uint32_t i=0; i<neuronsCount; ++i) {
+			tmp.clear();
+			tmp.insert(input[i].begin(), input[i].end());
+			structure[i].assign(tmp.begin(), tmp.lower_bound(neuronsCount));
+		}
+		perNeuronStatic.resize(neuronsCount);
+		uint32_t weightsCount = 0;
+		for(uint32_t i=0; i<structure.size(); ++i) {
+			std::vector<uint32_t>& v = structure[i];
+			if(v.size()) {
+				perNeuronStatic[i].weights_count = v.size();
+				perNeuronStatic[i].weights_start = weightsCount;
+				weightsCount += v.size();
+			} else {
+				perNeuronStatic[i].weights_count = 0;
+				perNeuronStatic[i].weights_start = 0;
+			}
+		}
+		return weightsCount;
+	}
+	
+	uint32_t DetectFixedDegree(const PerNeuronStatic* perNeuronStatic,
+			uint32_t neurons, uint32_t& firstNeuron) {
+		firstNeuron = 0;
+		while(firstNeuron < neurons
+				&& perNeuronStatic[firstNeuron].weights_count == 0)
+			++firstNeuron;
+		if(firstNeuron == neurons)
+			return 0;
+		const uint32_t degree = perNeuronStatic[firstNeuron].weights_count;
+		for(uint32_t i=firstNeuron; i<neurons; ++i) {
+			if(perNeuronStatic[i].weights_count != degree
+					|| perNeuronStatic[i].weights_start
+					!= (i-firstNeuron)*degree)
+				return 0;
+		}
+		return degree;
+	}
+	
+	uint32_t PackedEdgeStructure(EdgeLayout layout,
+			const std::vector<PerNeuronStatic>& perNeuronStatic,
+			std::vector<PerNeuronStatic>& packedStatic) {
+		packedStatic = perNeuronStatic;
+		if(layout != EdgeLayout::INTERLEAVED_FP16) {
+			uint32_t edges = 0;
+			for(const PerNeuronStatic& info : perNeuronStatic)
+				edges = std::max(edges, info.weights_start+info.weights_count);
+			return layout == EdgeLayout::SEPARATE ? 0 : edges*2;
+		}
+		uint32_t edges = 0;
+		for(PerNeuronStatic& info : packedStatic) {
+			if(info.weights_count == 0) {
+				info.weights_start = 0;
+				continue;
+			}
+			info.weights_start = edges;
+			edges += (info.weights_count+1) & ~1u;
+		}
+		return edges/2*3;
+	}
+	
+	void PackEdges(EdgeLayout layout, const PerNeuronStatic* perNeuronStatic,
+			const PerNeuronStatic* packedStatic, uint32_t neurons,
+			const uint32_t* connections, const float* weights,
+			uint32_t* packed) {
+		for(uint32_t n=0; n<neurons; ++n) {
+			const uint32_t count = perNeuronStatic[n].weights_count;
+			const uint32_t* c = connections + perNeuronStatic[n].weights_start;
+			const float* w = weights + perNeuronStatic[n].weights_start;
+			if(layout == EdgeLayout::INTERLEAVED_FP32) {
+				uint32_t* out = packed + packedStatic[n].weights_start*2;
+				for(uint32_t i=0; i<count; ++i) {
+					out[i*2] = c[i];
+					memcpy(out+i*2+1, w+i, sizeof(float));
+				}
+			} else if(layout == EdgeLayout::INTERLEAVED_FP16) {
+				uint32_t* out = packed + packedStatic[n].weights_start/2*3;
+				for(uint32_t i=0; i<count; i+=2) {
+					const bool second = i+1 < count;
+					out[i/2*3] = c[i];
+					out[i/2*3+1] = c[second ? i+1 : i];
+					out[i/2*3+2] = FloatToHalf(w[i])
+						| ((uint32_t)FloatToHalf(second ? w[i+1] : 0.0f) << 16);
+				}
+			}
+		}
+	}
+	
+	uint16_t FloatToHalf(float value) {
+		uint32_t f;
+		memcpy(&f, &value, sizeof(f));
+		const uint32_t sign = (f >> 16) & 0x8000;
+		const uint32_t exponent = (f >> 23) & 0xFF;
+		uint32_t mantissa = f & 0x7FFFFF;
+		if(exponent == 0xFF)
+			return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+		const int32_t e = (int32_t)exponent - 127 + 15;
+		if(e >= 31)
+			return sign | 0x7C00;
+		uint32_t shift = 13;
+		uint32_t half;
+		if(e <= 0) {
+			// subnormal half
+			if(e < -10)
+				return sign;
+			mantissa |= 0x800000;
+			shift = 14 - e;
+			half = mantissa >> shift;
+		} else {
+			half = ((uint32_t)e << 10) | (mantissa >> 13);
+		}
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		// carry into exponent gives correct rounding up to infinity
+		if(rest > halfway || (rest == halfway && (half & 1)))
+			++half;
+		return sign | half;
+	}
+	
+	float HalfToFloat(uint16_t value) {
+		const uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+		const uint32_t exponent = (value >> 10) & 0x1F;
+		const uint32_t mantissa = value & 0x3FF;
+		if(exponent == 0) {
+			const float v = std::ldexp((float)mantissa, -24);
+			return sign ? -v : v;
+		}
+		uint32_t f;
+		if(exponent == 31)
+			f = sign | 0x7F800000 | (mantissa << 13);
+		else
+			f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		float v;
+		memcpy(&v, &f, sizeof(v));
+		return v;
+	}
+}
@@ -16,32 +16,17 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <ctime>
+#include <cstdio>
 
 #include <algorithm>
-#include <set>
-#include <random>
 
 #include "openglwrapper/VBO.hpp"
 
+#include "../include/boltzmann/PrefixSum.hpp"
+
 #include "../include/boltzmann/NeuralNetwork.hpp"
 
 namespace bn {
-	void RandomBuffer(std::vector<float>& buf, uint32_t count, float min,
-			float max) {
-		buf.resize(count);
-		static std::mt19937_64 mt(time(NULL));
-		std::uniform_real_distribution<float> dist(min/5, max/5.0);
-		for(float& v : buf) {
-			v =
-				+dist(mt)
-				+dist(mt)
-				+dist(mt)
-				+dist(mt)
-				+dist(mt);
-		}
-	}
-	
 	void FillBufferWithRandom(gl::SimpleVBO<float>& vbo, float min, float max) {
 		std::vector<float> buf;
 		RandomBuffer(buf, vbo.GetVertexCount(), min, max);
@@ -50,14 +35,23 @@ namespace bn {
 	
 	void NeuralNetwork::UpdateBiasWeights(float* bias, float* weight) {
 		printf(" updating bias weights: %i %i\n", neuronsCount, weightsCount);
+		if(profiler)
+			profiler->Begin(Profiler::UPDATE_BIAS_WEIGHTS);
+		// replica gets own weights instead of writing into source
+		weights.Detach();
+		this->bias.Detach();
 		weights.Update(weight, 0, weightsCount*4);
 		this->bias.Update(bias, 0, neuronsCount*4);
+		PackEdges();
+		if(profiler)
+			profiler->End(Profiler::UPDATE_BIAS_WEIGHTS);
 	}
 	
 	
 	
-	NeuralNetwork::NeuralNetwork() {
-		calculationShader.Compile(CALCULATIONS_SOURCE_CODE);
+	NeuralNetwork::NeuralNetwork(EdgeLayout edgeLayout) :
+		edgeLayout(edgeLayout) {
+		ApplyKernelConfig(KernelConfig());
 	}
 	
 	NeuralNetwork::~NeuralNetwork() {
@@ -65,28 +59,13 @@ namespace bn {
 	
 	void NeuralNetwork::InitEmptyNetwork(
 			const std::vector<std::vector<uint32_t>>& structure) {
+		if(perNeuronLeak)
+			SetLeakRates(nullptr);
+		if(perNeuronSampling)
+			SetSamplingIndices(nullptr);
 		neuronsCount = structure.size();
-		this->structure.resize(neuronsCount);
-		std::set<uint32_t> tmp;
-		for(uint32_t i=0; i<neuronsCount; ++i) {
-			tmp.clear();
-			tmp.insert(structure[i].begin(), structure[i].end());
-			this->structure[i].insert(this->structure[i].begin(), tmp.begin(),
-					tmp.lower_bound(neuronsCount));
-		}
-		perNeuronStaticInfoHost.resize(neuronsCount);
-		weightsCount = 0;
-		for(uint32_t i=0; i<this->structure.size(); ++i) {
-			std::vector<uint32_t>& v = this->structure[i];
-			if(v.size()) {
-				perNeuronStaticInfoHost[i].weights_count = v.size();
-				perNeuronStaticInfoHost[i].weights_start = weightsCount;
-				weightsCount += v.size();
-			} else {
-				perNeuronStaticInfoHost[i].weights_count = 0;
-				perNeuronStaticInfoHost[i].weights_start = 0;
-			}
-		}
+		weightsCount = BuildNetworkStructure(structure, this->structure,
+				perNeuronStaticInfoHost);
 		
 		weightsStructure.Resize(weightsCount);
 		
@@ -111,48 +90,649 @@ namespace bn {
 		bias.Resize(neuronsCount);
 		FillBufferWithRandom(bias, -10000, 10000);
 		
+		PackEdges();
+		
+		statePrevious = states;
+		stateNext = states+1;
+		
+		UpdateFixedDegree();
+		
+		if(!kernelConfigSet) {
+			// unrolled fixed degree sum exists only for thread per neuron
+			KernelConfig config;
+			if(!fixedDegree) {
+				uint32_t computedNeurons = 0;
+				for(const PerNeuronStatic& info : perNeuronStaticInfoHost)
+					computedNeurons += info.weights_count ? 1 : 0;
+				config = DefaultKernelConfig(computedNeurons ?
+						weightsCount/computedNeurons : 0);
+			}
+			if(config != kernelConfig)
+				ApplyKernelConfig(config);
+		}
+		
+		// Whether staging pays off depends on device, window is enabled by
+		// SetKernelConfig or Autotuner.
+		inputWindowsBlock = 0;
+		inputWindowCoverage = UpdateInputWindows(kernelConfig.workgroupSize
+				/ LanesPerNeuron(kernelConfig), DEFAULT_X_WINDOW);
+	}
+	
+	void NeuralNetwork::InitShared(const NeuralNetwork& source) {
+		neuronsCount = source.neuronsCount;
+		weightsCount = source.weightsCount;
+		structure = source.structure;
+		perNeuronStaticInfoHost = source.perNeuronStaticInfoHost;
+		packedStaticHost = source.packedStaticHost;
+		fixedDegree = source.fixedDegree;
+		fixedDegreeFirstNeuron = source.fixedDegreeFirstNeuron;
+		inputWindowCoverage = source.inputWindowCoverage;
+		samplingSeed = source.samplingSeed;
+		
+		perNeuronStatic.ShareFrom(source.perNeuronStatic);
+		weightsStructure.ShareFrom(source.weightsStructure);
+		weights.ShareFrom(source.weights);
+		bias.ShareFrom(source.bias);
+		packedEdges.ShareFrom(source.packedEdges);
+		packedStatic.ShareFrom(source.packedStatic);
+		inputWindows.ShareFrom(source.inputWindows);
+		inputWindowsBlock = source.inputWindowsBlock;
+		leakRates.ShareFrom(source.leakRates);
+		samplingIndices.ShareFrom(source.samplingIndices);
+		
+		states[0].Generate(nullptr, neuronsCount);
+		states[1].Generate(nullptr, neuronsCount);
+		states[0].Copy(source.statePrevious, 0, 0, neuronsCount*sizeof(float));
 		statePrevious = states;
 		stateNext = states+1;
+		
+		edgeLayout = source.edgeLayout;
+		activation = source.activation;
+		activationGroups = source.activationGroups;
+		leakRate = source.leakRate;
+		perNeuronLeak = source.perNeuronLeak;
+		perNeuronSampling = source.perNeuronSampling;
+		kernelConfigSet = source.kernelConfigSet;
+		if(ApplyKernelConfig(source.kernelConfig))
+			ApplyKernelConfig(KernelConfig());
+	}
+	
+	float NeuralNetwork::UpdateInputWindows(uint32_t neuronsPerGroup,
+			uint32_t window) {
+		const uint32_t blocks = (neuronsCount+neuronsPerGroup-1)
+			/ neuronsPerGroup;
+		std::vector<uint32_t> table(std::max(blocks, 1u)*2);
+		uint32_t withInputs = 0, fitting = 0;
+		for(uint32_t b=0; b<blocks; ++b) {
+			uint32_t lo = 0xFFFFFFFF, hi = 0;
+			const uint32_t end = std::min(neuronsCount, (b+1)*neuronsPerGroup);
+			for(uint32_t n=b*neuronsPerGroup; n<end; ++n) {
+				// inputs are sorted by BuildNetworkStructure and pruning
+				if(structure[n].size()) {
+					lo = std::min(lo, structure[n].front());
+					hi = std::max(hi, structure[n].back());
+				}
+			}
+			table[b*2] = lo;
+			table[b*2+1] = hi;
+			if(lo <= hi) {
+				++withInputs;
+				fitting += hi-lo < window ? 1 : 0;
+			}
+		}
+		inputWindows.Generate(table.data(), table.size());
+		inputWindowsBlock = neuronsPerGroup;
+		return withInputs ? fitting/(float)withInputs : 0.0f;
 	}
 	
 	void NeuralNetwork::SwapStates() {
 		std::swap(statePrevious, stateNext);
+		++samplingSeed;
 	}
 	
 	void NeuralNetwork::UpdateStates(const float* data, uint32_t start,
 			uint32_t elements) {
+		if(profiler)
+			profiler->Begin(Profiler::UPDATE_STATES);
 		statePrevious->UpdateElements(data, start, elements);
+		if(profiler)
+			profiler->End(Profiler::UPDATE_STATES);
 	}
 	
 	void NeuralNetwork::FetchStates(float* data, uint32_t start,
 			uint32_t elements) {
+		if(profiler)
+			profiler->Begin(Profiler::FETCH_STATES);
 		stateNext->FetchElements(data, start, elements);
+		if(profiler)
+			profiler->End(Profiler::FETCH_STATES);
 	}
 
 	
+	int NeuralNetwork::SetKernelConfig(const KernelConfig& config) {
+		int ret = ApplyKernelConfig(config);
+		if(ret == 0)
+			kernelConfigSet = true;
+		return ret;
+	}
+	
+	int NeuralNetwork::ApplyKernelConfig(const KernelConfig& config) {
+		if(config.mapping == KernelMapping::LANES_PER_NEURON
+				&& (config.lanes == 0 || (config.lanes & (config.lanes-1))
+					|| config.lanes > config.workgroupSize)) {
+			printf(" Invalid lanes per neuron: %u\n", config.lanes);
+			return -1;
+		}
+		if(config.mapping == KernelMapping::SUBGROUP_PER_NEURON
+				&& (SubgroupSize() == 0
+					|| config.workgroupSize % SubgroupSize())) {
+			printf(" Subgroup per neuron needs subgroups dividing workgroup"
+					" size %u, subgroup size %u\n", config.workgroupSize,
+					SubgroupSize());
+			return -1;
+		}
+		if(config.xWindow) {
+			static const GLint maxShared = []() {
+				GLint value = 0;
+				glGetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &value);
+				return value;
+			}();
+			uint32_t shared = config.xWindow*sizeof(float);
+			if(config.mapping == KernelMapping::LANES_PER_NEURON)
+				shared += config.workgroupSize*sizeof(float);
+			if(shared > (uint32_t)maxShared) {
+				printf(" State window of %u floats exceeds shared memory\n",
+						config.xWindow);
+				return -1;
+			}
+		}
+		int ret = CompileKernels(config);
+		if(ret == 0) {
+			kernelConfig = config;
+		} else if(config != kernelConfig) {
+			CompileKernels(kernelConfig);
+		}
+		return ret;
+	}
+	
+	int NeuralNetwork::CompileKernels(const KernelConfig& config) {
+		int ret = calculationShader.Compile(CALCULATIONS_SOURCE_CODE,
+				CalculationDefines(config, activation));
+		bool compiled[ACTIVATION_COUNT] = {};
+		compiled[(uint32_t)activation] = true;
+		for(const ActivationGroup& group : activationGroups) {
+			const uint32_t a = (uint32_t)group.activation;
+			if(compiled[a])
+				continue;
+			compiled[a] = true;
+			int r = groupShaders[a].Compile(CALCULATIONS_SOURCE_CODE,
+					CalculationDefines(config, group.activation));
+			if(ret == 0)
+				ret = r;
+		}
+		return ret;
+	}
+	
+	gl::Shader& NeuralNetwork::KernelFor(Activation activation) {
+		if(activation == this->activation)
+			return calculationShader;
+		return groupShaders[(uint32_t)activation];
+	}
+	
+	gl::Shader::Defines NeuralNetwork::CalculationDefines(
+			const KernelConfig& config) const {
+		return CalculationDefines(config, activation);
+	}
+	
+	gl::Shader::Defines NeuralNetwork::CalculationDefines(
+			const KernelConfig& config, Activation activation) const {
+		gl::Shader::Defines defines = {
+			{"WORKGROUP_SIZE", std::to_string(config.workgroupSize)},
+			{"UNROLL", std::to_string(config.unroll)},
+			{"VECTOR_ACCUMULATE", config.vectorAccumulate ? "1" : "0"},
+			{"MAPPING", std::to_string((uint32_t)config.mapping)},
+			{"LANES", std::to_string(config.lanes)},
+			{"EDGE_LAYOUT", std::to_string((uint32_t)edgeLayout)},
+			{"X_WINDOW", std::to_string(config.xWindow)},
+			{"ACTIVATION", std::to_string((uint32_t)activation)},
+			{"LEAK", std::to_string(LeakMode())},
+			{"SAMPLING_INDICES", perNeuronSampling ? "1" : "0"}
+		};
+		if(config.xWindow) {
+			defines.push_back({"NEURONS_PER_GROUP", std::to_string(
+						config.workgroupSize/LanesPerNeuron(config))});
+		}
+		if(fixedDegree && config.mapping == KernelMapping::THREAD_PER_NEURON) {
+			// fully unrolled sum over inputs of neuron starting at edge
+			// `start`, emitted as single line macro
+			std::string sum;
+			uint32_t i = 0;
+			uint32_t stride = fixedDegree;
+			if(edgeLayout != EdgeLayout::SEPARATE) {
+				uint32_t units = fixedDegree;
+				if(edgeLayout == EdgeLayout::INTERLEAVED_FP16) {
+					units = (fixedDegree+1)/2;
+					stride = units*2;
+				}
+				for(uint32_t u=0; u<units; ++u)
+					sum += "sum += UNIT_TERM(start, " + std::to_string(u)
+						+ "); ";
+				i = fixedDegree;
+			} else if(config.vectorAccumulate) {
+				for(; i+4 <= fixedDegree; i+=4) {
+					std::string e[4];
+					for(uint32_t j=0; j<4; ++j)
+						e[j] = "start+" + std::to_string(i+j);
+					sum += "sum += dot(vec4(weights[" + e[0] + "], weights["
+						+ e[1] + "], weights[" + e[2] + "], weights[" + e[3]
+						+ "]), vec4(GatherX(connectedNeurons[" + e[0]
+						+ "]), GatherX(connectedNeurons[" + e[1]
+						+ "]), GatherX(connectedNeurons[" + e[2]
+						+ "]), GatherX(connectedNeurons[" + e[3] + "]))); ";
+				}
+			}
+			for(; i<fixedDegree; ++i) {
+				std::string e = "start+" + std::to_string(i);
+				sum += "sum += weights[" + e + "] * GatherX(connectedNeurons["
+					+ e + "]); ";
+			}
+			defines.push_back({"FIXED_DEGREE", std::to_string(fixedDegree)});
+			defines.push_back({"FIXED_DEGREE_STRIDE", std::to_string(stride)});
+			defines.push_back({"FIXED_DEGREE_FIRST_NEURON",
+					std::to_string(fixedDegreeFirstNeuron)});
+			defines.push_back({"FIXED_DEGREE_SUM", sum});
+		}
+		return defines;
+	}
+	
+	int NeuralNetwork::SetActivation(Activation activation) {
+		const Activation previous = this->activation;
+		this->activation = activation;
+		int ret = CompileKernels(kernelConfig);
+		if(ret != 0) {
+			this->activation = previous;
+			CompileKernels(kernelConfig);
+		}
+		return ret;
+	}
+	
+	int NeuralNetwork::SetActivationGroups(
+			const std::vector<ActivationGroup>& groups) {
+		std::vector<ActivationGroup> normalized = groups;
+		if(!NormalizeActivationGroups(normalized)) {
+			printf(" Overlapping or invalid activation groups\n");
+			return -1;
+		}
+		activationGroups.swap(normalized);
+		int ret = CompileKernels(kernelConfig);
+		if(ret != 0) {
+			activationGroups.swap(normalized);
+			CompileKernels(kernelConfig);
+		}
+		return ret;
+	}
+	
+	uint32_t NeuralNetwork::LeakMode() const {
+		if(perNeuronLeak)
+			return 2;
+		return leakRate != 1.0f ? 1 : 0;
+	}
+	
+	int NeuralNetwork::SetLeakRate(float rate) {
+		const float previous = leakRate;
+		const uint32_t mode = LeakMode();
+		leakRate = rate;
+		if(LeakMode() == mode)
+			return 0;
+		int ret = CompileKernels(kernelConfig);
+		if(ret != 0) {
+			leakRate = previous;
+			CompileKernels(kernelConfig);
+		}
+		return ret;
+	}
+	
+	int NeuralNetwork::SetLeakRates(const float* rates) {
+		if(rates)
+			leakRates.Generate(rates, neuronsCount);
+		if(perNeuronLeak == (rates != nullptr))
+			return 0;
+		perNeuronLeak = rates != nullptr;
+		int ret = CompileKernels(kernelConfig);
+		if(ret != 0) {
+			perNeuronLeak = !perNeuronLeak;
+			CompileKernels(kernelConfig);
+		}
+		return ret;
+	}
+	
+	int NeuralNetwork::SetSamplingIndices(const uint32_t* indices) {
+		if(indices)
+			samplingIndices.Generate(indices, neuronsCount);
+		if(perNeuronSampling == (indices != nullptr))
+			return 0;
+		perNeuronSampling = indices != nullptr;
+		int ret = CompileKernels(kernelConfig);
+		if(ret != 0) {
+			perNeuronSampling = !perNeuronSampling;
+			CompileKernels(kernelConfig);
+		}
+		return ret;
+	}
+	
+	uint32_t NeuralNetwork::SubgroupSize() {
+		// same device for all contexts, initialized once across threads
+		static const uint32_t size = []() -> uint32_t {
+			if(!GLEW_KHR_shader_subgroup)
+				return 0;
+			GLint stages = 0, features = 0, subgroupSize = 0;
+			glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+			glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features);
+			glGetIntegerv(GL_SUBGROUP_SIZE_KHR, &subgroupSize);
+			GL_CHECK_PUSH_ERROR;
+			if((stages & GL_COMPUTE_SHADER_BIT)
+					&& (features & GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR))
+				return subgroupSize;
+			return 0;
+		}();
+		return size;
+	}
+	
+	KernelConfig NeuralNetwork::DefaultKernelConfig(uint32_t meanDegree) {
+		KernelConfig config;
+		if(meanDegree < 64 || meanDegree > 4096)
+			return config;
+		config.unroll = 1;
+		config.vectorAccumulate = false;
+		if(SubgroupSize() && config.workgroupSize % SubgroupSize() == 0) {
+			config.mapping = KernelMapping::SUBGROUP_PER_NEURON;
+		} else {
+			// about 4 inputs per lane
+			config.mapping = KernelMapping::LANES_PER_NEURON;
+			config.lanes = 8;
+			while(config.lanes < 64 && config.lanes*8 <= meanDegree)
+				config.lanes <<= 1;
+		}
+		return config;
+	}
+	
+	uint32_t NeuralNetwork::LanesPerNeuron(const KernelConfig& config) {
+		switch(config.mapping) {
+			case KernelMapping::SUBGROUP_PER_NEURON:
+				return std::max(SubgroupSize(), 1u);
+			case KernelMapping::LANES_PER_NEURON:
+				return std::max(config.lanes, 1u);
+			default:
+				return 1;
+		}
+	}
+	
+	void NeuralNetwork::UpdateFixedDegree() {
+		uint32_t firstNeuron = 0;
+		uint32_t degree = DetectFixedDegree(perNeuronStaticInfoHost,
+				firstNeuron);
+		if(degree > MAX_UNROLLED_DEGREE)
+			degree = 0;
+		if(degree != fixedDegree || firstNeuron != fixedDegreeFirstNeuron) {
+			fixedDegree = degree;
+			fixedDegreeFirstNeuron = degree ? firstNeuron : 0;
+			ApplyKernelConfig(kernelConfig);
+		}
+	}
+	
 	void NeuralNetwork::PerformCalculation(uint32_t start, uint32_t count) {
+		if(start >= neuronsCount)
+			return;
+		count = std::min(neuronsCount-start, count);
+		
+		if(profiler)
+			profiler->Begin(Profiler::PERFORM_CALCULATION);
 		glMemoryBarrier(GL_ALL_BARRIER_BITS);
 		
-		calculationShader.Use();
-		calculationShader.SetUInt(1, start);
-		calculationShader.SetUInt(2, std::min(neuronsCount-start, count));
-
 		statePrevious->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 4);
 		stateNext->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 5);
 		
+		bias.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 1);
+		if(edgeLayout == EdgeLayout::SEPARATE) {
+			perNeuronStatic.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 3);
+			weights.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
+			weightsStructure.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 6);
+		} else {
+			packedStatic.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 3);
+			packedEdges.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 7);
+		}
+		
+		static const GLint maxGroups = []() {
+			GLint value = 0;
+			glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &value);
+			return std::max(value, 65535);
+		}();
+		const uint32_t neuronsPerGroup = kernelConfig.workgroupSize
+			/ LanesPerNeuron(kernelConfig);
+		if(kernelConfig.xWindow) {
+			if(inputWindowsBlock != neuronsPerGroup)
+				UpdateInputWindows(neuronsPerGroup, kernelConfig.xWindow);
+			inputWindows.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 8);
+		}
+		if(perNeuronLeak)
+			leakRates.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 9);
+		if(perNeuronSampling)
+			samplingIndices.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 11);
+		const uint32_t chunk = (uint32_t)std::min<uint64_t>(
+				(uint64_t)maxGroups*neuronsPerGroup, 1u<<31);
+		ForEachActivationRange(activationGroups, activation, start,
+				start+count,
+				[&](uint32_t begin, uint32_t end, Activation activation) {
+					gl::Shader& shader = KernelFor(activation);
+					shader.Use();
+					if(activation == Activation::LOGISTIC_SAMPLING)
+						shader.SetUInt(3, samplingSeed);
+					if(LeakMode() == 1)
+						shader.SetFloat(4, leakRate);
+					for(uint32_t offset=begin; offset<end; offset+=chunk) {
+						const uint32_t n = std::min(chunk, end-offset);
+						shader.SetUInt(1, offset);
+						shader.SetUInt(2, offset+n);
+						shader.Dispatch((n+neuronsPerGroup-1)/neuronsPerGroup,
+								1, 1);
+					}
+				});
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		if(profiler)
+			profiler->End(Profiler::PERFORM_CALCULATION);
+	}
+	
+	void NeuralNetwork::ReduceStateDelta() {
+		if(stateDeltaShader.GetProgram() == 0) {
+			stateDeltaShader.Compile(STATE_DELTA_SOURCE_CODE);
+			stateDeltaFinalShader.Compile(STATE_DELTA_SOURCE_CODE,
+					{{"FINAL", "1"}});
+			stateDeltaPartials.Generate(nullptr, MAX_STATE_DELTA_GROUPS*2);
+			stateDelta.Generate(nullptr, 2);
+		}
+		const uint32_t groups = std::max(1u, std::min(MAX_STATE_DELTA_GROUPS,
+					(neuronsCount+255)/256));
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		statePrevious->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 4);
+		stateNext->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 5);
+		stateDeltaPartials.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 10);
+		stateDelta.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 11);
+		stateDeltaShader.Use();
+		stateDeltaShader.SetUInt(1, neuronsCount);
+		stateDeltaShader.Dispatch(groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		stateDeltaFinalShader.Use();
+		stateDeltaFinalShader.SetUInt(1, groups);
+		stateDeltaFinalShader.Dispatch(1, 1, 1);
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+	}
+	
+	StateDelta NeuralNetwork::FetchStateDelta() {
+		float result[2] = {0, 0};
+		if(stateDelta.GetVertexCount())
+			stateDelta.FetchElements(result, 0, 2);
+		StateDelta delta;
+		delta.max = result[0];
+		delta.l2 = result[1];
+		return delta;
+	}
+	
+	ConvergenceResult NeuralNetwork::RunUntilConverged(float tolerance,
+			uint32_t maxSteps, uint32_t pollInterval) {
+		pollInterval = std::max(pollInterval, 1u);
+		ConvergenceResult result;
+		GLsync fence = 0;
+		for(; result.steps<maxSteps && !result.converged; ++result.steps) {
+			PerformCalculation(0, neuronsCount);
+			// only one reduction in flight, its buffer is reused
+			if(fence == 0 && ((result.steps+1) % pollInterval == 0
+						|| result.steps+1 == maxSteps)) {
+				ReduceStateDelta();
+				fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			}
+			SwapStates();
+			if(fence) {
+				const bool last = result.steps+1 == maxSteps;
+				GLenum status = glClientWaitSync(fence,
+						GL_SYNC_FLUSH_COMMANDS_BIT,
+						last ? GL_TIMEOUT_IGNORED : 0);
+				if(status == GL_ALREADY_SIGNALED
+						|| status == GL_CONDITION_SATISFIED) {
+					glDeleteSync(fence);
+					fence = 0;
+					result.delta = FetchStateDelta();
+					result.converged = result.delta.max <= tolerance;
+				}
+			}
+		}
+		if(fence)
+			glDeleteSync(fence);
+		GL_CHECK_PUSH_ERROR;
+		return result;
+	}
+	
+	NeuralNetwork::PruneStatistics NeuralNetwork::PruneByThreshold(
+			float threshold) {
+		return Prune(threshold, 0);
+	}
+	
+	NeuralNetwork::PruneStatistics NeuralNetwork::PruneTopK(uint32_t k) {
+		if(k == 0) {
+			printf("Pruning to 0 connections per neuron is not allowed\n");
+			return {weightsCount, weightsCount};
+		}
+		return Prune(0.0f, k);
+	}
+	
+	NeuralNetwork::PruneStatistics NeuralNetwork::Prune(float threshold,
+			uint32_t topK) {
+		PruneStatistics stats{weightsCount, weightsCount};
+		if(weightsCount == 0)
+			return stats;
+		if(pruneMarkShader.GetProgram() == 0) {
+			pruneMarkShader.Compile(PRUNE_MARK_SOURCE_CODE);
+			pruneCompactShader.Compile(PRUNE_COMPACT_SOURCE_CODE);
+		}
+		const uint32_t groups = (neuronsCount+255)/256;
+		// compacted offsets are copied into perNeuronStatic, replica must
+		// not write them into source
+		perNeuronStatic.Detach();
+		
+		gl::SimpleVBO<uint32_t> keep, starts;
+		keep.Generate(nullptr, weightsCount);
+		starts.Generate(nullptr, neuronsCount);
+		
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		pruneMarkShader.Use();
+		pruneMarkShader.SetUInt(1, neuronsCount);
+		pruneMarkShader.SetFloat(2, threshold);
+		pruneMarkShader.SetUInt(3, topK);
+		weights.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
 		perNeuronStatic.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 3);
+		keep.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 7);
+		starts.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 8);
+		pruneMarkShader.Dispatch(groups, 1, 1);
+		
+		PrefixSum scan;
+		const uint32_t kept = scan.ExclusiveScan(starts, neuronsCount);
+		
+		gl::SimpleVBO<float> prunedWeights;
+		gl::SimpleVBO<uint32_t> prunedStructure;
+		gl::SimpleVBO<PerNeuronStatic> prunedStatic;
+		prunedWeights.Generate(nullptr, kept);
+		prunedStructure.Generate(nullptr, kept);
+		prunedStatic.Generate(nullptr, neuronsCount);
+		
+		pruneCompactShader.Use();
+		pruneCompactShader.SetUInt(1, neuronsCount);
 		weights.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
-		bias.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 1);
+		perNeuronStatic.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 3);
 		weightsStructure.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 6);
+		keep.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 7);
+		starts.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 8);
+		prunedWeights.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 9);
+		prunedStructure.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 10);
+		prunedStatic.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 11);
+		pruneCompactShader.Dispatch(groups, 1, 1);
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		
+		weights.Generate(nullptr, kept);
+		weights.Copy(&prunedWeights, 0, 0, kept*sizeof(float));
+		weightsStructure.Generate(nullptr, kept);
+		weightsStructure.Copy(&prunedStructure, 0, 0, kept*sizeof(uint32_t));
+		perNeuronStatic.Copy(&prunedStatic, 0, 0,
+				neuronsCount*sizeof(PerNeuronStatic));
+		weightsCount = kept;
+		stats.edgesAfter = kept;
+		
+		// host mirrors are refreshed from already compacted buffers
+		perNeuronStatic.FetchElements(perNeuronStaticInfoHost.data(), 0,
+				neuronsCount);
+		std::vector<uint32_t> connections(weightsCount);
+		weightsStructure.FetchElements(connections.data(), 0, weightsCount);
+		for(uint32_t i=0; i<neuronsCount; ++i) {
+			const PerNeuronStatic& info = perNeuronStaticInfoHost[i];
+			structure[i].assign(connections.begin()+info.weights_start,
+					connections.begin()+info.weights_start+info.weights_count);
+		}
+		UpdateFixedDegree();
+		PackEdges();
+		inputWindowsBlock = 0;
+		return stats;
+	}
+	
+	void NeuralNetwork::PackEdges() {
+		if(edgeLayout == EdgeLayout::SEPARATE)
+			return;
+		const uint32_t words = PackedEdgeStructure(edgeLayout,
+				perNeuronStaticInfoHost, packedStaticHost);
+		if(packEdgesShader.GetProgram() == 0) {
+			packEdgesShader.Compile(PACK_EDGES_SOURCE_CODE, {{"EDGE_LAYOUT",
+					std::to_string((uint32_t)edgeLayout)}});
+		}
+		packedEdges.Generate(nullptr, std::max(words, 4u));
+		packedStatic.Generate(packedStaticHost.data(), neuronsCount);
 		
-		calculationShader.DispatchRoundGroupNumbers(count, 1, 1);
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		packEdgesShader.Use();
+		packEdgesShader.SetUInt(1, neuronsCount);
+		weights.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
+		perNeuronStatic.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 3);
+		weightsStructure.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 6);
+		packedEdges.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 7);
+		packedStatic.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 8);
+		packEdgesShader.DispatchRoundGroupNumbers(neuronsCount, 1, 1);
 		glMemoryBarrier(GL_ALL_BARRIER_BITS);
 	}
 
 
 	const char* NeuralNetwork::CALCULATIONS_SOURCE_CODE = R"(#version 450 core
+#if MAPPING == 1
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
 layout (location=1) uniform uint neuronsStart;
-layout (location=2) uniform uint neuronsCount;
+layout (location=2) uniform uint neuronsEnd;
 
 struct NeuronStructureInfo {
 	uint start;
@@ -183,13 +763,223 @@ layout (packed, binding=6) readonly buffer ConnectedNeurons {
 	uint connectedNeurons[];
 };
 
-layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+// coefficients and error bounds are documented in Activation.hpp
+#if ACTIVATION == 1
+float Activate(float v) {
+	v = clamp(v, -4.97, 4.97);
+	const float v2 = v*v;
+	const float p = v*(135135.0 + v2*(17325.0 + v2*(378.0 + v2)));
+	const float q = 135135.0 + v2*(62370.0 + v2*(3150.0 + v2*28.0));
+	return clamp(p/q, -1.0, 1.0);
+}
+#elif ACTIVATION == 2
+float Activate(float v) {
+	v = clamp(v, -3.0, 3.0);
+	const float v2 = v*v;
+	const float p = v*(0.975854818 + v2*(-0.253494945 + v2*(0.0490969892
+					+ v2*(-0.00494697699 + v2*0.000193352928))));
+	return clamp(p, -1.0, 1.0);
+}
+#elif ACTIVATION == 3 || ACTIVATION == 6
+float Activate(float v) {
+	return 1.0 / (1.0 + exp(-v));
+}
+#elif ACTIVATION == 4
+float Activate(float v) {
+	return max(v, 0.0);
+}
+#elif ACTIVATION == 5
+float Activate(float v) {
+	return clamp(v, -1.0, 1.0);
+}
+#else
+float Activate(float v) {
+	return tanh(v);
+}
+#endif
+
+#if ACTIVATION == 6
+layout (location=3) uniform uint samplingSeed;
+
+// same hash as bn::SamplingHash
+uint SamplingHash(uint v) {
+	v = v*747796405u + 2891336453u;
+	v = ((v >> ((v >> 28u) + 4u)) ^ v) * 277803737u;
+	return (v >> 22u) ^ v;
+}
+
+#if SAMPLING_INDICES
+layout (std430, binding=11) readonly buffer SamplingIndices {
+	uint samplingIndices[];
+};
+#define SAMPLING_INDEX(neuron) samplingIndices[neuron]
+#else
+#define SAMPLING_INDEX(neuron) (neuron)
+#endif
 
+float ActivateNeuron(float v, uint neuron) {
+	const uint h = SamplingHash(SAMPLING_INDEX(neuron)
+			^ SamplingHash(samplingSeed));
+	return float(h >> 8u) * (1.0 / 16777216.0) < Activate(v) ? 1.0 : 0.0;
+}
+#else
+#define ActivateNeuron(v, neuron) Activate(v)
+#endif
+
+// leaky integration of previous state
+#if LEAK == 1
+layout (location=4) uniform float leakRate;
+#define Output(v, neuron) mix(x[neuron], ActivateNeuron(v, neuron), leakRate)
+#elif LEAK == 2
+layout (packed, binding=9) readonly buffer LeakRates {
+	float leakRates[];
+};
+#define Output(v, neuron) \
+	mix(x[neuron], ActivateNeuron(v, neuron), leakRates[neuron])
+#else
+#define Output(v, neuron) ActivateNeuron(v, neuron)
+#endif
+
+#if X_WINDOW > 0
+// [min, max] input of every NEURONS_PER_GROUP aligned neurons
+layout (std430, binding=8) readonly buffer InputWindows {
+	uvec2 inputWindows[];
+};
+
+shared float xWindow[X_WINDOW];
+uint windowStart;
+bool useWindow;
+
+float GatherX(uint i) {
+	return useWindow ? xWindow[i-windowStart] : x[i];
+}
+
+// Must be called in uniform control flow. Workgroup may straddle two
+// aligned blocks when neuronsStart is not aligned.
+void StageWindow() {
+	const uint first = neuronsStart + gl_WorkGroupID.x*NEURONS_PER_GROUP;
+	const uint last = min(first+NEURONS_PER_GROUP, neuronsEnd) - 1;
+	const uvec2 a = inputWindows[first/NEURONS_PER_GROUP];
+	const uvec2 b = inputWindows[last/NEURONS_PER_GROUP];
+	const uint lo = min(a.x, b.x);
+	const uint hi = max(a.y, b.y);
+	useWindow = lo <= hi && hi-lo < X_WINDOW;
+	windowStart = lo;
+	if(useWindow) {
+		for(uint i=gl_LocalInvocationIndex; i<=hi-lo; i+=WORKGROUP_SIZE)
+			xWindow[i] = x[lo+i];
+	}
+	barrier();
+}
+#else
+#define GatherX(i) x[i]
+#define StageWindow()
+#endif
+
+// Connections are summed in units: one connection, or pair of connections
+// for fp16 layout where neuron start is even.
+#if EDGE_LAYOUT == 1
+layout (std430, binding=7) readonly buffer PackedEdges {
+	uvec2 edges[];
+};
+#define UNITS(count) (count)
+#define UNIT_TERM(start, u) \
+	(uintBitsToFloat(edges[(start)+(u)].y) * GatherX(edges[(start)+(u)].x))
+#elif EDGE_LAYOUT == 2
+layout (std430, binding=7) readonly buffer PackedEdges {
+	uint edges[];
+};
+#define UNITS(count) (((count)+1)/2)
+float UnitTerm(uint start, uint u) {
+	const uint p = (start/2+u)*3;
+	const vec2 w = unpackHalf2x16(edges[p+2]);
+	return w.x*GatherX(edges[p]) + w.y*GatherX(edges[p+1]);
+}
+#define UNIT_TERM(start, u) UnitTerm(start, u)
+#else
+#define UNITS(count) (count)
+#define UNIT_TERM(start, u) \
+	(weights[(start)+(u)] * GatherX(connectedNeurons[(start)+(u)]))
+#endif
+
+layout (local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+#if MAPPING == 1
+
+// one subgroup per neuron, lanes read consecutive inputs
 void main() {
+	StageWindow();
+	const uint neuron = neuronsStart + gl_WorkGroupID.x*gl_NumSubgroups
+		+ gl_SubgroupID;
+	if(neuron >= neuronsEnd)
+		return;
+	const NeuronStructureInfo info = neuronStructure[neuron];
+	float sum = 0.0;
+	const uint units = UNITS(info.count);
+	for(uint i=gl_SubgroupInvocationID; i<units; i+=gl_SubgroupSize) {
+		sum += UNIT_TERM(info.start, i);
+	}
+	sum = subgroupAdd(sum);
+	if(subgroupElect()) {
+		if(info.count == 0)
+			y[neuron] = x[neuron];
+		else
+			y[neuron] = Output(sum + biases[neuron], neuron);
+	}
+}
+
+#elif MAPPING == 2
+
+shared float partial[WORKGROUP_SIZE];
+
+// LANES invocations per neuron, tree reduction in shared memory
+void main() {
+	StageWindow();
+	const uint l = gl_LocalInvocationID.x;
+	const uint lane = l % LANES;
+	const uint neuron = neuronsStart
+		+ gl_WorkGroupID.x*(WORKGROUP_SIZE/LANES) + l/LANES;
+	NeuronStructureInfo info = NeuronStructureInfo(0, 0);
+	float sum = 0.0;
+	if(neuron < neuronsEnd) {
+		info = neuronStructure[neuron];
+		const uint units = UNITS(info.count);
+		for(uint i=lane; i<units; i+=LANES) {
+			sum += UNIT_TERM(info.start, i);
+		}
+	}
+	partial[l] = sum;
+	barrier();
+	for(uint offset=LANES/2; offset>0; offset>>=1) {
+		if(lane < offset)
+			partial[l] += partial[l+offset];
+		barrier();
+	}
+	if(lane == 0 && neuron < neuronsEnd) {
+		if(info.count == 0)
+			y[neuron] = x[neuron];
+		else
+			y[neuron] = Output(partial[l] + biases[neuron], neuron);
+	}
+}
+
+#else
+
+void main() {
+	StageWindow();
 	uint neuron = gl_GlobalInvocationID.x+neuronsStart;
-	if(neuron >= neuronsCount)
+	if(neuron >= neuronsEnd)
 		return;
 
+#ifdef FIXED_DEGREE
+	if(neuron < FIXED_DEGREE_FIRST_NEURON) {
+		y[neuron] = x[neuron];
+		return;
+	}
+	const uint start = (neuron-FIXED_DEGREE_FIRST_NEURON)*FIXED_DEGREE_STRIDE;
+	float sum = biases[neuron];
+	FIXED_DEGREE_SUM
+#else
 	const NeuronStructureInfo info = neuronStructure[neuron];
 	if(info.count == 0) {
 		y[neuron] = x[neuron];
@@ -197,24 +987,312 @@ void main() {
 	}
 	
 	float sum = biases[neuron];
-	for(uint i=0; i<info.count; i+=4) {
-		vec4 W, X;
-		W[0] = weights[info.start+i+0];
-		W[1] = weights[info.start+i+1];
-		W[2] = weights[info.start+i+2];
-		W[3] = weights[info.start+i+3];
-		X[0] = x[connectedNeurons[info.start+i+0]];
-		X[1] = x[connectedNeurons[info.start+i+1]];
-		X[2] = x[connectedNeurons[info.start+i+2]];
-		X[3] = x[connectedNeurons[info.start+i+3]];
-		sum += dot(W, X);
-	}
-	for(uint i=info.count&0xFFFFFFFC; i<info.count; ++i) {
-		sum += weights[info.start+i] * x[connectedNeurons[info.start+i]];
-	}
-	
-	y[neuron] = tanh(sum);
-})";
+	const uint units = UNITS(info.count);
+	uint i = 0;
+#if UNROLL > 1
+	for(; i+UNROLL <= units; i+=UNROLL) {
+#if VECTOR_ACCUMULATE && (UNROLL % 4) == 0 && EDGE_LAYOUT == 0
+		for(uint j=0; j<UNROLL; j+=4) {
+			const uint e = info.start+i+j;
+			vec4 W = vec4(weights[e], weights[e+1], weights[e+2], weights[e+3]);
+			vec4 X = vec4(GatherX(connectedNeurons[e]),
+					GatherX(connectedNeurons[e+1]),
+					GatherX(connectedNeurons[e+2]),
+					GatherX(connectedNeurons[e+3]));
+			sum += dot(W, X);
+		}
+#else
+		for(uint j=0; j<UNROLL; ++j) {
+			sum += UNIT_TERM(info.start, i+j);
+		}
+#endif
+	}
+#endif
+	for(; i<units; ++i) {
+		sum += UNIT_TERM(info.start, i);
+	}
+#endif
+	
+	y[neuron] = Output(sum, neuron);
+}
+
+#endif
+)";
+
+	const char* NeuralNetwork::PRUNE_MARK_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint neuronsCount;
+layout (location=2) uniform float threshold;
+layout (location=3) uniform uint topK;
+
+struct NeuronStructureInfo {
+	uint start;
+	uint count;
+};
+
+layout (packed, binding=2) readonly buffer Weights {
+	float weights[];
+};
+
+layout (packed, binding=3) readonly buffer NeuronsStructure {
+	NeuronStructureInfo neuronStructure[];
+};
+
+layout (std430, binding=7) writeonly buffer Keep {
+	uint keep[];
+};
+
+layout (std430, binding=8) writeonly buffer KeptCount {
+	uint keptCount[];
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
 
+// bits of absolute value, magnitudes of floats order as unsigned integers
+uint Magnitude(uint i) {
+	return floatBitsToUint(weights[i]) & 0x7FFFFFFFu;
 }
 
+void main() {
+	uint neuron = gl_GlobalInvocationID.x;
+	if(neuron >= neuronsCount)
+		return;
+	
+	const NeuronStructureInfo info = neuronStructure[neuron];
+	uint kept = 0;
+	if(topK >= info.count) {
+		for(uint i=0; i<info.count; ++i)
+			keep[info.start+i] = 1;
+		kept = info.count;
+	} else if(topK != 0) {
+		// Magnitude of k-th strongest connection selected bit by bit from
+		// the highest one, 31 passes over inputs whatever the degree.
+		uint selected = 0;
+		for(int bit=30; bit>=0; --bit) {
+			const uint candidate = selected | (1u << bit);
+			uint count = 0;
+			for(uint i=0; i<info.count; ++i)
+				count += Magnitude(info.start+i) >= candidate ? 1 : 0;
+			if(count >= topK)
+				selected = candidate;
+		}
+		uint stronger = 0;
+		for(uint i=0; i<info.count; ++i)
+			stronger += Magnitude(info.start+i) > selected ? 1 : 0;
+		// ties with k-th connection are kept in order of index
+		uint ties = topK - stronger;
+		for(uint i=0; i<info.count; ++i) {
+			const uint m = Magnitude(info.start+i);
+			uint k = m > selected ? 1 : 0;
+			if(m == selected && ties != 0) {
+				k = 1;
+				--ties;
+			}
+			keep[info.start+i] = k;
+		}
+		kept = topK;
+	} else {
+		uint strongest = 0;
+		float strongestWeight = -1.0;
+		for(uint i=0; i<info.count; ++i) {
+			const float w = abs(weights[info.start+i]);
+			const uint k = w >= threshold ? 1 : 0;
+			keep[info.start+i] = k;
+			kept += k;
+			if(w > strongestWeight) {
+				strongestWeight = w;
+				strongest = i;
+			}
+		}
+		if(kept == 0 && info.count != 0) {
+			keep[info.start+strongest] = 1;
+			kept = 1;
+		}
+	}
+	keptCount[neuron] = kept;
+})";
+
+	const char* NeuralNetwork::PRUNE_COMPACT_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint neuronsCount;
+
+struct NeuronStructureInfo {
+	uint start;
+	uint count;
+};
+
+layout (packed, binding=2) readonly buffer Weights {
+	float weights[];
+};
+
+layout (packed, binding=3) readonly buffer NeuronsStructure {
+	NeuronStructureInfo neuronStructure[];
+};
+
+layout (packed, binding=6) readonly buffer ConnectedNeurons {
+	uint connectedNeurons[];
+};
+
+layout (std430, binding=7) readonly buffer Keep {
+	uint keep[];
+};
+
+layout (std430, binding=8) readonly buffer KeptStart {
+	uint keptStart[];
+};
+
+layout (packed, binding=9) writeonly buffer PrunedWeights {
+	float prunedWeights[];
+};
+
+layout (packed, binding=10) writeonly buffer PrunedConnectedNeurons {
+	uint prunedConnectedNeurons[];
+};
+
+layout (packed, binding=11) writeonly buffer PrunedNeuronsStructure {
+	NeuronStructureInfo prunedNeuronStructure[];
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+	uint neuron = gl_GlobalInvocationID.x;
+	if(neuron >= neuronsCount)
+		return;
+	
+	const NeuronStructureInfo info = neuronStructure[neuron];
+	const uint start = keptStart[neuron];
+	uint count = 0;
+	for(uint i=0; i<info.count; ++i) {
+		if(keep[info.start+i] != 0) {
+			prunedWeights[start+count] = weights[info.start+i];
+			prunedConnectedNeurons[start+count] =
+				connectedNeurons[info.start+i];
+			++count;
+		}
+	}
+	
+	NeuronStructureInfo pruned;
+	pruned.start = count != 0 ? start : 0;
+	pruned.count = count;
+	prunedNeuronStructure[neuron] = pruned;
+})";
+
+	
+	const char* NeuralNetwork::PACK_EDGES_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint neuronsCount;
+
+struct NeuronStructureInfo {
+	uint start;
+	uint count;
+};
+
+layout (packed, binding=2) readonly buffer Weights {
+	float weights[];
+};
+
+layout (packed, binding=3) readonly buffer NeuronsStructure {
+	NeuronStructureInfo neuronStructure[];
+};
+
+layout (packed, binding=6) readonly buffer ConnectedNeurons {
+	uint connectedNeurons[];
+};
+
+#if EDGE_LAYOUT == 1
+layout (std430, binding=7) writeonly buffer PackedEdges {
+	uvec2 edges[];
+};
+#else
+layout (std430, binding=7) writeonly buffer PackedEdges {
+	uint edges[];
+};
+#endif
+
+layout (packed, binding=8) readonly buffer PackedStructure {
+	NeuronStructureInfo packedStructure[];
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+	const uint neuron = gl_GlobalInvocationID.x;
+	if(neuron >= neuronsCount)
+		return;
+	const NeuronStructureInfo info = neuronStructure[neuron];
+	const uint packedStart = packedStructure[neuron].start;
+#if EDGE_LAYOUT == 1
+	for(uint i=0; i<info.count; ++i) {
+		edges[packedStart+i] = uvec2(connectedNeurons[info.start+i],
+				floatBitsToUint(weights[info.start+i]));
+	}
+#else
+	// odd count is padded with zero weight connection to the same input
+	for(uint i=0; i<info.count; i+=2) {
+		const uint e = info.start+i;
+		const uint p = (packedStart+i)/2*3;
+		const bool second = i+1 < info.count;
+		edges[p] = connectedNeurons[e];
+		edges[p+1] = connectedNeurons[second ? e+1 : e];
+		edges[p+2] = packHalf2x16(vec2(weights[e],
+					second ? weights[e+1] : 0.0));
+	}
+#endif
+})";
+
+	const char* NeuralNetwork::STATE_DELTA_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint count;
+
+layout (packed, binding=4) readonly buffer StatePrevious {
+	float x[];
+};
+
+layout (packed, binding=5) readonly buffer StateNext {
+	float y[];
+};
+
+layout (std430, binding=10) buffer Partials {
+	vec2 partials[];
+};
+
+layout (std430, binding=11) writeonly buffer Result {
+	vec2 result;
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+shared vec2 reduction[256];
+
+// (max, sum of squares) of |y - x| over neurons in first pass, of
+// partials of workgroups in FINAL pass
+void main() {
+	const uint l = gl_LocalInvocationID.x;
+	vec2 v = vec2(0.0);
+#ifdef FINAL
+	for(uint i=l; i<count; i+=256) {
+		v = vec2(max(v.x, partials[i].x), v.y + partials[i].y);
+	}
+#else
+	const uint step = gl_NumWorkGroups.x*256;
+	for(uint i=gl_GlobalInvocationID.x; i<count; i+=step) {
+		const float d = abs(y[i] - x[i]);
+		v = vec2(max(v.x, d), v.y + d*d);
+	}
+#endif
+	reduction[l] = v;
+	barrier();
+	for(uint offset=128; offset>0; offset>>=1) {
+		if(l < offset) {
+			reduction[l] = vec2(max(reduction[l].x, reduction[l+offset].x),
+					reduction[l].y + reduction[l+offset].y);
+		}
+		barrier();
+	}
+	if(l == 0) {
+#ifdef FINAL
+		result = vec2(reduction[0].x, sqrt(reduction[0].y));
+#else
+		partials[gl_WorkGroupID.x] = reduction[0];
+#endif
+	}
+}
+)";
+}
@@ -0,0 +1,634 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/SharedNetworkImage.hpp"
+#include "../include/boltzmann/ThreadPool.hpp"
+
+namespace bn {
+	NeuralNetworkCPU::NeuralNetworkCPU(EdgeLayout edgeLayout) :
+		edgeLayout(edgeLayout), activation(Activation::TANH) {
+		weightsCount = neuronsCount = 0;
+		statePrevious = stateNext = nullptr;
+		fixedDegree = fixedDegreeFirstNeuron = 0;
+		batchWidth = 4;
+		prefetchDistance = streamLength = 0;
+		tileNeurons = 0;
+		tileBlockNeurons = 16384;
+		samplingSeed = 0;
+		leakRate = 1.0f;
+		image = nullptr;
+		imageLeakRates = false;
+		pool = nullptr;
+		taskBegin = taskEnd = 0;
+		numaPolicy = NumaPolicy::FIRST_TOUCH;
+		replicateStates = false;
+		replicasValid = false;
+	}
+	
+	NeuralNetworkCPU::~NeuralNetworkCPU() {
+	}
+	
+	void NeuralNetworkCPU::InitEmptyNetwork(
+			const std::vector<std::vector<uint32_t>>& structure) {
+		neuronsCount = structure.size();
+		std::vector<PerNeuronStatic> info, packed;
+		weightsCount = BuildNetworkStructure(structure, this->structure, info);
+		perNeuronStatic.assign(info.begin(), info.end());
+		leakRates.clear();
+		samplingIndices.clear();
+		image = nullptr;
+		imageLeakRates = false;
+		
+		weightsStructure.resize(weightsCount);
+		for(uint32_t i=0; i<neuronsCount; ++i) {
+			std::copy(this->structure[i].begin(), this->structure[i].end(),
+					weightsStructure.begin()+perNeuronStatic[i].weights_start);
+		}
+		
+		states[0].resize(neuronsCount);
+		RandomBuffer(states[0].data(), neuronsCount, -1, 1);
+		states[1].assign(neuronsCount, 0.0f);
+		weights.resize(weightsCount);
+		RandomBuffer(weights.data(), weightsCount, -10000, 10000);
+		bias.resize(neuronsCount);
+		RandomBuffer(bias.data(), neuronsCount, -10000, 10000);
+		
+		statePrevious = states[0].data();
+		stateNext = states[1].data();
+		
+		fixedDegree = DetectFixedDegree(info, fixedDegreeFirstNeuron);
+		
+		packedEdges.resize(PackedEdgeStructure(edgeLayout, info, packed));
+		packedStatic.assign(packed.begin(), packed.end());
+		PackEdges();
+		PackTiles();
+		
+		UpdateStreamLength();
+		UpdateWorkPrefix();
+		PlaceMemory();
+	}
+	
+	int NeuralNetworkCPU::AttachImage(const SharedNetworkImage& image) {
+		if(!image.IsOpen()) {
+			printf("Shared network image is not open\n");
+			return -1;
+		}
+		if(image.GetEdgeLayout() != edgeLayout) {
+			printf("Edge layout of shared network image differs\n");
+			return -1;
+		}
+		this->image = &image;
+		neuronsCount = image.GetNeuronsCount();
+		weightsCount = image.GetWeightsCount();
+		structure.clear();
+		perNeuronStatic.clear();
+		weightsStructure.clear();
+		weights.clear();
+		bias.clear();
+		packedStatic.clear();
+		packedEdges.clear();
+		tileNeurons = 0;
+		tiledBlockStarts.clear();
+		tiledSources.clear();
+		tiledTargets.clear();
+		tiledWeights.clear();
+		tileScratch.clear();
+		leakRates.clear();
+		samplingIndices.clear();
+		imageLeakRates = image.GetLeakRates() != nullptr;
+		activation = image.GetActivation();
+		leakRate = image.GetLeakRate();
+		fixedDegree = image.GetFixedDegree();
+		fixedDegreeFirstNeuron = image.GetFixedDegreeFirstNeuron();
+		// groups were normalized by network that created image
+		activationGroups = image.GetActivationGroups();
+		
+		states[0].resize(neuronsCount);
+		RandomBuffer(states[0].data(), neuronsCount, -1, 1);
+		states[1].assign(neuronsCount, 0.0f);
+		statePrevious = states[0].data();
+		stateNext = states[1].data();
+		
+		UpdateStreamLength();
+		UpdateWorkPrefix();
+		PlaceMemory();
+		return 0;
+	}
+	
+	void NeuralNetworkCPU::UpdateStreamLength() {
+		streamLength = weightsCount;
+		if(edgeLayout == EdgeLayout::SEPARATE)
+			return;
+		const PerNeuronStatic* packed = image ? image->GetPackedStatic()
+			: packedStatic.data();
+		streamLength = 0;
+		for(uint32_t i=0; i<neuronsCount; ++i)
+			streamLength = std::max(streamLength, packed[i].weights_start
+					+ packed[i].weights_count);
+	}
+	
+	void NeuralNetworkCPU::PackEdges() {
+		if(edgeLayout == EdgeLayout::SEPARATE)
+			return;
+		// packedEdges is sized by InitEmptyNetwork
+		bn::PackEdges(edgeLayout, perNeuronStatic.data(), packedStatic.data(),
+				neuronsCount, weightsStructure.data(), weights.data(),
+				packedEdges.data());
+	}
+	
+	void NeuralNetworkCPU::PackTiles() {
+		if(tileNeurons == 0) {
+			tiledBlockStarts.clear();
+			tiledSources.clear();
+			tiledTargets.clear();
+			tiledWeights.clear();
+			return;
+		}
+		const uint32_t blocks = (neuronsCount + tileBlockNeurons-1)
+			/ tileBlockNeurons;
+		const uint32_t tiles = (neuronsCount + tileNeurons-1) / tileNeurons;
+		// same size keeps placement of pages
+		tiledBlockStarts.resize(blocks+1);
+		tiledSources.resize(weightsCount);
+		tiledTargets.resize(weightsCount);
+		tiledWeights.resize(weightsCount);
+		std::vector<uint32_t> offsets(tiles+1);
+		uint32_t position = 0;
+		for(uint32_t b=0; b<blocks; ++b) {
+			const uint32_t first = b*tileBlockNeurons;
+			const uint32_t end = std::min(first+tileBlockNeurons, neuronsCount);
+			tiledBlockStarts[b] = position;
+			// counting sort of connections of block by tile of source
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for(uint32_t n=first; n<end; ++n) {
+				const PerNeuronStatic info = perNeuronStatic[n];
+				for(uint32_t i=0; i<info.weights_count; ++i)
+					++offsets[weightsStructure[info.weights_start+i]
+						/ tileNeurons + 1];
+			}
+			offsets[0] = position;
+			for(uint32_t t=0; t<tiles; ++t)
+				offsets[t+1] += offsets[t];
+			for(uint32_t n=first; n<end; ++n) {
+				const PerNeuronStatic info = perNeuronStatic[n];
+				for(uint32_t i=0; i<info.weights_count; ++i) {
+					const uint32_t source =
+						weightsStructure[info.weights_start+i];
+					const uint32_t e = offsets[source / tileNeurons]++;
+					tiledSources[e] = source;
+					tiledTargets[e] = n-first;
+					tiledWeights[e] = weights[info.weights_start+i];
+				}
+			}
+			position = offsets[tiles-1];
+		}
+		tiledBlockStarts[blocks] = position;
+	}
+	
+	int NeuralNetworkCPU::SetTiling(uint32_t tileNeurons,
+			uint32_t blockNeurons) {
+		if(image && tileNeurons) {
+			printf("Tiling is not available for network attached to shared"
+					" image\n");
+			return -1;
+		}
+		if(blockNeurons == 0 || blockNeurons % 16
+				|| blockNeurons > cpu::TILED_MAX_BLOCK) {
+			printf("Tile block of %u neurons is not multiple of 16 up to"
+					" %u\n", blockNeurons, cpu::TILED_MAX_BLOCK);
+			return -1;
+		}
+		this->tileNeurons = tileNeurons;
+		tileBlockNeurons = blockNeurons;
+		PackTiles();
+		UpdateTileScratch();
+		// task bounds follow blocks
+		taskBegin = taskEnd = 0;
+		PlaceMemory();
+		return 0;
+	}
+	
+	void NeuralNetworkCPU::UpdateTileScratch() {
+		if(tileNeurons == 0) {
+			HostVector<float>().swap(tileScratch);
+			return;
+		}
+		const uint32_t threads = pool ? pool->GetThreadCount() : 1;
+		HostVector<float> scratch;
+		// default initialized, pages are not touched yet
+		scratch.resize((size_t)threads*tileBlockNeurons);
+		tileScratch.swap(scratch);
+		if(pool == nullptr)
+			return;
+		pool->Run(threads, [&](uint32_t task, uint32_t) {
+				std::fill(tileScratch.begin() + (size_t)task*tileBlockNeurons,
+						tileScratch.begin() + (size_t)(task+1)*tileBlockNeurons,
+						0.0f);
+			}, false);
+	}
+	
+	cpu::TiledView NeuralNetworkCPU::GetTiledView() const {
+		return {tiledBlockStarts.data(), tiledSources.data(),
+			tiledTargets.data(), tiledWeights.data(), tileBlockNeurons,
+			neuronsCount};
+	}
+	
+	void NeuralNetworkCPU::SetThreadPool(ThreadPool* pool) {
+		this->pool = pool;
+		taskBegin = taskEnd = 0;
+		UpdateTileScratch();
+		PlaceMemory();
+	}
+	
+	void NeuralNetworkCPU::SetNumaPolicy(NumaPolicy policy,
+			bool replicateStates) {
+		numaPolicy = policy;
+		this->replicateStates = replicateStates;
+		PlaceMemory();
+	}
+	
+	void NeuralNetworkCPU::UpdateWorkPrefix() {
+		const PerNeuronStatic* info = GetView().perNeuronStatic;
+		workPrefix.resize(neuronsCount+1);
+		workPrefix[0] = 0;
+		for(uint32_t i=0; i<neuronsCount; ++i)
+			workPrefix[i+1] = workPrefix[i] + info[i].weights_count
+				+ NEURON_COST;
+		taskBegin = taskEnd = 0;
+	}
+	
+	void NeuralNetworkCPU::Partition(uint32_t begin, uint32_t end,
+			uint32_t tasks, std::vector<uint32_t>& bounds) const {
+		// 16 states per 64 byte line, neighbouring tasks never write the
+		// same line, tiled tasks cover whole blocks
+		const uint32_t ALIGNMENT = tiledBlockStarts.empty() ? 16
+			: tileBlockNeurons;
+		bounds.resize(tasks+1);
+		bounds[0] = begin;
+		bounds[tasks] = end;
+		const uint64_t first = workPrefix[begin];
+		const uint64_t work = workPrefix[end] - first;
+		for(uint32_t t=1; t<tasks; ++t) {
+			uint32_t b = std::lower_bound(workPrefix.begin()+begin,
+					workPrefix.begin()+end, first + work*t/tasks)
+				- workPrefix.begin();
+			b = b / ALIGNMENT * ALIGNMENT;
+			bounds[t] = std::min(std::max(b, bounds[t-1]), end);
+		}
+	}
+	
+	template<typename T>
+	static void Place(HostVector<T>& array, ThreadPool& pool,
+			const std::vector<uint32_t>& bounds,
+			const std::vector<uint64_t>& positions) {
+		if(array.empty())
+			return;
+		HostVector<T> placed;
+		// default initialized, pages are not touched yet
+		placed.resize(array.size());
+		const uint64_t last = positions.back();
+		pool.Run(bounds.size()-1, [&](uint32_t task, uint32_t) {
+				const size_t begin = array.size() * positions[task] / last;
+				const size_t end = array.size() * positions[task+1] / last;
+				std::copy(array.begin()+begin, array.begin()+end,
+						placed.begin()+begin);
+			}, false);
+		array.swap(placed);
+	}
+	
+	template<typename T>
+	static int Bind(HostVector<T>& array, const std::vector<uint32_t>& nodes,
+			const std::vector<uint64_t>& positions) {
+		int result = 0;
+		const uint64_t last = positions.back();
+		for(size_t t=0; t+1<positions.size() && !array.empty(); ++t) {
+			const size_t begin = array.size() * positions[t] / last;
+			const size_t end = array.size() * positions[t+1] / last;
+			result |= HostBindToNode(array.data()+begin,
+					(end-begin)*sizeof(T), nodes[t]);
+		}
+		return result;
+	}
+	
+	template<typename T>
+	static int Interleave(HostVector<T>& array, uint32_t nodes) {
+		return HostInterleave(array.data(), array.size()*sizeof(T), nodes);
+	}
+	
+	void NeuralNetworkCPU::PlaceMemory() {
+		replicasValid = false;
+		stateReplicas.clear();
+		if(pool == nullptr || neuronsCount == 0)
+			return;
+		const uint32_t tasks = pool->GetThreadCount()*TASKS_PER_THREAD;
+		std::vector<uint32_t> bounds;
+		Partition(0, neuronsCount, tasks, bounds);
+		// neuron and connection arrays are laid out in neuron order, task
+		// touches share of array proportional to its neurons or connections
+		std::vector<uint64_t> neurons(bounds.begin(), bounds.end());
+		std::vector<uint64_t> edges(bounds.size());
+		for(size_t i=0; i<bounds.size(); ++i)
+			edges[i] = workPrefix[bounds[i]] - (uint64_t)bounds[i]*NEURON_COST;
+		if(edges.back() == 0)
+			edges = neurons;
+		
+		int result = 0;
+		if(numaPolicy == NumaPolicy::FIRST_TOUCH) {
+			const bool previousFirst = statePrevious == states[0].data();
+			Place(states[0], *pool, bounds, neurons);
+			Place(states[1], *pool, bounds, neurons);
+			statePrevious = states[previousFirst ? 0 : 1].data();
+			stateNext = states[previousFirst ? 1 : 0].data();
+			Place(bias, *pool, bounds, neurons);
+			Place(leakRates, *pool, bounds, neurons);
+			Place(samplingIndices, *pool, bounds, neurons);
+			Place(perNeuronStatic, *pool, bounds, neurons);
+			Place(packedStatic, *pool, bounds, neurons);
+			Place(weightsStructure, *pool, bounds, edges);
+			Place(weights, *pool, bounds, edges);
+			Place(packedEdges, *pool, bounds, edges);
+			Place(tiledSources, *pool, bounds, edges);
+			Place(tiledTargets, *pool, bounds, edges);
+			Place(tiledWeights, *pool, bounds, edges);
+		} else if(numaPolicy == NumaPolicy::BIND) {
+			// node of home thread of every task
+			std::vector<uint32_t> nodes(tasks);
+			for(uint32_t t=0; t<pool->GetThreadCount(); ++t)
+				for(uint32_t i=ThreadPool::HomeBegin(tasks,
+							pool->GetThreadCount(), t);
+						i<ThreadPool::HomeBegin(tasks,
+							pool->GetThreadCount(), t+1); ++i)
+					nodes[i] = pool->GetNode(t);
+			result |= Bind(states[0], nodes, neurons);
+			result |= Bind(states[1], nodes, neurons);
+			result |= Bind(bias, nodes, neurons);
+			result |= Bind(leakRates, nodes, neurons);
+			result |= Bind(samplingIndices, nodes, neurons);
+			result |= Bind(perNeuronStatic, nodes, neurons);
+			result |= Bind(packedStatic, nodes, neurons);
+			result |= Bind(weightsStructure, nodes, edges);
+			result |= Bind(weights, nodes, edges);
+			result |= Bind(packedEdges, nodes, edges);
+			result |= Bind(tiledSources, nodes, edges);
+			result |= Bind(tiledTargets, nodes, edges);
+			result |= Bind(tiledWeights, nodes, edges);
+		} else if(numaPolicy == NumaPolicy::INTERLEAVE) {
+			const uint32_t count = pool->GetNodeCount();
+			result |= Interleave(states[0], count);
+			result |= Interleave(states[1], count);
+			result |= Interleave(bias, count);
+			result |= Interleave(leakRates, count);
+			result |= Interleave(samplingIndices, count);
+			result |= Interleave(perNeuronStatic, count);
+			result |= Interleave(packedStatic, count);
+			result |= Interleave(weightsStructure, count);
+			result |= Interleave(weights, count);
+			result |= Interleave(packedEdges, count);
+			result |= Interleave(tiledSources, count);
+			result |= Interleave(tiledTargets, count);
+			result |= Interleave(tiledWeights, count);
+		}
+		
+		if(replicateStates) {
+			stateReplicas.resize(pool->GetNodeCount());
+			for(uint32_t n=0; n<stateReplicas.size(); ++n) {
+				// policy of fresh pages is set before they are touched
+				stateReplicas[n].resize(neuronsCount);
+				result |= HostBindToNode(stateReplicas[n].data(),
+						neuronsCount*sizeof(float), n);
+			}
+		}
+		if(result)
+			printf("mbind failed, part of arrays keeps previous placement\n");
+	}
+	
+	void NeuralNetworkCPU::RefreshReplicas() {
+		const uint32_t threads = pool->GetThreadCount();
+		pool->Run(threads, [this, threads](uint32_t, uint32_t thread) {
+				// threads of the node split copying its replica
+				const uint32_t node = pool->GetNode(thread);
+				uint32_t rank = 0, count = 0;
+				for(uint32_t t=0; t<threads; ++t) {
+					if(pool->GetNode(t) == node) {
+						rank += t < thread;
+						++count;
+					}
+				}
+				const uint32_t begin = (uint64_t)neuronsCount*rank/count;
+				const uint32_t end = (uint64_t)neuronsCount*(rank+1)/count;
+				memcpy(stateReplicas[node].data()+begin, statePrevious+begin,
+						(end-begin)*sizeof(float));
+			}, false);
+		replicasValid = true;
+	}
+	
+	
+	void NeuralNetworkCPU::SwapStates() {
+		std::swap(statePrevious, stateNext);
+		replicasValid = false;
+		++samplingSeed;
+	}
+	
+	void NeuralNetworkCPU::UpdateStates(const float* data, uint32_t start,
+			uint32_t elements) {
+		if(start >= neuronsCount)
+			return;
+		elements = std::min(neuronsCount-start, elements);
+		memcpy(statePrevious+start, data, elements*sizeof(float));
+		replicasValid = false;
+	}
+	
+	void NeuralNetworkCPU::FetchStates(float* data, uint32_t start,
+			uint32_t elements) {
+		if(start >= neuronsCount)
+			return;
+		elements = std::min(neuronsCount-start, elements);
+		memcpy(data, stateNext+start, elements*sizeof(float));
+	}
+	
+	void NeuralNetworkCPU::UpdateBiasWeights(float* bias, float* weight) {
+		if(image) {
+			printf("Weights of network attached to shared image are read"
+					" only\n");
+			return;
+		}
+		memcpy(weights.data(), weight, weightsCount*sizeof(float));
+		memcpy(this->bias.data(), bias, neuronsCount*sizeof(float));
+		PackEdges();
+		PackTiles();
+	}
+	
+	cpu::NetworkView NeuralNetworkCPU::GetView() const {
+		cpu::NetworkView view;
+		if(image)
+			view = {image->GetPerNeuronStatic(), image->GetConnections(),
+				image->GetWeights(), image->GetBias(), edgeLayout,
+				image->GetPackedStatic(), image->GetPackedEdges(), activation,
+				samplingSeed, imageLeakRates ? image->GetLeakRates()
+					: leakRates.empty() ? nullptr : leakRates.data(),
+				leakRate};
+		else
+			view = {perNeuronStatic.data(), weightsStructure.data(),
+				weights.data(), bias.data(), edgeLayout, packedStatic.data(),
+				packedEdges.data(), activation, samplingSeed,
+				leakRates.empty() ? nullptr : leakRates.data(), leakRate};
+		view.samplingIndices = samplingIndices.empty() ? nullptr
+			: samplingIndices.data();
+		view.streamLength = streamLength;
+		view.prefetchDistance = prefetchDistance;
+		return view;
+	}
+	
+	void NeuralNetworkCPU::SetLeakRates(const float* rates) {
+		imageLeakRates = false;
+		if(rates == nullptr) {
+			leakRates.clear();
+			return;
+		}
+		const bool allocated = leakRates.size() == neuronsCount;
+		leakRates.assign(rates, rates+neuronsCount);
+		if(!allocated)
+			PlaceMemory();
+	}
+	
+	void NeuralNetworkCPU::SetSamplingIndices(const uint32_t* indices) {
+		if(indices == nullptr) {
+			samplingIndices.clear();
+			return;
+		}
+		const bool allocated = samplingIndices.size() == neuronsCount;
+		samplingIndices.assign(indices, indices+neuronsCount);
+		if(!allocated)
+			PlaceMemory();
+	}
+	
+	int NeuralNetworkCPU::SetActivationGroups(
+			const std::vector<ActivationGroup>& groups) {
+		std::vector<ActivationGroup> normalized = groups;
+		if(!NormalizeActivationGroups(normalized))
+			return -1;
+		activationGroups.swap(normalized);
+		return 0;
+	}
+	
+	void NeuralNetworkCPU::PerformCalculation(uint32_t start, uint32_t count) {
+		if(start >= neuronsCount)
+			return;
+		const uint32_t end = start + std::min(neuronsCount-start, count);
+		if(pool == nullptr || pool->GetThreadCount() < 2) {
+			CalculateRange(start, end, statePrevious, 0);
+			return;
+		}
+		if(taskBegin != start || taskEnd != end) {
+			Partition(start, end, pool->GetThreadCount()*TASKS_PER_THREAD,
+					taskBounds);
+			taskBegin = start;
+			taskEnd = end;
+		}
+		const bool replicas = !stateReplicas.empty();
+		if(replicas && !replicasValid)
+			RefreshReplicas();
+		pool->Run(taskBounds.size()-1, [=](uint32_t task, uint32_t thread) {
+				if(taskBounds[task] < taskBounds[task+1])
+					CalculateRange(taskBounds[task], taskBounds[task+1],
+							replicas ? stateReplicas[pool->GetNode(thread)]
+								.data() : statePrevious, thread);
+			});
+	}
+	
+	void NeuralNetworkCPU::CalculateRange(uint32_t start, uint32_t end,
+			const float* x, uint32_t thread) {
+		cpu::NetworkView view = GetView();
+		const cpu::TiledView tiles = GetTiledView();
+		ForEachActivationRange(activationGroups, activation, start, end,
+				[&](uint32_t begin, uint32_t end, Activation activation) {
+					view.activation = activation;
+					if(!tiledBlockStarts.empty()) {
+						cpu::DispatchTiled(view, tiles, x, stateNext, begin,
+								end, tileScratch.data()
+								+ (size_t)thread*tileBlockNeurons);
+						return;
+					}
+					if(fixedDegree && edgeLayout == EdgeLayout::SEPARATE
+							&& cpu::DispatchFixedDegree(fixedDegree,
+								batchWidth, view, x, stateNext, begin, end,
+								fixedDegreeFirstNeuron))
+						return;
+					cpu::DispatchGeneric(view, x, stateNext, begin, end);
+				});
+	}
+	
+	uint32_t NeuralNetworkCPU::TunePrefetchDistance(uint32_t iterations) {
+		double bestTime = INFINITY;
+		uint32_t best = 0;
+		for(uint32_t distance : cpu::PREFETCH_DISTANCES) {
+			prefetchDistance = distance;
+			// first run warms caches and partitions tasks
+			PerformCalculation(0, neuronsCount);
+			auto t1 = std::chrono::steady_clock::now();
+			for(uint32_t i=0; i<iterations; ++i)
+				PerformCalculation(0, neuronsCount);
+			auto t2 = std::chrono::steady_clock::now();
+			const double time = std::chrono::duration<double>(t2-t1).count();
+			if(time < bestTime) {
+				bestTime = time;
+				best = distance;
+			}
+		}
+		prefetchDistance = best;
+		return best;
+	}
+	
+	StateDelta NeuralNetworkCPU::ComputeStateDelta() const {
+		float maxDelta = 0.0f;
+		double sum = 0.0;
+		for(uint32_t i=0; i<neuronsCount; ++i) {
+			const float d = std::fabs(stateNext[i] - statePrevious[i]);
+			maxDelta = std::max(maxDelta, d);
+			sum += d*d;
+		}
+		StateDelta delta;
+		delta.max = maxDelta;
+		delta.l2 = std::sqrt(sum);
+		return delta;
+	}
+	
+	ConvergenceResult NeuralNetworkCPU::RunUntilConverged(float tolerance,
+			uint32_t maxSteps, uint32_t pollInterval) {
+		pollInterval = std::max(pollInterval, 1u);
+		ConvergenceResult result;
+		for(; result.steps<maxSteps && !result.converged; ++result.steps) {
+			PerformCalculation(0, neuronsCount);
+			if((result.steps+1) % pollInterval == 0
+					|| result.steps+1 == maxSteps) {
+				result.delta = ComputeStateDelta();
+				result.converged = result.delta.max <= tolerance;
+			}
+			SwapStates();
+		}
+		return result;
+	}
+}
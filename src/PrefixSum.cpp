@@ -0,0 +1,131 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/boltzmann/PrefixSum.hpp"
+
+namespace bn {
+	const uint32_t PrefixSum::BLOCK_SIZE = 256;
+	
+	PrefixSum::PrefixSum() {
+		scanShader.Compile(SCAN_SOURCE_CODE);
+		addShader.Compile(ADD_SOURCE_CODE);
+	}
+	
+	PrefixSum::~PrefixSum() {
+		for(auto b : blockSums)
+			delete b;
+	}
+	
+	uint32_t PrefixSum::ExclusiveScan(gl::SimpleVBO<uint32_t>& data,
+			uint32_t count) {
+		if(count == 0)
+			return 0;
+		return ScanLevel(data, count, 0);
+	}
+	
+	uint32_t PrefixSum::ScanLevel(gl::SimpleVBO<uint32_t>& data,
+			uint32_t count, uint32_t level) {
+		const uint32_t groups = (count+BLOCK_SIZE-1)/BLOCK_SIZE;
+		if(blockSums.size() <= level)
+			blockSums.push_back(new gl::SimpleVBO<uint32_t>());
+		gl::SimpleVBO<uint32_t>& sums = *blockSums[level];
+		if(sums.GetVertexCount() < groups)
+			sums.Generate(nullptr, groups);
+		
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		scanShader.Use();
+		scanShader.SetUInt(1, count);
+		data.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 1);
+		sums.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
+		scanShader.Dispatch(groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT
+				| GL_BUFFER_UPDATE_BARRIER_BIT);
+		
+		uint32_t total = 0;
+		if(groups == 1) {
+			sums.FetchElements(&total, 0, 1);
+			return total;
+		}
+		
+		total = ScanLevel(sums, groups, level+1);
+		
+		addShader.Use();
+		addShader.SetUInt(1, count);
+		data.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 1);
+		sums.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
+		addShader.Dispatch(groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		return total;
+	}
+	
+	
+	const char* PrefixSum::SCAN_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint count;
+
+layout (std430, binding=1) buffer Data {
+	uint data[];
+};
+
+layout (std430, binding=2) writeonly buffer BlockSums {
+	uint blockSums[];
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+shared uint partial[256];
+
+void main() {
+	const uint id = gl_GlobalInvocationID.x;
+	const uint l = gl_LocalInvocationID.x;
+	const uint value = id < count ? data[id] : 0;
+	
+	partial[l] = value;
+	barrier();
+	for(uint offset=1; offset<256; offset<<=1) {
+		uint v = l >= offset ? partial[l-offset] : 0;
+		barrier();
+		partial[l] += v;
+		barrier();
+	}
+	
+	if(id < count)
+		data[id] = partial[l] - value;
+	if(l == 255)
+		blockSums[gl_WorkGroupID.x] = partial[255];
+})";
+	
+	const char* PrefixSum::ADD_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint count;
+
+layout (std430, binding=1) buffer Data {
+	uint data[];
+};
+
+layout (std430, binding=2) readonly buffer BlockSums {
+	uint blockSums[];
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+	const uint id = gl_GlobalInvocationID.x;
+	if(id < count)
+		data[id] += blockSums[gl_WorkGroupID.x];
+})";
+}
+
@@ -0,0 +1,236 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+#include <fstream>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+
+#include "../include/boltzmann/Profiler.hpp"
+
+namespace bn {
+	Profiler::Histogram::Histogram() {
+		Clear();
+	}
+	
+	void Profiler::Histogram::Clear() {
+		buckets.assign(BUCKETS, 0);
+		count = max = 0;
+		min = UINT64_MAX;
+		sum = 0;
+	}
+	
+	uint32_t Profiler::Histogram::Bucket(uint64_t nanoseconds) {
+		if(nanoseconds < SUB_BUCKETS)
+			return nanoseconds;
+		uint32_t exponent = 63 - __builtin_clzll(nanoseconds);
+		uint32_t mantissa = (nanoseconds >> (exponent-3)) & (SUB_BUCKETS-1);
+		return std::min(BUCKETS-1, (exponent-2)*SUB_BUCKETS + mantissa);
+	}
+	
+	double Profiler::Histogram::BucketValue(uint32_t bucket) {
+		if(bucket < SUB_BUCKETS)
+			return bucket;
+		uint32_t exponent = bucket/SUB_BUCKETS + 2;
+		uint32_t mantissa = bucket%SUB_BUCKETS;
+		// middle of bucket range
+		return std::ldexp(SUB_BUCKETS + mantissa + 0.5, exponent-3);
+	}
+	
+	void Profiler::Histogram::Record(uint64_t nanoseconds) {
+		buckets[Bucket(nanoseconds)]++;
+		count++;
+		sum += nanoseconds;
+		min = std::min(min, nanoseconds);
+		max = std::max(max, nanoseconds);
+	}
+	
+	double Profiler::Histogram::Percentile(double p) const {
+		if(count == 0)
+			return 0;
+		uint64_t rank = std::min<uint64_t>(count-1, p*count);
+		uint64_t seen = 0;
+		for(uint32_t i=0; i<BUCKETS; ++i) {
+			seen += buckets[i];
+			if(seen > rank)
+				return std::clamp<double>(BucketValue(i), min, max);
+		}
+		return max;
+	}
+	
+	
+	
+	Profiler::Profiler(uint32_t ringSize, uint32_t maxTraceEvents) :
+		maxTraceEvents(maxTraceEvents) {
+		ring.resize(std::max<uint32_t>(ringSize, 2));
+		for(Slot& slot : ring) {
+			glGenQueries(1, &slot.elapsedQuery);
+			glGenQueries(1, &slot.timestampQuery);
+			glGenQueries(1, &slot.endTimestampQuery);
+			slot.pending = false;
+		}
+		GL_CHECK_PUSH_ERROR;
+		head = tail = 0;
+		active = false;
+		traceNext = 0;
+		dropped = 0;
+	}
+	
+	Profiler::~Profiler() {
+		for(Slot& slot : ring) {
+			glDeleteQueries(1, &slot.elapsedQuery);
+			glDeleteQueries(1, &slot.timestampQuery);
+			glDeleteQueries(1, &slot.endTimestampQuery);
+		}
+	}
+	
+	void Profiler::Begin(Operation operation) {
+		Collect();
+		Slot& slot = ring[head];
+		if(slot.pending) {
+			dropped++;
+			active = false;
+			return;
+		}
+		slot.operation = operation;
+		glQueryCounter(slot.timestampQuery, GL_TIMESTAMP);
+		glBeginQuery(GL_TIME_ELAPSED, slot.elapsedQuery);
+		active = true;
+	}
+	
+	void Profiler::End(Operation operation) {
+		if(!active)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		glQueryCounter(ring[head].endTimestampQuery, GL_TIMESTAMP);
+		ring[head].pending = true;
+		head = (head+1) % ring.size();
+		active = false;
+	}
+	
+	bool Profiler::Retire(Slot& slot) {
+		GLint available = 0;
+		glGetQueryObjectiv(slot.endTimestampQuery, GL_QUERY_RESULT_AVAILABLE,
+				&available);
+		if(!available)
+			return false;
+		GLuint64 start = 0, end = 0, duration = 0;
+		glGetQueryObjectui64v(slot.timestampQuery, GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(slot.endTimestampQuery, GL_QUERY_RESULT, &end);
+		glGetQueryObjectui64v(slot.elapsedQuery, GL_QUERY_RESULT, &duration);
+		slot.pending = false;
+		// some software drivers (llvmpipe) report ~0 ns elapsed time while
+		// timestamps are valid
+		if(duration <= 1 && end > start)
+			duration = end - start;
+		
+		histograms[slot.operation].Record(duration);
+		TraceEvent event{slot.operation, start, duration};
+		if(trace.size() < maxTraceEvents) {
+			trace.emplace_back(event);
+		} else if(maxTraceEvents) {
+			trace[traceNext] = event;
+			traceNext = (traceNext+1) % maxTraceEvents;
+		}
+		return true;
+	}
+	
+	void Profiler::Collect() {
+		// queries finish in submission order
+		while(ring[tail].pending && Retire(ring[tail]))
+			tail = (tail+1) % ring.size();
+	}
+	
+	void Profiler::Clear() {
+		Collect();
+		for(Histogram& h : histograms)
+			h.Clear();
+		trace.clear();
+		traceNext = 0;
+		dropped = 0;
+	}
+	
+	const Profiler::Histogram& Profiler::GetHistogram(
+			Operation operation) const {
+		return histograms[operation];
+	}
+	
+	const char* Profiler::OperationName(Operation operation) {
+		switch(operation) {
+			case PERFORM_CALCULATION:
+				return "PerformCalculation";
+			case UPDATE_STATES:
+				return "UpdateStates";
+			case FETCH_STATES:
+				return "FetchStates";
+			case UPDATE_BIAS_WEIGHTS:
+				return "UpdateBiasWeights";
+			default:
+				return "Unknown";
+		}
+	}
+	
+	std::string Profiler::StatisticsJSON() const {
+		std::string json = "{";
+		char buf[512];
+		for(int i=0; i<OPERATIONS_COUNT; ++i) {
+			const Histogram& h = histograms[i];
+			snprintf(buf, sizeof(buf), "%s\"%s\":{\"count\":%llu,"
+					"\"mean_ns\":%.1f,\"min_ns\":%llu,\"p50_ns\":%.1f,"
+					"\"p99_ns\":%.1f,\"max_ns\":%llu}", i ? "," : "",
+					OperationName((Operation)i),
+					(unsigned long long)h.Count(), h.Mean(),
+					(unsigned long long)h.Min(), h.Percentile(0.5),
+					h.Percentile(0.99), (unsigned long long)h.Max());
+			json += buf;
+		}
+		snprintf(buf, sizeof(buf), ",\"dropped\":%llu}",
+				(unsigned long long)dropped);
+		return json + buf;
+	}
+	
+	std::string Profiler::ChromeTraceJSON() const {
+		std::vector<TraceEvent> events(trace.begin()+traceNext, trace.end());
+		events.insert(events.end(), trace.begin(), trace.begin()+traceNext);
+		const uint64_t origin = events.size() ? events[0].start : 0;
+		
+		std::string json = "{\"traceEvents\":[";
+		char buf[256];
+		for(size_t i=0; i<events.size(); ++i) {
+			snprintf(buf, sizeof(buf), "%s\n{\"name\":\"%s\",\"cat\":\"gpu\","
+					"\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":0}",
+					i ? "," : "", OperationName(events[i].operation),
+					(events[i].start-origin)/1000.0,
+					events[i].duration/1000.0);
+			json += buf;
+		}
+		return json + "\n],\"displayTimeUnit\":\"ns\"}\n";
+	}
+	
+	bool Profiler::DumpChromeTrace(const std::string& filePath) const {
+		std::ofstream file(filePath, std::ios::trunc);
+		if(!file.good())
+			return false;
+		file << ChromeTraceJSON();
+		return file.good();
+	}
+}
+
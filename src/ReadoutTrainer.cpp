@@ -0,0 +1,249 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstdio>
+
+#include <algorithm>
+
+#include "../include/boltzmann/ReadoutTrainer.hpp"
+
+namespace bn {
+	ReadoutTrainer::ReadoutTrainer() {
+		featuresCount = dimension = outputs = 0;
+		blockRows = rows = 0;
+		samples = 0;
+		bias = false;
+		gatherShader.Compile(GATHER_SOURCE_CODE);
+		gramShader.Compile(GRAM_SOURCE_CODE,
+				{{"TILE", std::to_string(TILE)}});
+	}
+	
+	ReadoutTrainer::~ReadoutTrainer() {
+	}
+	
+	void ReadoutTrainer::Init(const std::vector<uint32_t>& features,
+			uint32_t outputs, bool bias, uint32_t blockRows) {
+		featuresCount = features.size();
+		dimension = featuresCount + (bias ? 1 : 0);
+		this->outputs = outputs;
+		this->bias = bias;
+		// whole tiles of rows
+		this->blockRows = std::max((blockRows+TILE-1)/TILE*TILE, TILE);
+		
+		this->features.Generate(features.data(), featuresCount);
+		rowsBlock.Generate(nullptr, this->blockRows*dimension);
+		targetsBlock.Generate(nullptr, this->blockRows*std::max(outputs, 1u));
+		targetsHost.resize(this->blockRows*outputs);
+		gram.Generate(nullptr, dimension*(dimension+outputs));
+		Clear();
+	}
+	
+	void ReadoutTrainer::Clear() {
+		std::vector<double> zeros(dimension*(dimension+outputs), 0.0);
+		gram.UpdateElements(zeros.data(), 0, zeros.size());
+		rows = 0;
+		samples = 0;
+	}
+	
+	void ReadoutTrainer::Accumulate(NeuralNetwork& network,
+			const float* targets) {
+		if(dimension == 0)
+			return;
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		gatherShader.Use();
+		gatherShader.SetUInt(1, rows);
+		gatherShader.SetUInt(2, featuresCount);
+		gatherShader.SetUInt(3, dimension);
+		features.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 1);
+		rowsBlock.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
+		network.stateNext->BindBufferBase(gl::SHADER_STORAGE_BUFFER, 4);
+		gatherShader.Dispatch((dimension+255)/256, 1, 1);
+		
+		std::copy(targets, targets+outputs, targetsHost.begin()+rows*outputs);
+		++rows;
+		++samples;
+		if(rows == blockRows)
+			Flush();
+	}
+	
+	void ReadoutTrainer::Flush() {
+		if(rows == 0)
+			return;
+		if(outputs)
+			targetsBlock.UpdateElements(targetsHost.data(), 0, rows*outputs);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		gramShader.Use();
+		gramShader.SetUInt(1, rows);
+		gramShader.SetUInt(2, dimension);
+		gramShader.SetUInt(3, outputs);
+		rowsBlock.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 2);
+		targetsBlock.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 3);
+		gram.BindBufferBase(gl::SHADER_STORAGE_BUFFER, 5);
+		gramShader.Dispatch((dimension+outputs+TILE-1)/TILE,
+				(dimension+TILE-1)/TILE, 1);
+		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		rows = 0;
+	}
+	
+	int ReadoutTrainer::Solve(double ridge, std::vector<float>& weights) {
+		Flush();
+		const uint32_t D = dimension, stride = dimension+outputs;
+		std::vector<double> g(D*stride);
+		gram.FetchElements(g.data(), 0, g.size());
+		
+		// lower triangle of A = X^T X + ridge*I, factorized in place into L
+		std::vector<double> L(D*D);
+		for(uint32_t i=0; i<D; ++i) {
+			for(uint32_t j=0; j<=i; ++j)
+				L[i*D+j] = g[j*stride+i];
+			if(!(bias && i+1 == D))
+				L[i*D+i] += ridge;
+		}
+		for(uint32_t j=0; j<D; ++j) {
+			double d = L[j*D+j];
+			for(uint32_t k=0; k<j; ++k)
+				d -= L[j*D+k]*L[j*D+k];
+			if(!(d > 0.0)) {
+				printf(" Readout matrix is not positive definite\n");
+				return -1;
+			}
+			d = std::sqrt(d);
+			L[j*D+j] = d;
+			for(uint32_t i=j+1; i<D; ++i) {
+				double s = L[i*D+j];
+				for(uint32_t k=0; k<j; ++k)
+					s -= L[i*D+k]*L[j*D+k];
+				L[i*D+j] = s/d;
+			}
+		}
+		
+		weights.resize(outputs*D);
+		std::vector<double> y(D);
+		for(uint32_t o=0; o<outputs; ++o) {
+			// L y = X^T Y
+			for(uint32_t i=0; i<D; ++i) {
+				double s = g[i*stride+D+o];
+				for(uint32_t k=0; k<i; ++k)
+					s -= L[i*D+k]*y[k];
+				y[i] = s/L[i*D+i];
+			}
+			// L^T w = y
+			for(uint32_t i=D; i-->0;) {
+				double s = y[i];
+				for(uint32_t k=i+1; k<D; ++k)
+					s -= L[k*D+i]*y[k];
+				y[i] = s/L[i*D+i];
+			}
+			for(uint32_t i=0; i<D; ++i)
+				weights[o*D+i] = y[i];
+		}
+		return 0;
+	}
+	
+	
+	
+	const char* ReadoutTrainer::GATHER_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint row;
+layout (location=2) uniform uint featuresCount;
+layout (location=3) uniform uint dimension;
+
+layout (packed, binding=1) readonly buffer Features {
+	uint features[];
+};
+
+layout (packed, binding=2) writeonly buffer Rows {
+	float rows[];
+};
+
+layout (packed, binding=4) readonly buffer State {
+	float x[];
+};
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+	const uint f = gl_GlobalInvocationID.x;
+	if(f >= dimension)
+		return;
+	rows[row*dimension + f] = f < featuresCount ? x[features[f]] : 1.0;
+}
+)";
+
+	const char* ReadoutTrainer::GRAM_SOURCE_CODE = R"(#version 450 core
+layout (location=1) uniform uint rowsCount;
+layout (location=2) uniform uint dimension;
+layout (location=3) uniform uint outputs;
+
+layout (packed, binding=2) readonly buffer Rows {
+	float rows[];
+};
+
+layout (packed, binding=3) readonly buffer Targets {
+	float targets[];
+};
+
+layout (std430, binding=5) buffer Gram {
+	double gram[];
+};
+
+layout (local_size_x = TILE, local_size_y = TILE, local_size_z = 1) in;
+
+shared float tileI[TILE][TILE];
+shared float tileJ[TILE][TILE];
+
+// column c of [X Y] in row r
+float Column(uint r, uint c) {
+	if(c < dimension)
+		return rows[r*dimension + c];
+	if(c < dimension+outputs)
+		return targets[r*outputs + c-dimension];
+	return 0.0;
+}
+
+// Each workgroup adds TILE x TILE tile of [X^T X | X^T Y], reading rows in
+// tiles of TILE samples through shared memory. Products of floats are exact
+// in double.
+void main() {
+	const uint tx = gl_LocalInvocationID.x;
+	const uint ty = gl_LocalInvocationID.y;
+	const uint j0 = gl_WorkGroupID.x*TILE;
+	const uint i0 = gl_WorkGroupID.y*TILE;
+	// X^T X is symmetric, tiles below diagonal are skipped
+	if(j0+TILE <= i0)
+		return;
+	
+	double sum = 0.0;
+	for(uint r0=0; r0<rowsCount; r0+=TILE) {
+		const uint r = r0+ty;
+		tileI[ty][tx] = r < rowsCount && i0+tx < dimension ?
+			rows[r*dimension + i0+tx] : 0.0;
+		tileJ[ty][tx] = r < rowsCount ? Column(r, j0+tx) : 0.0;
+		barrier();
+		for(uint k=0; k<TILE; ++k)
+			sum += double(tileI[k][ty]) * double(tileJ[k][tx]);
+		barrier();
+	}
+	
+	const uint i = i0+ty, j = j0+tx;
+	if(i < dimension && j < dimension+outputs && j >= i)
+		gram[i*(dimension+outputs) + j] += sum;
+}
+)";
+}
+
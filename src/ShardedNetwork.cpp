@@ -0,0 +1,370 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <type_traits>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+
+#include "../include/boltzmann/ShardedNetwork.hpp"
+#include "../include/boltzmann/NeuralNetwork.hpp"
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/ThreadPool.hpp"
+
+namespace bn {
+	template<typename Network>
+	ShardedNetwork<Network>::ShardedNetwork(EdgeLayout edgeLayout) :
+		edgeLayout(edgeLayout) {
+		weightsCount = neuronsCount = 0;
+	}
+	
+	template<typename Network>
+	ShardedNetwork<Network>::~ShardedNetwork() {
+		// objects of every shard are deleted with its context current
+		ForEachShard([](Shard& shard) {
+				shard.network.reset();
+			});
+	}
+	
+	template<typename Network>
+	template<typename F>
+	void ShardedNetwork<Network>::ForEachShard(F&& f, bool parallel) {
+		if(parallel && pool) {
+			// as many threads as shards, every shard on its own thread
+			pool->Run(shards.size(), [&](uint32_t task, uint32_t) {
+					f(shards[task]);
+				}, false);
+			return;
+		}
+		// Switching context flushes commands of previous one, so every
+		// shard has its work submitted before next shard is visited.
+		gl::OpenGL* previous = nullptr;
+		for(Shard& shard : shards) {
+			if(shard.context) {
+				if(previous == nullptr)
+					previous = gl::OpenGL::Current();
+				shard.context->MakeCurrent();
+			}
+			f(shard);
+		}
+		if(previous)
+			previous->MakeCurrent();
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::InitEmptyNetwork(
+			const std::vector<std::vector<uint32_t>>& structure,
+			uint32_t shardCount, const std::vector<gl::OpenGL*>& contexts) {
+		const uint32_t neurons = structure.size();
+		shardCount = std::max(1u, std::min(shardCount, neurons));
+		std::vector<uint64_t> connections(neurons+1, 0);
+		for(uint32_t i=0; i<neurons; ++i)
+			connections[i+1] = connections[i] + structure[i].size();
+		std::vector<uint32_t> rangeEnds(shardCount, neurons);
+		uint32_t begin = 0;
+		for(uint32_t k=0; k+1<shardCount; ++k) {
+			uint64_t target = connections[neurons]*(k+1)/shardCount;
+			uint32_t end = std::lower_bound(connections.begin()+begin+1,
+					connections.end(), target) - connections.begin();
+			// keep at least one neuron for every remaining shard
+			end = std::min(std::max(end, begin+1), neurons-(shardCount-k-1));
+			rangeEnds[k] = begin = end;
+		}
+		InitEmptyNetwork(structure, rangeEnds, contexts);
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::InitEmptyNetwork(
+			const std::vector<std::vector<uint32_t>>& structure,
+			const std::vector<uint32_t>& rangeEnds,
+			const std::vector<gl::OpenGL*>& contexts) {
+		ForEachShard([](Shard& shard) {
+				shard.network.reset();
+			});
+		shards.clear();
+		
+		std::vector<std::vector<uint32_t>> canonical;
+		std::vector<PerNeuronStatic> perNeuronStatic;
+		neuronsCount = structure.size();
+		weightsCount = BuildNetworkStructure(structure, canonical,
+				perNeuronStatic);
+		
+		shards.resize(rangeEnds.size());
+		if(!std::is_same<Network, NeuralNetworkCPU>::value
+				|| shards.size() < 2)
+			pool.reset();
+		else if(pool == nullptr || pool->GetThreadCount() != shards.size())
+			pool.reset(new ThreadPool(shards.size(), false));
+		std::vector<uint32_t> owner(neuronsCount);
+		for(uint32_t k=0, begin=0; k<shards.size(); ++k) {
+			Shard& shard = shards[k];
+			shard.begin = std::min(begin, neuronsCount);
+			shard.end = std::max(shard.begin, std::min(rangeEnds[k],
+						neuronsCount));
+			shard.context = k < contexts.size() ? contexts[k] : nullptr;
+			std::fill(owner.begin()+shard.begin, owner.begin()+shard.end, k);
+			begin = shard.end;
+		}
+		
+		// neurons read by other shard than owner, and halo of every shard
+		// sorted by global index, which also groups it by source shard
+		std::vector<bool> sent(neuronsCount, false);
+		std::vector<std::vector<uint32_t>> halos(shards.size());
+		for(uint32_t k=0; k<shards.size(); ++k) {
+			std::vector<uint32_t>& halo = halos[k];
+			for(uint32_t i=shards[k].begin; i<shards[k].end; ++i) {
+				for(uint32_t input : canonical[i]) {
+					if(owner[input] != k) {
+						sent[input] = true;
+						halo.emplace_back(input);
+					}
+				}
+			}
+			std::sort(halo.begin(), halo.end());
+			halo.erase(std::unique(halo.begin(), halo.end()), halo.end());
+		}
+		
+		for(uint32_t k=0; k<shards.size(); ++k) {
+			Shard& shard = shards[k];
+			const std::vector<uint32_t>& halo = halos[k];
+			shard.haloCount = halo.size();
+			shard.globalOfLocal = halo;
+			std::vector<uint32_t> category[4];
+			for(uint32_t i=shard.begin; i<shard.end; ++i) {
+				bool computed = !canonical[i].empty();
+				category[computed ? 3-sent[i] : sent[i]].emplace_back(i);
+			}
+			shard.sendLocal = shard.haloCount + category[0].size();
+			shard.sendCount = category[1].size() + category[2].size();
+			for(auto& c : category)
+				shard.globalOfLocal.insert(shard.globalOfLocal.end(),
+						c.begin(), c.end());
+			shard.localOfOwned.resize(shard.end-shard.begin);
+			for(uint32_t l=shard.haloCount; l<shard.globalOfLocal.size();
+					++l)
+				shard.localOfOwned[shard.globalOfLocal[l]-shard.begin] = l;
+			shard.sendBuffer.resize(shard.sendCount);
+			shard.runsCount = 0;
+			shard.runs.clear();
+		}
+		
+		std::vector<std::vector<std::vector<uint32_t>>> localStructures(
+				shards.size());
+		for(uint32_t k=0; k<shards.size(); ++k) {
+			Shard& shard = shards[k];
+			const std::vector<uint32_t>& halo = halos[k];
+			shard.halos.clear();
+			for(uint32_t h=0; h<halo.size(); ++h) {
+				const Shard& source = shards[owner[halo[h]]];
+				if(shard.halos.empty()
+						|| shard.halos.back().source != owner[halo[h]])
+					shard.halos.push_back({owner[halo[h]], h, {}});
+				shard.halos.back().positions.emplace_back(
+						source.localOfOwned[halo[h]-source.begin]
+						- source.sendLocal);
+			}
+			
+			auto localOf = [&](uint32_t global) -> uint32_t {
+				if(owner[global] == k)
+					return shard.localOfOwned[global-shard.begin];
+				return std::lower_bound(halo.begin(), halo.end(), global)
+					- halo.begin();
+			};
+			std::vector<std::vector<uint32_t>>& local = localStructures[k];
+			local.resize(shard.globalOfLocal.size());
+			std::vector<std::pair<uint32_t, uint32_t>> inputs;
+			shard.weightSource.clear();
+			for(uint32_t l=shard.haloCount; l<local.size(); ++l) {
+				const uint32_t global = shard.globalOfLocal[l];
+				const std::vector<uint32_t>& in = canonical[global];
+				inputs.clear();
+				for(uint32_t j=0; j<in.size(); ++j)
+					inputs.emplace_back(localOf(in[j]),
+							perNeuronStatic[global].weights_start+j);
+				// same order as BuildNetworkStructure of shard
+				std::sort(inputs.begin(), inputs.end());
+				for(auto& p : inputs) {
+					local[l].emplace_back(p.first);
+					shard.weightSource.emplace_back(p.second);
+				}
+			}
+		}
+		
+		// sequentially, random initialization is not thread safe
+		ForEachShard([&](Shard& shard) {
+				shard.network.reset(new Network(edgeLayout));
+				shard.network->InitEmptyNetwork(
+						localStructures[&shard - shards.data()]);
+				shard.network->SetSamplingIndices(shard.globalOfLocal.data());
+			}, false);
+		
+		// halo copies start equal to their sources
+		std::vector<float> states;
+		RandomBuffer(states, neuronsCount, -1, 1);
+		UpdateStates(states.data(), 0, neuronsCount);
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::CollectRuns(const Shard& shard,
+			uint32_t start, uint32_t count, bool halo, std::vector<Run>& runs) {
+		runs.clear();
+		const uint64_t end = (uint64_t)start + count;
+		std::vector<uint32_t> locals;
+		if(halo) {
+			auto first = std::lower_bound(shard.globalOfLocal.begin(),
+					shard.globalOfLocal.begin()+shard.haloCount, start);
+			auto last = std::lower_bound(first,
+					shard.globalOfLocal.begin()+shard.haloCount, end);
+			for(auto it=first; it!=last; ++it)
+				locals.emplace_back(it - shard.globalOfLocal.begin());
+		}
+		for(uint32_t i=std::max(start, shard.begin);
+				i<std::min<uint64_t>(end, shard.end); ++i)
+			locals.emplace_back(shard.localOfOwned[i-shard.begin]);
+		std::sort(locals.begin(), locals.end());
+		for(uint32_t l : locals) {
+			if(!runs.empty() && runs.back().local+runs.back().count == l)
+				++runs.back().count;
+			else
+				runs.push_back({l, 1});
+		}
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::SwapStates() {
+		ForEachShard([](Shard& shard) {
+				if(shard.sendCount)
+					shard.network->FetchStates(shard.sendBuffer.data(),
+							shard.sendLocal, shard.sendCount);
+			});
+		ForEachShard([this](Shard& shard) {
+				shard.network->SwapStates();
+				for(const Halo& halo : shard.halos) {
+					const std::vector<float>& sent =
+						shards[halo.source].sendBuffer;
+					shard.buffer.resize(halo.positions.size());
+					for(size_t i=0; i<halo.positions.size(); ++i)
+						shard.buffer[i] = sent[halo.positions[i]];
+					shard.network->UpdateStates(shard.buffer.data(),
+							halo.local, halo.positions.size());
+				}
+			});
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::UpdateStates(const float* data,
+			uint32_t start, uint32_t elements) {
+		if(start >= neuronsCount)
+			return;
+		elements = std::min(neuronsCount-start, elements);
+		ForEachShard([=](Shard& shard) {
+				std::vector<Run> runs;
+				CollectRuns(shard, start, elements, true, runs);
+				for(const Run& run : runs) {
+					shard.buffer.resize(run.count);
+					for(uint32_t i=0; i<run.count; ++i)
+						shard.buffer[i] =
+							data[shard.globalOfLocal[run.local+i]-start];
+					shard.network->UpdateStates(shard.buffer.data(),
+							run.local, run.count);
+				}
+			});
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::FetchStates(float* data, uint32_t start,
+			uint32_t elements) {
+		if(start >= neuronsCount)
+			return;
+		elements = std::min(neuronsCount-start, elements);
+		ForEachShard([=](Shard& shard) {
+				std::vector<Run> runs;
+				CollectRuns(shard, start, elements, false, runs);
+				for(const Run& run : runs) {
+					shard.buffer.resize(run.count);
+					shard.network->FetchStates(shard.buffer.data(),
+							run.local, run.count);
+					for(uint32_t i=0; i<run.count; ++i)
+						data[shard.globalOfLocal[run.local+i]-start] =
+							shard.buffer[i];
+				}
+			});
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::PerformCalculation(uint32_t start,
+			uint32_t count) {
+		ForEachShard([=](Shard& shard) {
+				if(shard.runsStart != start || shard.runsCount != count
+						|| shard.runs.empty()) {
+					CollectRuns(shard, start, count, false, shard.runs);
+					shard.runsStart = start;
+					shard.runsCount = count;
+				}
+				for(const Run& run : shard.runs)
+					shard.network->PerformCalculation(run.local, run.count);
+			});
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::UpdateBiasWeights(float* bias,
+			float* weight) {
+		ForEachShard([=](Shard& shard) {
+				std::vector<float> localBias(shard.globalOfLocal.size());
+				for(size_t l=0; l<localBias.size(); ++l)
+					localBias[l] = bias[shard.globalOfLocal[l]];
+				std::vector<float> localWeights(shard.weightSource.size());
+				for(size_t i=0; i<localWeights.size(); ++i)
+					localWeights[i] = weight[shard.weightSource[i]];
+				shard.network->UpdateBiasWeights(localBias.data(),
+						localWeights.data());
+			});
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::SetActivation(Activation activation) {
+		ForEachShard([=](Shard& shard) {
+				shard.network->SetActivation(activation);
+			});
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::SetLeakRate(float rate) {
+		ForEachShard([=](Shard& shard) {
+				shard.network->SetLeakRate(rate);
+			});
+	}
+	
+	template<typename Network>
+	void ShardedNetwork<Network>::SetLeakRates(const float* rates) {
+		ForEachShard([=](Shard& shard) {
+				if(rates == nullptr) {
+					shard.network->SetLeakRates(nullptr);
+					return;
+				}
+				std::vector<float> local(shard.globalOfLocal.size());
+				for(size_t l=0; l<local.size(); ++l)
+					local[l] = rates[shard.globalOfLocal[l]];
+				shard.network->SetLeakRates(local.data());
+			});
+	}
+	
+	template class ShardedNetwork<NeuralNetwork>;
+	template class ShardedNetwork<NeuralNetworkCPU>;
+}
+
@@ -0,0 +1,372 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/boltzmann/SharedNetworkImage.hpp"
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+
+namespace bn {
+	enum ImageArray {
+		PER_NEURON_STATIC = 0,
+		CONNECTIONS,
+		WEIGHTS,
+		BIAS,
+		PACKED_STATIC,
+		PACKED_EDGES,
+		LEAK_RATES,
+		ACTIVATION_GROUPS,
+		IMAGE_ARRAY_COUNT
+	};
+	
+	struct SharedNetworkImage::Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t neuronsCount;
+		uint32_t weightsCount;
+		uint32_t edgeLayout;
+		uint32_t activation;
+		float leakRate;
+		uint32_t fixedDegree;
+		uint32_t fixedDegreeFirstNeuron;
+		uint32_t padding;
+		// in bytes from beginning of segment, size 0 when array is absent
+		uint64_t offsets[IMAGE_ARRAY_COUNT];
+		uint64_t sizes[IMAGE_ARRAY_COUNT];
+	};
+	
+	static const uint32_t IMAGE_MAGIC = 0x4e4e4253; // "SBNN"
+	static const uint32_t IMAGE_VERSION = 2;
+	// arrays start on page boundaries
+	static const uint64_t IMAGE_ALIGNMENT = 4096;
+	
+	SharedNetworkImage::SharedNetworkImage() {
+		header = nullptr;
+		data = nullptr;
+		size = 0;
+		owner = false;
+	}
+	
+	SharedNetworkImage::~SharedNetworkImage() {
+		Close();
+	}
+	
+	int SharedNetworkImage::Create(const char* name,
+			const NeuralNetworkCPU& network) {
+		Close();
+		if(network.GetImage()) {
+			printf("Network attached to shared image cannot be shared"
+					" again\n");
+			return -1;
+		}
+		const void* arrays[IMAGE_ARRAY_COUNT] = {
+			network.perNeuronStatic.data(),
+			network.weightsStructure.data(),
+			network.weights.data(),
+			network.bias.data(),
+			network.packedStatic.data(),
+			network.packedEdges.data(),
+			network.leakRates.data(),
+			network.GetActivationGroups().data()
+		};
+		const bool packed = network.GetEdgeLayout() != EdgeLayout::SEPARATE;
+		Header h;
+		memset(&h, 0, sizeof(h));
+		h.magic = IMAGE_MAGIC;
+		h.version = IMAGE_VERSION;
+		h.neuronsCount = network.neuronsCount;
+		h.weightsCount = network.weightsCount;
+		h.edgeLayout = (uint32_t)network.GetEdgeLayout();
+		h.activation = (uint32_t)network.GetActivation();
+		h.leakRate = network.GetLeakRate();
+		h.fixedDegree = network.fixedDegree;
+		h.fixedDegreeFirstNeuron = network.fixedDegreeFirstNeuron;
+		h.sizes[PER_NEURON_STATIC] = network.perNeuronStatic.size()
+			* sizeof(PerNeuronStatic);
+		h.sizes[CONNECTIONS] = network.weightsStructure.size()*sizeof(uint32_t);
+		h.sizes[WEIGHTS] = network.weights.size()*sizeof(float);
+		h.sizes[BIAS] = network.bias.size()*sizeof(float);
+		h.sizes[PACKED_STATIC] = packed ? network.packedStatic.size()
+			* sizeof(PerNeuronStatic) : 0;
+		h.sizes[PACKED_EDGES] = packed ? network.packedEdges.size()
+			* sizeof(uint32_t) : 0;
+		h.sizes[LEAK_RATES] = network.leakRates.size()*sizeof(float);
+		h.sizes[ACTIVATION_GROUPS] = network.GetActivationGroups().size()
+			* sizeof(ActivationGroup);
+		uint64_t offset = IMAGE_ALIGNMENT;
+		for(int i=0; i<IMAGE_ARRAY_COUNT; ++i) {
+			h.offsets[i] = offset;
+			offset += (h.sizes[i] + IMAGE_ALIGNMENT-1)
+				/ IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+		}
+		
+		shm_unlink(name);
+		int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+		if(fd < 0) {
+			perror("shm_open");
+			return -1;
+		}
+		if(ftruncate(fd, offset) != 0) {
+			perror("ftruncate");
+			close(fd);
+			shm_unlink(name);
+			return -1;
+		}
+		void* mapping = mmap(nullptr, offset, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
+		close(fd);
+		if(mapping == MAP_FAILED) {
+			perror("mmap");
+			shm_unlink(name);
+			return -1;
+		}
+		for(int i=0; i<IMAGE_ARRAY_COUNT; ++i)
+			if(h.sizes[i])
+				memcpy((char*)mapping + h.offsets[i], arrays[i], h.sizes[i]);
+		// header last, segment is valid for Attach once magic is written
+		h.magic = 0;
+		memcpy(mapping, &h, sizeof(h));
+		__atomic_store_n((uint32_t*)mapping, IMAGE_MAGIC, __ATOMIC_RELEASE);
+		
+		header = (const Header*)mapping;
+		data = mapping;
+		size = offset;
+		this->name = name;
+		owner = true;
+		return 0;
+	}
+	
+	// Arrays have sizes implied by counts of header, every neuron's
+	// connections lie inside them and stored input indices are below
+	// neuron count, so kernels never read out of segment or states.
+	bool SharedNetworkImage::Validate(const Header* h, const void* mapping) {
+		const uint64_t neurons = h->neuronsCount;
+		const uint64_t weights = h->weightsCount;
+		const bool packed = h->edgeLayout != (uint32_t)EdgeLayout::SEPARATE;
+		if(h->edgeLayout > (uint32_t)EdgeLayout::INTERLEAVED_FP16
+				|| h->activation >= ACTIVATION_COUNT)
+			return false;
+		if(h->sizes[PER_NEURON_STATIC] != neurons*sizeof(PerNeuronStatic)
+				|| h->sizes[CONNECTIONS] != weights*sizeof(uint32_t)
+				|| h->sizes[WEIGHTS] != weights*sizeof(float)
+				|| h->sizes[BIAS] != neurons*sizeof(float)
+				|| h->sizes[PACKED_STATIC] != (packed ? neurons
+					* sizeof(PerNeuronStatic) : 0)
+				|| (!packed && h->sizes[PACKED_EDGES] != 0)
+				|| (h->sizes[LEAK_RATES] != 0
+					&& h->sizes[LEAK_RATES] != neurons*sizeof(float))
+				|| h->sizes[ACTIVATION_GROUPS] % sizeof(ActivationGroup))
+			return false;
+		
+		const char* base = (const char*)mapping;
+		const PerNeuronStatic* info = (const PerNeuronStatic*)(base
+				+ h->offsets[PER_NEURON_STATIC]);
+		const PerNeuronStatic* packedInfo = (const PerNeuronStatic*)(base
+				+ h->offsets[PACKED_STATIC]);
+		const uint32_t* connections = (const uint32_t*)(base
+				+ h->offsets[CONNECTIONS]);
+		const uint32_t* packedEdges = (const uint32_t*)(base
+				+ h->offsets[PACKED_EDGES]);
+		const uint64_t words = h->sizes[PACKED_EDGES] / sizeof(uint32_t);
+		// kernels gather states by stored indices
+		for(uint64_t i=0; i<weights; ++i)
+			if(connections[i] >= neurons)
+				return false;
+		for(uint64_t n=0; n<neurons; ++n) {
+			if((uint64_t)info[n].weights_start + info[n].weights_count
+					> weights)
+				return false;
+			if(!packed)
+				continue;
+			const uint64_t start = packedInfo[n].weights_start;
+			const uint64_t count = packedInfo[n].weights_count;
+			if(count == 0)
+				continue;
+			if(h->edgeLayout == (uint32_t)EdgeLayout::INTERLEAVED_FP32) {
+				// {index, weight bits} per connection
+				if((start+count)*2 > words)
+					return false;
+				for(uint64_t i=start; i<start+count; ++i)
+					if(packedEdges[i*2] >= neurons)
+						return false;
+			} else {
+				// {index0, index1, half2 weights} per two connections
+				const uint64_t first = start/2;
+				const uint64_t end = first + (count+1)/2;
+				if(end*3 > words)
+					return false;
+				for(uint64_t p=first; p<end; ++p)
+					if(packedEdges[p*3] >= neurons
+							|| packedEdges[p*3+1] >= neurons)
+						return false;
+			}
+		}
+		
+		uint32_t firstNeuron = 0;
+		const uint32_t degree = DetectFixedDegree(info, neurons, firstNeuron);
+		if(h->fixedDegree && (h->fixedDegree != degree
+					|| h->fixedDegreeFirstNeuron != firstNeuron))
+			return false;
+		
+		const ActivationGroup* groups = (const ActivationGroup*)(base
+				+ h->offsets[ACTIVATION_GROUPS]);
+		for(uint64_t i=0; i<h->sizes[ACTIVATION_GROUPS]
+				/ sizeof(ActivationGroup); ++i)
+			if(groups[i].begin > groups[i].end || groups[i].end > neurons
+					|| (uint32_t)groups[i].activation >= ACTIVATION_COUNT)
+				return false;
+		return true;
+	}
+	
+	int SharedNetworkImage::Attach(const char* name) {
+		Close();
+		int fd = shm_open(name, O_RDONLY, 0);
+		if(fd < 0) {
+			perror("shm_open");
+			return -1;
+		}
+		struct stat st;
+		if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+			printf("Shared memory %s is not a network image\n", name);
+			close(fd);
+			return -1;
+		}
+		void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd,
+				0);
+		close(fd);
+		if(mapping == MAP_FAILED) {
+			perror("mmap");
+			return -1;
+		}
+		const Header* h = (const Header*)mapping;
+		bool valid = __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE)
+			== IMAGE_MAGIC && h->version == IMAGE_VERSION;
+		for(int i=0; valid && i<IMAGE_ARRAY_COUNT; ++i)
+			valid = h->offsets[i] <= (uint64_t)st.st_size
+				&& h->sizes[i] <= (uint64_t)st.st_size - h->offsets[i];
+		if(valid && !Validate(h, mapping)) {
+			printf("Shared memory %s holds inconsistent network image\n",
+					name);
+			munmap(mapping, st.st_size);
+			return -1;
+		}
+		if(!valid) {
+			printf("Shared memory %s is not a network image\n", name);
+			munmap(mapping, st.st_size);
+			return -1;
+		}
+		header = h;
+		data = mapping;
+		size = st.st_size;
+		this->name = name;
+		owner = false;
+		return 0;
+	}
+	
+	void SharedNetworkImage::Close() {
+		if(data == nullptr)
+			return;
+		munmap(data, size);
+		if(owner)
+			shm_unlink(name.c_str());
+		header = nullptr;
+		data = nullptr;
+		size = 0;
+		name.clear();
+		owner = false;
+	}
+	
+	template<typename T>
+	const T* SharedNetworkImage::Array(int index) const {
+		if(header->sizes[index] == 0)
+			return nullptr;
+		return (const T*)((const char*)data + header->offsets[index]);
+	}
+	
+	uint32_t SharedNetworkImage::GetNeuronsCount() const {
+		return header->neuronsCount;
+	}
+	
+	uint32_t SharedNetworkImage::GetWeightsCount() const {
+		return header->weightsCount;
+	}
+	
+	EdgeLayout SharedNetworkImage::GetEdgeLayout() const {
+		return (EdgeLayout)header->edgeLayout;
+	}
+	
+	Activation SharedNetworkImage::GetActivation() const {
+		return (Activation)header->activation;
+	}
+	
+	float SharedNetworkImage::GetLeakRate() const {
+		return header->leakRate;
+	}
+	
+	uint32_t SharedNetworkImage::GetFixedDegree() const {
+		return header->fixedDegree;
+	}
+	
+	uint32_t SharedNetworkImage::GetFixedDegreeFirstNeuron() const {
+		return header->fixedDegreeFirstNeuron;
+	}
+	
+	const PerNeuronStatic* SharedNetworkImage::GetPerNeuronStatic() const {
+		return Array<PerNeuronStatic>(PER_NEURON_STATIC);
+	}
+	
+	const uint32_t* SharedNetworkImage::GetConnections() const {
+		return Array<uint32_t>(CONNECTIONS);
+	}
+	
+	const float* SharedNetworkImage::GetWeights() const {
+		return Array<float>(WEIGHTS);
+	}
+	
+	const float* SharedNetworkImage::GetBias() const {
+		return Array<float>(BIAS);
+	}
+	
+	const PerNeuronStatic* SharedNetworkImage::GetPackedStatic() const {
+		return Array<PerNeuronStatic>(PACKED_STATIC);
+	}
+	
+	const uint32_t* SharedNetworkImage::GetPackedEdges() const {
+		return Array<uint32_t>(PACKED_EDGES);
+	}
+	
+	const float* SharedNetworkImage::GetLeakRates() const {
+		return Array<float>(LEAK_RATES);
+	}
+	
+	std::vector<ActivationGroup> SharedNetworkImage::GetActivationGroups()
+			const {
+		const ActivationGroup* groups =
+			Array<ActivationGroup>(ACTIVATION_GROUPS);
+		return std::vector<ActivationGroup>(groups, groups ? groups
+				+ header->sizes[ACTIVATION_GROUPS]/sizeof(ActivationGroup)
+				: nullptr);
+	}
+}
+
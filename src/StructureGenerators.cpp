@@ -0,0 +1,99 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <random>
+
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+namespace bn {
+	// count distinct values from range [begin, end) excluding `self`
+	static void SampleDistinct(std::vector<uint32_t>& out, uint32_t count,
+			uint32_t begin, uint32_t end, uint32_t self, std::mt19937_64& gen) {
+		out.clear();
+		uint32_t available = end - begin - (self >= begin && self < end);
+		count = std::min(count, available);
+		if(count*2 > available) {
+			for(uint32_t i=begin; i<end; ++i)
+				if(i != self)
+					out.emplace_back(i);
+			std::shuffle(out.begin(), out.end(), gen);
+			out.resize(count);
+			std::sort(out.begin(), out.end());
+		} else {
+			std::uniform_int_distribution<uint32_t> dist(begin, end-1);
+			while(out.size() < count) {
+				for(uint32_t i=out.size(); i<count;) {
+					uint32_t v = dist(gen);
+					if(v != self) {
+						out.emplace_back(v);
+						++i;
+					}
+				}
+				std::sort(out.begin(), out.end());
+				out.erase(std::unique(out.begin(), out.end()), out.end());
+			}
+		}
+	}
+	
+	void GenerateUniformStructure(std::vector<std::vector<uint32_t>>& structure,
+			uint32_t neurons, uint32_t fanIn, uint32_t inputNeurons,
+			uint64_t seed) {
+		std::mt19937_64 gen(seed);
+		structure.clear();
+		structure.resize(neurons);
+		for(uint32_t i=inputNeurons; i<neurons; ++i)
+			SampleDistinct(structure[i], fanIn, 0, neurons, i, gen);
+	}
+	
+	void GeneratePowerLawStructure(
+			std::vector<std::vector<uint32_t>>& structure, uint32_t neurons,
+			uint32_t meanFanIn, float exponent, uint32_t inputNeurons,
+			uint64_t seed) {
+		std::mt19937_64 gen(seed);
+		structure.clear();
+		structure.resize(neurons);
+		exponent = std::max(exponent, 1.05f);
+		// Pareto with minimum xm has mean xm*alpha/(alpha-1)
+		const double xm = std::max(1.0, meanFanIn*(exponent-1.0)/exponent);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		for(uint32_t i=inputNeurons; i<neurons; ++i) {
+			double degree = xm / std::pow(1.0-uniform(gen), 1.0/exponent);
+			uint32_t fanIn = std::min<double>(degree, neurons-1);
+			SampleDistinct(structure[i], fanIn, 0, neurons, i, gen);
+		}
+	}
+	
+	void GenerateClusteredStructure(
+			std::vector<std::vector<uint32_t>>& structure, uint32_t neurons,
+			uint32_t fanIn, uint32_t radius, uint32_t inputNeurons,
+			uint64_t seed) {
+		std::mt19937_64 gen(seed);
+		structure.clear();
+		structure.resize(neurons);
+		radius = std::max(radius, (fanIn+1)/2);
+		for(uint32_t i=inputNeurons; i<neurons; ++i) {
+			uint32_t begin = i > radius ? i-radius : 0;
+			uint32_t end = std::min<uint64_t>((uint64_t)i+radius+1, neurons);
+			SampleDistinct(structure[i], fanIn, begin, end, i, gen);
+		}
+	}
+}
+
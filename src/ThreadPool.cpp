@@ -0,0 +1,215 @@
+/*
+ *  This file is part of BoltzmannNN
+ *  Copyright (C) 2023 Marek Zalewski aka Drwalin
+ *
+ *  BoltzmannNN is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  BoltzmannNN is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "../include/boltzmann/ThreadPool.hpp"
+
+namespace bn {
+	static inline uint64_t PackRange(uint32_t begin, uint32_t end) {
+		return ((uint64_t)begin << 32) | end;
+	}
+	
+	// parses list like "0-3,8,10-11"
+	static std::vector<int> ParseList(const char* text) {
+		std::vector<int> cpus;
+		while(*text) {
+			char* next;
+			long first = strtol(text, &next, 10);
+			if(next == text)
+				break;
+			long last = first;
+			if(*next == '-')
+				last = strtol(next+1, &next, 10);
+			for(long c=first; c<=last; ++c)
+				cpus.emplace_back(c);
+			text = *next == ',' ? next+1 : next;
+		}
+		return cpus;
+	}
+	
+	static bool ReadLine(const char* path, char* text, size_t size) {
+		FILE* file = fopen(path, "r");
+		if(file == nullptr)
+			return false;
+		bool read = fgets(text, size, file) != nullptr;
+		fclose(file);
+		return read;
+	}
+	
+	std::vector<std::vector<int>> ThreadPool::NumaTopology() {
+		std::vector<std::vector<int>> nodes;
+		char text[4096];
+		if(ReadLine("/sys/devices/system/node/online", text, sizeof(text))) {
+			// nodes without CPUs are kept so that indices match node ids
+			for(int node : ParseList(text)) {
+				char path[128];
+				snprintf(path, sizeof(path),
+						"/sys/devices/system/node/node%d/cpulist", node);
+				nodes.resize(node+1);
+				if(ReadLine(path, text, sizeof(text)))
+					nodes[node] = ParseList(text);
+			}
+		}
+		bool any = false;
+		for(auto& n : nodes)
+			any |= !n.empty();
+		if(!any) {
+			nodes.assign(1, {});
+			for(uint32_t c=0; c<std::thread::hardware_concurrency(); ++c)
+				nodes[0].emplace_back(c);
+		}
+		return nodes;
+	}
+	
+	ThreadPool::ThreadPool(uint32_t threads, bool pin) {
+		std::vector<std::vector<int>> nodes = NumaTopology();
+		std::vector<std::pair<int, uint32_t>> cpus;
+		for(uint32_t n=0; n<nodes.size(); ++n)
+			for(int cpu : nodes[n])
+				cpus.emplace_back(cpu, n);
+		nodesCount = nodes.size();
+		if(threads == 0)
+			threads = std::max<size_t>(cpus.size(), 1);
+		threadsCount = threads;
+		generation = 0;
+		running = 0;
+		stop = false;
+		task = nullptr;
+		steal = true;
+		stolen = 0;
+		
+		workers.reset(new Worker[threadsCount]);
+		for(uint32_t i=0; i<threadsCount; ++i) {
+			workers[i].range = PackRange(0, 0);
+			if(pin && !cpus.empty()) {
+				// consecutive threads fill one node before next
+				workers[i].cpu = cpus[i % cpus.size()].first;
+				workers[i].node = cpus[i % cpus.size()].second;
+			}
+		}
+		for(uint32_t i=0; i<threadsCount; ++i)
+			workers[i].thread = std::thread(&ThreadPool::WorkerLoop, this, i);
+	}
+	
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for(uint32_t i=0; i<threadsCount; ++i)
+			workers[i].thread.join();
+	}
+	
+	void ThreadPool::Run(uint32_t tasks, const Task& f, bool steal) {
+		if(tasks == 0)
+			return;
+		std::unique_lock<std::mutex> lock(mutex);
+		for(uint32_t i=0; i<threadsCount; ++i)
+			workers[i].range.store(PackRange(
+						HomeBegin(tasks, threadsCount, i),
+						HomeBegin(tasks, threadsCount, i+1)),
+					std::memory_order_relaxed);
+		task = &f;
+		this->steal = steal;
+		running = threadsCount;
+		++generation;
+		wake.notify_all();
+		done.wait(lock, [this]() { return running == 0; });
+		task = nullptr;
+	}
+	
+	bool ThreadPool::Pop(uint32_t index, uint32_t& task) {
+		std::atomic<uint64_t>& range = workers[index].range;
+		uint64_t r = range.load(std::memory_order_acquire);
+		for(;;) {
+			const uint32_t begin = r >> 32, end = r;
+			if(begin >= end)
+				return false;
+			if(range.compare_exchange_weak(r, PackRange(begin+1, end),
+						std::memory_order_acq_rel)) {
+				task = begin;
+				return true;
+			}
+		}
+	}
+	
+	bool ThreadPool::Steal(uint32_t index, uint32_t& task) {
+		for(uint32_t i=1; i<threadsCount; ++i) {
+			std::atomic<uint64_t>& victim =
+				workers[(index+i) % threadsCount].range;
+			uint64_t r = victim.load(std::memory_order_acquire);
+			for(;;) {
+				const uint32_t begin = r >> 32, end = r;
+				if(begin >= end)
+					break;
+				const uint32_t count = (end - begin + 1) / 2;
+				if(victim.compare_exchange_weak(r, PackRange(begin,
+								end-count), std::memory_order_acq_rel)) {
+					// own range is empty, other thieves only read it
+					workers[index].range.store(PackRange(end-count+1, end),
+							std::memory_order_release);
+					stolen.fetch_add(count, std::memory_order_relaxed);
+					task = end-count;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+	
+	void ThreadPool::WorkerLoop(uint32_t index) {
+		if(workers[index].cpu >= 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(workers[index].cpu, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		}
+		uint64_t seen = 0;
+		for(;;) {
+			const Task* f;
+			bool allowSteal;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stop || generation != seen; });
+				if(stop)
+					return;
+				seen = generation;
+				f = task;
+				allowSteal = steal;
+			}
+			uint32_t t;
+			for(;;) {
+				while(Pop(index, t))
+					(*f)(t, index);
+				if(!allowSteal || !Steal(index, t))
+					break;
+				(*f)(t, index);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			if(--running == 0)
+				done.notify_one();
+		}
+	}
+}
+
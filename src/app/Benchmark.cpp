@@ -0,0 +1,359 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+#include "../include/boltzmann/NeuralNetwork.hpp"
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/HostAllocator.hpp"
+#include "../include/boltzmann/ThreadPool.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+#include "../include/boltzmann/Autotuner.hpp"
+
+#include "BenchmarkCommon.hpp"
+
+static void PrintUsage(const char* name) {
+	printf("Usage: %s [options]\n"
+		"  --backend gpu,cpu            backends to measure\n"
+		"  --neurons 65536,1048576      neuron counts\n"
+		"  --fanin 16,128               mean inputs per neuron\n"
+		"  --distribution uniform,powerlaw,clustered\n"
+		"  --layout separate            separate, fp32 or fp16 edge layout\n"
+		"  --activation tanh            tanh, tanh_pade, tanh_polynomial,\n"
+		"                               sigmoid, relu, hard_tanh or\n"
+		"                               logistic_sampling\n"
+		"  --leak 1                     leak rates, 1 = overwrite state\n"
+		"  --batch 0                    neurons per dispatch, 0 = all\n"
+		"  --steps 16                   steps per repetition\n"
+		"  --warmup 2                   untimed repetitions\n"
+		"  --repetitions 10             timed repetitions\n"
+		"  --inputs 64                  input-only neurons\n"
+		"  --exponent 2.5               power-law exponent\n"
+		"  --radius 4096                clustered window radius\n"
+		"  --seed 1                     structure seed\n"
+		"  --autotune                   tune GPU kernel before measuring\n"
+		"  --autotune-cache FILE        keep tuned configs in FILE, env\n"
+		"                               BOLTZMANN_AUTOTUNE_CACHE\n"
+		"  --shader-cache DIR           cache program binaries in DIR, env\n"
+		"                               BOLTZMANN_SHADER_CACHE; warm cache\n"
+		"                               shortens first run\n"
+		"  --threads 1                  CPU backend threads, 0 = every CPU\n"
+		"  --prefetch 0                 CPU prefetch distances in\n"
+		"                               connections, auto = tuned\n"
+		"  --tile 0                     CPU tiles of source neurons, 0 =\n"
+		"                               untiled\n"
+		"  --tile-block 16384           neurons of CPU tiled block\n"
+		"  --pages small                small, transparent, 2m or 1g pages\n"
+		"                               of CPU backend arrays\n"
+		"  --perf                       count dTLB load misses of CPU\n"
+		"                               backend with perf events\n"
+		"  --egl                        surfaceless EGL context, no window\n"
+		"                               system needed\n"
+		"  --format csv|json            output format\n"
+		"  --output FILE                output file, default stdout\n",
+		name);
+}
+
+static bool ParseLayout(const std::string& name, bn::EdgeLayout& layout) {
+	if(name == "separate")
+		layout = bn::EdgeLayout::SEPARATE;
+	else if(name == "fp32")
+		layout = bn::EdgeLayout::INTERLEAVED_FP32;
+	else if(name == "fp16")
+		layout = bn::EdgeLayout::INTERLEAVED_FP16;
+	else
+		return false;
+	return true;
+}
+
+static void Synchronize(bn::NeuralNetwork&) {
+	glFinish();
+}
+
+static void Synchronize(bn::NeuralNetworkCPU&) {
+}
+
+template<typename Network>
+static void RunSteps(Network& nn, uint32_t steps, uint32_t batch) {
+	const uint32_t neurons = nn.neuronsCount;
+	if(batch == 0)
+		batch = neurons;
+	for(uint32_t s=0; s<steps; ++s) {
+		for(uint32_t i=0; i<neurons; i+=batch)
+			nn.PerformCalculation(i, std::min(batch, neurons-i));
+		nn.SwapStates();
+	}
+	Synchronize(nn);
+}
+
+template<typename Network>
+static std::vector<double> Measure(Network& nn, uint32_t steps,
+		uint32_t batch, uint32_t warmup, uint32_t repetitions,
+		bench::PerfCounter* counter, uint64_t& events) {
+	for(uint32_t i=0; i<warmup; ++i)
+		RunSteps(nn, steps, batch);
+	std::vector<double> seconds;
+	if(counter)
+		counter->Start();
+	for(uint32_t i=0; i<repetitions; ++i)
+		seconds.emplace_back(bench::MeasureSeconds([&](){
+					RunSteps(nn, steps, batch);
+				}));
+	events = counter ? counter->Stop() : 0;
+	return seconds;
+}
+
+int main(int argc, char** argv) {
+	bench::Arguments args(argc, argv);
+	if(args.Has("--help") || args.Has("-h")) {
+		PrintUsage(argv[0]);
+		return 0;
+	}
+	
+	const std::vector<std::string> backends = args.GetNames("--backend",
+			"gpu,cpu");
+	const std::vector<uint32_t> neuronsList = args.GetList("--neurons",
+			"65536,1048576");
+	const std::vector<uint32_t> fanInList = args.GetList("--fanin", "16,128");
+	const std::vector<std::string> distributions =
+		args.GetNames("--distribution", "uniform,powerlaw,clustered");
+	const std::vector<std::string> layouts = args.GetNames("--layout",
+			"separate");
+	const std::vector<std::string> activations =
+		args.GetNames("--activation", "tanh");
+	const std::vector<std::string> leakList = args.GetNames("--leak", "1");
+	const std::vector<uint32_t> batchList = args.GetList("--batch", "0");
+	const std::vector<uint32_t> stepsList = args.GetList("--steps", "16");
+	const uint32_t warmup = args.GetUInt("--warmup", 2);
+	const uint32_t repetitions = std::max(1u,
+			args.GetUInt("--repetitions", 10));
+	const uint32_t inputs = args.GetUInt("--inputs", 64);
+	const float exponent = args.GetDouble("--exponent", 2.5);
+	const uint32_t radius = args.GetUInt("--radius", 4096);
+	const uint64_t seed = args.GetUInt("--seed", 1);
+	const bool autotune = args.Has("--autotune");
+	// nothing is written to disk unless asked
+	const char* autotuneCache = args.Get("--autotune-cache",
+			getenv("BOLTZMANN_AUTOTUNE_CACHE"));
+	const char* shaderCache = args.Get("--shader-cache",
+			getenv("BOLTZMANN_SHADER_CACHE"));
+	const uint32_t threads = args.GetUInt("--threads", 1);
+	std::unique_ptr<bn::ThreadPool> pool;
+	if(threads != 1)
+		pool.reset(new bn::ThreadPool(threads));
+	const std::vector<std::string> pagesList = args.GetNames("--pages",
+			"small");
+	const std::vector<std::string> prefetchList =
+		args.GetNames("--prefetch", "0");
+	const std::vector<uint32_t> tileList = args.GetList("--tile", "0");
+	const uint32_t tileBlock = args.GetUInt("--tile-block", 16384);
+	// opened after pool, counts its threads too
+	std::unique_ptr<bench::PerfCounter> tlbMisses;
+	if(args.Has("--perf")) {
+		tlbMisses.reset(new bench::PerfCounter(
+					bench::PerfCounter::DtlbLoadMisses()));
+		if(!tlbMisses->Valid()) {
+			fprintf(stderr, "dTLB load misses cannot be counted\n");
+			tlbMisses.reset();
+		}
+	}
+	
+	bool useGpu = false;
+	for(const std::string& b : backends)
+		useGpu |= b == "gpu";
+	if(useGpu) {
+		if(args.Has("--egl"))
+			gl::openGL.InitHeadlessEGL();
+		else
+			gl::openGL.InitHeadless();
+		if(shaderCache && shaderCache[0])
+			gl::Shader::SetProgramBinaryCacheDirectory(shaderCache);
+	}
+	
+	{
+		bench::ResultWriter writer(args.Get("--format", "csv"),
+				args.Get("--output", nullptr));
+		
+		std::vector<std::vector<uint32_t>> structure;
+		for(const std::string& distribution : distributions) {
+			for(uint32_t neurons : neuronsList) {
+				for(uint32_t fanIn : fanInList) {
+					if(distribution == "uniform") {
+						bn::GenerateUniformStructure(structure, neurons, fanIn,
+								inputs, seed);
+					} else if(distribution == "powerlaw") {
+						bn::GeneratePowerLawStructure(structure, neurons,
+								fanIn, exponent, inputs, seed);
+					} else if(distribution == "clustered") {
+						bn::GenerateClusteredStructure(structure, neurons,
+								fanIn, radius, inputs, seed);
+					} else {
+						fprintf(stderr, "Unknown distribution: %s\n",
+								distribution.c_str());
+						continue;
+					}
+					uint64_t edges = 0;
+					for(const auto& s : structure)
+						edges += s.size();
+					
+					for(const std::string& backend : backends)
+					for(const std::string& layoutName : layouts)
+					for(const std::string& pagesName : pagesList)
+					for(const std::string& prefetch : prefetchList)
+					for(uint32_t tile : tileList) {
+						bn::EdgeLayout layout;
+						if(!ParseLayout(layoutName, layout)) {
+							fprintf(stderr, "Unknown layout: %s\n",
+									layoutName.c_str());
+							continue;
+						}
+						const uint64_t bytes = bench::StepTrafficBytes(neurons,
+								edges, layout);
+						bn::HostPages pages;
+						if(!bn::HostPagesFromName(pagesName, pages)) {
+							fprintf(stderr, "Unknown pages: %s\n",
+									pagesName.c_str());
+							continue;
+						}
+						bn::NeuralNetwork* gpu = nullptr;
+						bn::NeuralNetworkCPU* cpu = nullptr;
+						std::string config = "default";
+						std::string backed = "-";
+						if(backend == "gpu") {
+							// host arrays of GPU backend are not gathered
+							if(pagesName != pagesList.front()
+									|| prefetch != prefetchList.front()
+									|| tile != tileList.front())
+								continue;
+							gpu = new bn::NeuralNetwork(layout);
+							gpu->InitEmptyNetwork(structure);
+							if(autotune) {
+								bn::Autotuner tuner(autotuneCache
+										? autotuneCache : "");
+								config = bn::Autotuner::ToString(
+										tuner.Tune(*gpu));
+							} else {
+								config = bn::Autotuner::ToString(
+										gpu->GetKernelConfig());
+							}
+						} else if(backend == "cpu") {
+							bn::SetHostPages(pages);
+							cpu = new bn::NeuralNetworkCPU(layout);
+							cpu->SetThreadPool(pool.get());
+							cpu->InitEmptyNetwork(structure);
+							if(cpu->SetTiling(tile, tileBlock)) {
+								bn::SetHostPages(bn::HostPages::SMALL);
+								delete cpu;
+								continue;
+							}
+							bn::SetHostPages(bn::HostPages::SMALL);
+							const bn::cpu::NetworkView view = cpu->GetView();
+							backed = bn::HostPagesName(bn::HostPagesOf(
+										layout == bn::EdgeLayout::SEPARATE
+										? (const void*)view.connections
+										: (const void*)view.packedEdges));
+							if(prefetch == "auto")
+								cpu->TunePrefetchDistance();
+							else
+								cpu->SetPrefetchDistance(atoi(
+											prefetch.c_str()));
+							config = "threads=" + std::to_string(pool ?
+									pool->GetThreadCount() : 1)
+								+ " prefetch=" + std::to_string(
+										cpu->GetPrefetchDistance())
+								+ " tile=" + std::to_string(tile);
+						} else {
+							fprintf(stderr, "Unknown backend: %s\n",
+									backend.c_str());
+							continue;
+						}
+						
+						for(const std::string& activationName : activations)
+						for(const std::string& leak : leakList)
+						for(uint32_t batch : batchList) {
+							bn::Activation activation;
+							if(!bn::ActivationFromName(activationName,
+										activation)) {
+								fprintf(stderr, "Unknown activation: %s\n",
+										activationName.c_str());
+								continue;
+							}
+							const float leakRate = atof(leak.c_str());
+							if(gpu) {
+								gpu->SetActivation(activation);
+								gpu->SetLeakRate(leakRate);
+							} else {
+								cpu->SetActivation(activation);
+								cpu->SetLeakRate(leakRate);
+							}
+							for(uint32_t steps : stepsList) {
+								uint64_t misses = 0;
+								std::vector<double> seconds = gpu
+									? Measure(*gpu, steps, batch, warmup,
+											repetitions, nullptr, misses)
+									: Measure(*cpu, steps, batch, warmup,
+											repetitions, tlbMisses.get(),
+											misses);
+								const bool counted = cpu && tlbMisses;
+								const double stepsCounted =
+									(double)steps*repetitions;
+								for(double& s : seconds)
+									s /= steps;
+								bench::Statistics st =
+									bench::Summarize(seconds);
+								
+								writer.Write({
+									{"backend", backend},
+									{"distribution", distribution},
+									{"layout", layoutName},
+									{"activation", activationName},
+									{"leak", leak},
+									{"neurons", std::to_string(neurons)},
+									{"fanin", std::to_string(fanIn)},
+									{"edges", std::to_string(edges)},
+									{"batch", std::to_string(batch)},
+									{"steps", std::to_string(steps)},
+									{"repetitions",
+										std::to_string(repetitions)},
+									{"config", config},
+									{"pages", gpu ? "-" : pagesName},
+									{"backed", backed},
+									{"step_ms_mean",
+										bench::Format(st.mean*1e3)},
+									{"step_ms_ci95",
+										bench::Format(st.ci95*1e3)},
+									{"step_ms_min",
+										bench::Format(st.min*1e3)},
+									{"ns_per_neuron",
+										bench::Format(st.mean*1e9/neurons)},
+									{"edges_per_s",
+										bench::Format(edges/st.mean)},
+									{"gb_per_s",
+										bench::Format(bytes/st.mean*1e-9)},
+									{"dtlb_misses_per_step", counted
+										? bench::Format(misses/stepsCounted)
+										: "-"},
+									{"dtlb_misses_per_edge", counted
+										? bench::Format(misses/stepsCounted
+												/edges)
+										: "-"}
+								});
+							}
+						}
+						delete gpu;
+						delete cpu;
+					}
+				}
+			}
+		}
+	}
+	
+	if(useGpu)
+		gl::openGL.Destroy();
+	return 0;
+}
+
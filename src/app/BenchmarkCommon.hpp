@@ -0,0 +1,309 @@
+#ifndef BOLTZMANNNN_BENCHMARK_COMMON_HPP
+#define BOLTZMANNNN_BENCHMARK_COMMON_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "../include/boltzmann/NetworkStructure.hpp"
+
+/*
+ * Helpers shared by benchmark and calibration apps: argument parsing,
+ * repetition statistics and machine readable output.
+ */
+namespace bench {
+	struct Statistics {
+		uint32_t samples;
+		double mean;
+		double stddev;
+		double min;
+		// half width of 95% confidence interval of mean
+		double ci95;
+	};
+	
+	inline double StudentT95(uint32_t degreesOfFreedom) {
+		static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571,
+			2.447, 2.365, 2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145,
+			2.131, 2.120, 2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069,
+			2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+		if(degreesOfFreedom == 0)
+			return INFINITY;
+		if(degreesOfFreedom <= 30)
+			return table[degreesOfFreedom-1];
+		return 1.96;
+	}
+	
+	inline Statistics Summarize(const std::vector<double>& values) {
+		Statistics s{(uint32_t)values.size(), 0, 0, INFINITY, 0};
+		for(double v : values) {
+			s.mean += v;
+			s.min = std::min(s.min, v);
+		}
+		if(values.empty())
+			return s;
+		s.mean /= values.size();
+		for(double v : values)
+			s.stddev += (v-s.mean)*(v-s.mean);
+		if(values.size() > 1) {
+			s.stddev = std::sqrt(s.stddev/(values.size()-1));
+			s.ci95 = StudentT95(values.size()-1)*s.stddev
+				/ std::sqrt((double)values.size());
+		} else {
+			s.stddev = 0;
+		}
+		return s;
+	}
+	
+	// Bytes touched by one full step: per edge stored connection and
+	// gathered state, per neuron structure info, bias and written state.
+	// Connection is 4 byte index with fp32 weight, or with fp16 weight in
+	// INTERLEAVED_FP16 (padding of odd degrees not counted).
+	inline uint64_t StepTrafficBytes(uint64_t neurons, uint64_t edges,
+			bn::EdgeLayout layout) {
+		const uint64_t connection = layout == bn::EdgeLayout::INTERLEAVED_FP16
+			? 4+2 : 4+4;
+		return edges*(connection+4) + neurons*(8+4+4);
+	}
+	
+	template<typename F>
+	inline double MeasureSeconds(F&& f) {
+		auto t1 = std::chrono::steady_clock::now();
+		f();
+		auto t2 = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(t2-t1).count();
+	}
+	
+	class Arguments {
+	public:
+		
+		Arguments(int argc, char** argv) : argc(argc), argv(argv) {}
+		
+		const char* Get(const char* name, const char* def) const {
+			for(int i=1; i+1<argc; ++i)
+				if(!strcmp(argv[i], name))
+					return argv[i+1];
+			return def;
+		}
+		
+		bool Has(const char* name) const {
+			for(int i=1; i<argc; ++i)
+				if(!strcmp(argv[i], name))
+					return true;
+			return false;
+		}
+		
+		uint32_t GetUInt(const char* name, uint32_t def) const {
+			const char* v = Get(name, nullptr);
+			return v ? strtoul(v, nullptr, 0) : def;
+		}
+		
+		double GetDouble(const char* name, double def) const {
+			const char* v = Get(name, nullptr);
+			return v ? atof(v) : def;
+		}
+		
+		std::vector<std::string> GetNames(const char* name,
+				const char* def) const {
+			std::vector<std::string> names;
+			std::string all = Get(name, def);
+			size_t begin = 0;
+			while(begin <= all.size()) {
+				size_t end = all.find(',', begin);
+				if(end == std::string::npos)
+					end = all.size();
+				if(end > begin)
+					names.emplace_back(all.substr(begin, end-begin));
+				begin = end+1;
+			}
+			return names;
+		}
+		
+		std::vector<uint32_t> GetList(const char* name, const char* def) const {
+			std::vector<uint32_t> values;
+			for(const std::string& v : GetNames(name, def))
+				values.emplace_back(strtoul(v.c_str(), nullptr, 0));
+			return values;
+		}
+		
+	private:
+		
+		int argc;
+		char** argv;
+	};
+	
+	/*
+	 * Writes one record per result as CSV (header from first record) or as
+	 * JSON lines.
+	 */
+	class ResultWriter {
+	public:
+		
+		using Record = std::vector<std::pair<std::string, std::string>>;
+		
+		ResultWriter(const std::string& format, const char* path) :
+			json(format == "json"), headerWritten(false) {
+			file = path ? fopen(path, "w") : stdout;
+			if(file == nullptr) {
+				fprintf(stderr, "Cannot open %s, writing to stdout\n", path);
+				file = stdout;
+			}
+		}
+		
+		~ResultWriter() {
+			if(file != stdout)
+				fclose(file);
+		}
+		
+		void Write(const Record& record) {
+			if(json) {
+				fprintf(file, "{");
+				for(size_t i=0; i<record.size(); ++i) {
+					const std::string& v = record[i].second;
+					bool number = !v.empty() && strspn(v.c_str(),
+							"0123456789.-+eE") == v.size();
+					fprintf(file, number ? "%s\"%s\":%s" : "%s\"%s\":\"%s\"",
+							i ? "," : "", record[i].first.c_str(), v.c_str());
+				}
+				fprintf(file, "}\n");
+			} else {
+				if(!headerWritten) {
+					for(size_t i=0; i<record.size(); ++i)
+						fprintf(file, "%s%s", i ? "," : "",
+								record[i].first.c_str());
+					fprintf(file, "\n");
+					headerWritten = true;
+				}
+				for(size_t i=0; i<record.size(); ++i)
+					fprintf(file, "%s%s", i ? "," : "",
+							record[i].second.c_str());
+				fprintf(file, "\n");
+			}
+			fflush(file);
+		}
+		
+	private:
+		
+		FILE* file;
+		bool json;
+		bool headerWritten;
+	};
+	
+	/*
+	 * Hardware event counted in user space of every thread of process.
+	 * Counters are opened for threads alive at construction, so thread
+	 * pool has to exist before. Not valid when kernel does not allow
+	 * counting (perf_event_paranoid, containers) or lacks the event.
+	 */
+	class PerfCounter {
+	public:
+		
+		PerfCounter(uint32_t type, uint64_t config) {
+#ifdef __linux__
+			DIR* dir = opendir("/proc/self/task");
+			if(dir == nullptr)
+				return;
+			while(struct dirent* entry = readdir(dir)) {
+				if(entry->d_name[0] == '.')
+					continue;
+				struct perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = type;
+				attr.config = config;
+				attr.disabled = 1;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				int fd = syscall(SYS_perf_event_open, &attr,
+						atoi(entry->d_name), -1, -1, 0);
+				if(fd < 0) {
+					Close();
+					break;
+				}
+				fds.emplace_back(fd);
+			}
+			closedir(dir);
+#endif
+		}
+		
+		~PerfCounter() {
+			Close();
+		}
+		
+		// data TLB misses of loads
+		static PerfCounter DtlbLoadMisses() {
+#ifdef __linux__
+			return PerfCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+					| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+					| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+			return PerfCounter(0, 0);
+#endif
+		}
+		
+		PerfCounter(PerfCounter&& other) : fds(std::move(other.fds)) {
+			other.fds.clear();
+		}
+		PerfCounter(const PerfCounter&) = delete;
+		PerfCounter& operator=(const PerfCounter&) = delete;
+		
+		inline bool Valid() const { return !fds.empty(); }
+		
+		void Start() {
+#ifdef __linux__
+			for(int fd : fds) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+#endif
+		}
+		
+		// Returns sum over threads since Start.
+		uint64_t Stop() {
+			uint64_t sum = 0;
+#ifdef __linux__
+			for(int fd : fds) {
+				ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+				uint64_t value = 0;
+				if(read(fd, &value, sizeof(value)) == sizeof(value))
+					sum += value;
+			}
+#endif
+			return sum;
+		}
+		
+	private:
+		
+		void Close() {
+#ifdef __linux__
+			for(int fd : fds)
+				close(fd);
+#endif
+			fds.clear();
+		}
+		
+		std::vector<int> fds;
+	};
+	
+	inline std::string Format(double value, const char* format = "%.6g") {
+		char buf[64];
+		snprintf(buf, sizeof(buf), format, value);
+		return buf;
+	}
+}
+
+#endif
+
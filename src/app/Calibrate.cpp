@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <string>
+#include <vector>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+#include "../include/boltzmann/NeuralNetwork.hpp"
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+#include "../include/boltzmann/BandwidthCalibration.hpp"
+#include "../include/boltzmann/Autotuner.hpp"
+
+#include "BenchmarkCommon.hpp"
+
+static void PrintUsage(const char* name) {
+	printf("Usage: %s [options]\n"
+		"  --backend gpu,cpu            backends to calibrate\n"
+		"  --elements 16777216          floats read by microkernels\n"
+		"  --stride 16                  stride of strided read in floats\n"
+		"  --iterations 8               timed passes per microkernel\n"
+		"  --neurons 1048576            network to place on roofline\n"
+		"  --fanin 128\n"
+		"  --distribution uniform       uniform, powerlaw or clustered\n"
+		"  --autotune                   tune GPU kernel before measuring\n"
+		"  --autotune-cache FILE        keep tuned configs in FILE, env\n"
+		"                               BOLTZMANN_AUTOTUNE_CACHE\n"
+		"  --shader-cache DIR           cache program binaries in DIR, env\n"
+		"                               BOLTZMANN_SHADER_CACHE\n"
+		"  --egl                        surfaceless EGL context, no window\n"
+		"                               system needed\n"
+		"  --format csv|json            output format\n"
+		"  --output FILE                output file, default stdout\n",
+		name);
+}
+
+/*
+ * Lower bound of step time from ceilings: connection indices are read
+ * together with gathered states at gather bandwidth, weights and per
+ * neuron data are streamed.
+ */
+static double ModelSeconds(const bn::BandwidthCeilings& c, uint64_t neurons,
+		uint64_t edges) {
+	return (edges*8.0/c.gather + (edges*4.0 + neurons*16.0)/c.stream) * 1e-9;
+}
+
+int main(int argc, char** argv) {
+	bench::Arguments args(argc, argv);
+	if(args.Has("--help") || args.Has("-h")) {
+		PrintUsage(argv[0]);
+		return 0;
+	}
+	
+	const std::vector<std::string> backends = args.GetNames("--backend",
+			"gpu,cpu");
+	const uint32_t elements = args.GetUInt("--elements", 1u<<24);
+	const uint32_t stride = args.GetUInt("--stride", 16);
+	const uint32_t iterations = args.GetUInt("--iterations", 8);
+	const uint32_t neurons = args.GetUInt("--neurons", 1024*1024);
+	const uint32_t fanIn = args.GetUInt("--fanin", 128);
+	const std::string distribution = args.Get("--distribution", "uniform");
+	// nothing is written to disk unless asked
+	const char* autotuneCache = args.Get("--autotune-cache",
+			getenv("BOLTZMANN_AUTOTUNE_CACHE"));
+	const char* shaderCache = args.Get("--shader-cache",
+			getenv("BOLTZMANN_SHADER_CACHE"));
+	
+	bool useGpu = false;
+	for(const std::string& b : backends)
+		useGpu |= b == "gpu";
+	if(useGpu) {
+		if(args.Has("--egl"))
+			gl::openGL.InitHeadlessEGL();
+		else
+			gl::openGL.InitHeadless();
+		if(shaderCache && shaderCache[0])
+			gl::Shader::SetProgramBinaryCacheDirectory(shaderCache);
+	}
+	
+	{
+		bench::ResultWriter writer(args.Get("--format", "csv"),
+				args.Get("--output", nullptr));
+		// gather over as many states as network has, so caches see the same
+		// working set as the calculation kernel
+		bn::BandwidthCalibration calibration(elements, stride, neurons);
+		
+		std::vector<std::vector<uint32_t>> structure;
+		if(distribution == "powerlaw")
+			bn::GeneratePowerLawStructure(structure, neurons, fanIn, 2.5f, 64,
+					1);
+		else if(distribution == "clustered")
+			bn::GenerateClusteredStructure(structure, neurons, fanIn, 4096, 64,
+					1);
+		else
+			bn::GenerateUniformStructure(structure, neurons, fanIn, 64, 1);
+		uint64_t edges = 0;
+		for(const auto& s : structure)
+			edges += s.size();
+		// networks below keep default edge layout
+		const uint64_t bytes = bench::StepTrafficBytes(neurons, edges,
+				bn::EdgeLayout::SEPARATE);
+		
+		for(const std::string& backend : backends) {
+			bn::BandwidthCeilings ceilings;
+			double seconds = 0;
+			if(backend == "gpu") {
+				ceilings = calibration.MeasureGpu(iterations);
+				bn::NeuralNetwork nn;
+				nn.InitEmptyNetwork(structure);
+				if(args.Has("--autotune")) {
+					bn::Autotuner tuner(autotuneCache ? autotuneCache : "");
+					tuner.Tune(nn);
+				}
+				bn::Autotuner::Measure(nn, 1);
+				seconds = bn::Autotuner::Measure(nn, iterations) * 1e-9;
+			} else if(backend == "cpu") {
+				ceilings = calibration.MeasureCpu(iterations);
+				bn::NeuralNetworkCPU nn;
+				nn.InitEmptyNetwork(structure);
+				nn.PerformCalculation(0, neurons);
+				seconds = bench::MeasureSeconds([&]() {
+						for(uint32_t i=0; i<iterations; ++i)
+							nn.PerformCalculation(0, neurons);
+					}) / std::max(iterations, 1u);
+			} else {
+				fprintf(stderr, "Unknown backend: %s\n", backend.c_str());
+				continue;
+			}
+			
+			const double model = ModelSeconds(ceilings, neurons, edges);
+			const double achieved = bytes / seconds * 1e-9;
+			writer.Write({
+				{"backend", backend},
+				{"elements", std::to_string(calibration.GetElements())},
+				{"stream_gb_per_s", bench::Format(ceilings.stream)},
+				{"strided_gb_per_s", bench::Format(ceilings.strided)},
+				{"gather_gb_per_s", bench::Format(ceilings.gather)},
+				{"distribution", distribution},
+				{"neurons", std::to_string(neurons)},
+				{"edges", std::to_string(edges)},
+				{"step_ms", bench::Format(seconds*1e3)},
+				{"kernel_gb_per_s", bench::Format(achieved)},
+				{"of_stream", bench::Format(achieved/ceilings.stream)},
+				{"of_gather", bench::Format(achieved/ceilings.gather)},
+				{"model_step_ms", bench::Format(model*1e3)},
+				{"efficiency", bench::Format(model/seconds)}
+			});
+		}
+	}
+	
+	if(useGpu)
+		gl::openGL.Destroy();
+	return 0;
+}
+
@@ -0,0 +1,89 @@
+#include <cstdio>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+
+#include "BenchmarkCommon.hpp"
+
+static void PrintUsage(const char* name) {
+	printf("Usage: %s [options]\n"
+		"  --backend glfw,egl           context creation paths to measure\n"
+		"  --repetitions 20             timed creations per backend\n"
+		"  --debug-context              create debug contexts\n"
+		"  --format csv|json            output format\n"
+		"  --output FILE                output file, default stdout\n",
+		name);
+}
+
+static int Create(gl::OpenGL& context, const std::string& backend,
+		bool debugContext) {
+	if(backend == "egl")
+		return context.InitHeadlessEGL(4, 5, debugContext);
+	return context.InitHeadless(4, 5, debugContext);
+}
+
+/*
+ * Time from nothing to usable core 4.5 context: creation, making it current,
+ * loading GL functions and first glFinish, followed by destruction. First
+ * creation in process also pays for library and display initialization,
+ * which is what every new worker process pays, so it is reported apart.
+ */
+int main(int argc, char** argv) {
+	bench::Arguments args(argc, argv);
+	if(args.Has("--help") || args.Has("-h")) {
+		PrintUsage(argv[0]);
+		return 0;
+	}
+	
+	const std::vector<std::string> backends = args.GetNames("--backend",
+			"glfw,egl");
+	const uint32_t repetitions = std::max(1u,
+			args.GetUInt("--repetitions", 20));
+	const bool debugContext = args.Has("--debug-context");
+	
+	bench::ResultWriter writer(args.Get("--format", "csv"),
+			args.Get("--output", nullptr));
+	
+	for(const std::string& backend : backends) {
+		if(backend != "glfw" && backend != "egl") {
+			fprintf(stderr, "Unknown backend: %s\n", backend.c_str());
+			continue;
+		}
+		std::vector<double> times;
+		double first = 0;
+		bool failed = false;
+		for(uint32_t r=0; r<=repetitions && !failed; ++r) {
+			double destroyed = 0;
+			double created = bench::MeasureSeconds([&]() {
+					std::unique_ptr<gl::OpenGL> context(new gl::OpenGL);
+					failed = Create(*context, backend, debugContext) != 0;
+					if(!failed)
+						glFinish();
+					destroyed = bench::MeasureSeconds([&]() {
+							context.reset();
+						});
+				});
+			if(r)
+				times.push_back(created - destroyed);
+			else
+				first = created - destroyed;
+		}
+		if(failed) {
+			fprintf(stderr, "Failed to create %s context\n", backend.c_str());
+			continue;
+		}
+		bench::Statistics s = bench::Summarize(times);
+		writer.Write({
+			{"backend", backend},
+			{"repetitions", std::to_string(repetitions)},
+			{"first_ms", bench::Format(first*1e3)},
+			{"create_ms_mean", bench::Format(s.mean*1e3)},
+			{"create_ms_ci95", bench::Format(s.ci95*1e3)},
+			{"create_ms_min", bench::Format(s.min*1e3)}
+		});
+	}
+	return 0;
+}
@@ -4,6 +4,8 @@
 #include <ctime>
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <set>
 
 #include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
@@ -41,8 +43,23 @@ void GenerateRandomStructure(std::vector<std::vector<uint32_t>>& structure,
 	}
 }
 
-int main() {
+// Writes no files unless asked: --shader-cache DIR (or BOLTZMANN_SHADER_CACHE)
+// caches program binaries, --trace FILE (or BOLTZMANN_TRACE) dumps Chrome
+// trace of profiled calls.
+int main(int argc, char** argv) {
+	const char* shaderCache = getenv("BOLTZMANN_SHADER_CACHE");
+	const char* trace = getenv("BOLTZMANN_TRACE");
+	for(int i=1; i+1<argc; i+=2) {
+		if(!strcmp(argv[i], "--shader-cache")) {
+			shaderCache = argv[i+1];
+		} else if(!strcmp(argv[i], "--trace")) {
+			trace = argv[i+1];
+		}
+	}
+	
 	gl::openGL.InitHeadless();
+	if(shaderCache && shaderCache[0])
+		gl::Shader::SetProgramBinaryCacheDirectory(shaderCache);
 	
 	{
 		constexpr uint32_t NEURONS=1024*1024;
@@ -58,6 +75,9 @@ int main() {
 		
 		auto t2 = std::chrono::steady_clock::now();
 		printf(" network generation time: %.3f ms\n", (t2-t1).count()/1000000.0f);
+		bn::Profiler profiler;
+		nn.profiler = &profiler;
+		
 		t2 = std::chrono::steady_clock::now();
 		constexpr uint32_t ITERATIONS = 256;
 		
@@ -69,6 +89,15 @@ int main() {
 		auto t3 = std::chrono::steady_clock::now();
 		printf(" One iteration time: %.3f ms\n", (t3-t2).count()/1000.0f/1000.f/ITERATIONS);
 		printf(" Calculation time per neuron: %.3f ns\n", (t3-t2).count()/(float)(ITERATIONS*NEURONS));
+		
+		profiler.Collect();
+		const bn::Profiler::Histogram& h =
+			profiler.GetHistogram(bn::Profiler::PERFORM_CALCULATION);
+		printf(" GPU iteration time: p50 %.3f ms, p99 %.3f ms\n",
+				h.Percentile(0.5)/1000000.0, h.Percentile(0.99)/1000000.0);
+		printf(" %s\n", profiler.StatisticsJSON().c_str());
+		if(trace && trace[0])
+			profiler.DumpChromeTrace(trace);
 	}
 	gl::openGL.Destroy();
 	
@@ -0,0 +1,79 @@
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+
+#include "../include/boltzmann/NeuralNetwork.hpp"
+
+double MeasureStepTime(bn::NeuralNetwork& nn, uint32_t iterations) {
+	nn.PerformCalculation(0, nn.neuronsCount);
+	glFinish();
+	auto t1 = std::chrono::steady_clock::now();
+	for(uint32_t i=0; i<iterations; ++i) {
+		nn.PerformCalculation(0, nn.neuronsCount);
+		nn.SwapStates();
+	}
+	glFinish();
+	auto t2 = std::chrono::steady_clock::now();
+	return (t2-t1).count()/1000000.0/iterations;
+}
+
+int main(int argc, char** argv) {
+	uint32_t neurons = 256*1024;
+	uint32_t connections = 128;
+	float threshold = 2000.0f;
+	uint32_t topK = 0;
+	for(int i=1; i+1<argc; i+=2) {
+		if(!strcmp(argv[i], "--neurons")) {
+			neurons = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--connections")) {
+			connections = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--threshold")) {
+			threshold = atof(argv[i+1]);
+		} else if(!strcmp(argv[i], "--topk")) {
+			topK = atoi(argv[i+1]);
+		}
+	}
+	
+	gl::openGL.InitHeadless();
+	
+	{
+		constexpr uint32_t ITERATIONS = 64;
+		
+		std::vector<std::vector<uint32_t>> structure(neurons);
+		std::mt19937 gen(12345);
+		std::uniform_int_distribution<uint32_t> dist(0, neurons-1);
+		for(auto& s : structure) {
+			s.resize(connections);
+			for(auto& c : s)
+				c = dist(gen);
+		}
+		
+		bn::NeuralNetwork nn;
+		nn.InitEmptyNetwork(structure);
+		
+		double before = MeasureStepTime(nn, ITERATIONS);
+		
+		auto t1 = std::chrono::steady_clock::now();
+		bn::NeuralNetwork::PruneStatistics stats = topK ?
+			nn.PruneTopK(topK) : nn.PruneByThreshold(threshold);
+		glFinish();
+		auto t2 = std::chrono::steady_clock::now();
+		
+		double after = MeasureStepTime(nn, ITERATIONS);
+		
+		printf(" prune time: %.3f ms\n", (t2-t1).count()/1000000.0);
+		printf(" edges: %u -> %u (%.2f%% removed)\n", stats.edgesBefore,
+				stats.edgesAfter,
+				100.0*(stats.edgesBefore-stats.edgesAfter)/stats.edgesBefore);
+		printf(" step time: %.3f ms -> %.3f ms (%.2fx)\n", before, after,
+				before/after);
+	}
+	gl::openGL.Destroy();
+	
+	return 0;
+}
+
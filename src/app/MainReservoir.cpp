@@ -0,0 +1,107 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+
+#include "../include/boltzmann/NeuralNetwork.hpp"
+#include "../include/boltzmann/ReadoutTrainer.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+// Echo state network predicting next sample of a two tone signal.
+float Signal(uint32_t t) {
+	return 0.6f*sinf(t*0.2f) + 0.3f*sinf(t*0.0311f);
+}
+
+int main(int argc, char** argv) {
+	uint32_t neurons = 8192;
+	uint32_t connections = 16;
+	uint32_t featureStride = 8;
+	float leak = 0.3f;
+	float ridge = 1e-4f;
+	uint32_t trainSteps = 4000;
+	uint32_t testSteps = 1000;
+	for(int i=1; i+1<argc; i+=2) {
+		if(!strcmp(argv[i], "--neurons")) {
+			neurons = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--connections")) {
+			connections = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--stride")) {
+			featureStride = std::max(atoi(argv[i+1]), 1);
+		} else if(!strcmp(argv[i], "--leak")) {
+			leak = atof(argv[i+1]);
+		} else if(!strcmp(argv[i], "--ridge")) {
+			ridge = atof(argv[i+1]);
+		} else if(!strcmp(argv[i], "--train")) {
+			trainSteps = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--test")) {
+			testSteps = atoi(argv[i+1]);
+		}
+	}
+	
+	gl::openGL.InitHeadless();
+	
+	{
+		// neuron 0 is input
+		std::vector<std::vector<uint32_t>> structure;
+		bn::GenerateUniformStructure(structure, neurons, connections, 1, 1);
+		
+		bn::NeuralNetwork nn;
+		nn.InitEmptyNetwork(structure);
+		// weights scaled for spectral radius below 1
+		std::vector<float> weights(nn.weightsCount), bias(neurons, 0.0f);
+		std::vector<float> states(neurons, 0.0f);
+		bn::RandomBuffer(weights, nn.weightsCount, -1.0f, 1.0f);
+		const float scale = 0.9f * sqrtf(3.0f/connections);
+		for(float& w : weights)
+			w *= scale;
+		nn.UpdateBiasWeights(bias.data(), weights.data());
+		nn.UpdateStates(states.data(), 0, neurons);
+		nn.SetLeakRate(leak);
+		
+		std::vector<uint32_t> features;
+		for(uint32_t i=1; i<neurons; i+=featureStride)
+			features.push_back(i);
+		bn::ReadoutTrainer trainer;
+		trainer.Init(features, 1);
+		
+		// washout, training and free running test share one trajectory
+		const uint32_t washout = 100;
+		std::vector<float> readout;
+		double error = 0, variance = 0;
+		for(uint32_t t=0; t<washout+trainSteps+testSteps; ++t) {
+			const float input = Signal(t);
+			const float target = Signal(t+1);
+			nn.UpdateStates(&input, 0, 1);
+			nn.PerformCalculation(0, neurons);
+			if(t >= washout && t < washout+trainSteps) {
+				trainer.Accumulate(nn, &target);
+			} else if(t == washout+trainSteps) {
+				if(trainer.Solve(ridge, readout)) {
+					printf(" Training failed\n");
+					break;
+				}
+			}
+			if(t >= washout+trainSteps) {
+				nn.FetchStates(states.data(), 0, neurons);
+				double prediction = readout.back();
+				for(uint32_t i=0; i<features.size(); ++i)
+					prediction += readout[i] * states[features[i]];
+				error += (prediction-target)*(prediction-target);
+				variance += target*target;
+			}
+			nn.SwapStates();
+		}
+		
+		printf(" features: %u, training samples: %llu\n",
+				trainer.GetDimension(),
+				(unsigned long long)trainer.GetSamples());
+		printf(" test NRMSE: %.5f\n", sqrt(error/std::max(variance, 1e-30)));
+	}
+	gl::openGL.Destroy();
+	
+	return 0;
+}
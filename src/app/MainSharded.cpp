@@ -0,0 +1,115 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+
+#include "../include/boltzmann/NeuralNetwork.hpp"
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/ShardedNetwork.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+// Runs the same network as a whole and split into shards, reports halo
+// sizes and largest difference of states.
+template<typename Network>
+void Compare(const char* name, Network& whole,
+		bn::ShardedNetwork<Network>& sharded,
+		const std::vector<std::vector<uint32_t>>& structure, uint32_t inputs,
+		uint32_t steps) {
+	const uint32_t neurons = structure.size();
+	whole.InitEmptyNetwork(structure);
+	std::vector<float> weights, bias(neurons, 0.0f), states;
+	bn::RandomBuffer(weights, whole.weightsCount, -0.5f, 0.5f);
+	bn::RandomBuffer(states, neurons, -1.0f, 1.0f);
+	whole.UpdateBiasWeights(bias.data(), weights.data());
+	sharded.UpdateBiasWeights(bias.data(), weights.data());
+	whole.UpdateStates(states.data(), 0, neurons);
+	sharded.UpdateStates(states.data(), 0, neurons);
+	
+	for(uint32_t i=0; i<steps; ++i) {
+		whole.PerformCalculation(inputs, neurons-inputs);
+		sharded.PerformCalculation(inputs, neurons-inputs);
+		whole.SwapStates();
+		sharded.SwapStates();
+	}
+	std::vector<float> a(neurons), b(neurons);
+	whole.FetchStates(a.data(), 0, neurons);
+	sharded.FetchStates(b.data(), 0, neurons);
+	float diff = 0;
+	for(uint32_t i=inputs; i<neurons; ++i)
+		diff = std::max(diff, fabsf(a[i]-b[i]));
+	
+	uint32_t halo = 0;
+	for(uint32_t k=0; k<sharded.GetShardCount(); ++k) {
+		printf("%s shard %u: neurons [%u, %u), halo %u, sends %u\n", name, k,
+				sharded.GetShardBegin(k), sharded.GetShardEnd(k),
+				sharded.GetHaloSize(k), sharded.GetSendSize(k));
+		halo += sharded.GetHaloSize(k);
+	}
+	printf("%s: exchanged %.2f%% of states per step, max difference %g\n\n",
+			name, 100.0*halo/neurons, diff);
+}
+
+int main(int argc, char** argv) {
+	uint32_t neurons = 65536;
+	uint32_t connections = 16;
+	uint32_t radius = 4096;
+	uint32_t shardCount = 4;
+	uint32_t steps = 16;
+	for(int i=1; i+1<argc; i+=2) {
+		if(!strcmp(argv[i], "--neurons")) {
+			neurons = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--connections")) {
+			connections = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--radius")) {
+			radius = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--shards")) {
+			shardCount = std::max(atoi(argv[i+1]), 1);
+		} else if(!strcmp(argv[i], "--steps")) {
+			steps = atoi(argv[i+1]);
+		}
+	}
+	
+	gl::openGL.InitHeadlessEGL();
+	
+	{
+		// local connections keep halo small
+		const uint32_t inputs = 64;
+		std::vector<std::vector<uint32_t>> structure;
+		bn::GenerateClusteredStructure(structure, neurons, connections, radius,
+				inputs, 1);
+		
+		bn::NeuralNetworkCPU wholeCPU;
+		bn::ShardedNetwork<bn::NeuralNetworkCPU> shardedCPU;
+		shardedCPU.InitEmptyNetwork(structure, shardCount);
+		Compare("cpu", wholeCPU, shardedCPU, structure, inputs, steps);
+		
+		// every GPU shard in its own context sharing objects with main one
+		std::vector<std::unique_ptr<gl::OpenGL>> contexts;
+		std::vector<gl::OpenGL*> shardContexts;
+		for(uint32_t k=0; k<shardCount; ++k) {
+			contexts.emplace_back(new gl::OpenGL());
+			if(contexts.back()->InitHeadlessEGL(4, 5, false, &gl::openGL)) {
+				printf("Failed to create context of shard %u\n", k);
+				return 1;
+			}
+			shardContexts.emplace_back(contexts.back().get());
+		}
+		gl::openGL.MakeCurrent();
+		{
+			bn::NeuralNetwork wholeGPU;
+			bn::ShardedNetwork<bn::NeuralNetwork> shardedGPU;
+			shardedGPU.InitEmptyNetwork(structure, shardCount, shardContexts);
+			Compare("gpu", wholeGPU, shardedGPU, structure, inputs, steps);
+		}
+		gl::openGL.MakeCurrent();
+	}
+	
+	gl::openGL.Destroy();
+	return 0;
+}
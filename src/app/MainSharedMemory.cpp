@@ -0,0 +1,113 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/SharedNetworkImage.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+// Owner process shares network through POSIX shared memory, forked workers
+// attach to it and step private states from the same start. Every worker
+// reports checksum of its states to compare with the owner.
+static double Run(bn::NeuralNetworkCPU& network,
+		const std::vector<float>& start, uint32_t inputs, uint32_t steps) {
+	const uint32_t neurons = network.neuronsCount;
+	network.UpdateStates(start.data(), 0, neurons);
+	for(uint32_t i=0; i<steps; ++i) {
+		network.PerformCalculation(inputs, neurons-inputs);
+		network.SwapStates();
+	}
+	std::vector<float> states(neurons);
+	// newest states back in stateNext
+	network.SwapStates();
+	network.FetchStates(states.data(), 0, neurons);
+	double sum = 0;
+	for(float s : states)
+		sum += s;
+	return sum;
+}
+
+int main(int argc, char** argv) {
+	uint32_t neurons = 1 << 20;
+	uint32_t connections = 32;
+	uint32_t workers = 4;
+	uint32_t steps = 8;
+	const char* name = "/boltzmann_network";
+	for(int i=1; i+1<argc; i+=2) {
+		if(!strcmp(argv[i], "--neurons")) {
+			neurons = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--connections")) {
+			connections = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--workers")) {
+			workers = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--steps")) {
+			steps = atoi(argv[i+1]);
+		} else if(!strcmp(argv[i], "--name")) {
+			name = argv[i+1];
+		}
+	}
+	const uint32_t inputs = 64;
+	
+	std::vector<float> start;
+	bn::RandomBuffer(start, neurons, -1.0f, 1.0f);
+	
+	bn::SharedNetworkImage image;
+	double expected = 0;
+	{
+		std::vector<std::vector<uint32_t>> structure;
+		bn::GenerateUniformStructure(structure, neurons, connections, inputs,
+				1);
+		bn::NeuralNetworkCPU network;
+		network.InitEmptyNetwork(structure);
+		std::vector<float> weights, bias(neurons, 0.0f);
+		bn::RandomBuffer(weights, network.weightsCount, -0.3f, 0.3f);
+		network.UpdateBiasWeights(bias.data(), weights.data());
+		if(image.Create(name, network))
+			return 1;
+		expected = Run(network, start, inputs, steps);
+	}
+	printf("image %s: %.1f MiB, private states of worker: %.1f MiB\n", name,
+			image.GetSize()/1048576.0, 2.0*neurons*sizeof(float)/1048576.0);
+	
+	std::vector<pid_t> children;
+	int fds[2];
+	if(pipe(fds))
+		return 1;
+	for(uint32_t w=0; w<workers; ++w) {
+		pid_t pid = fork();
+		if(pid == 0) {
+			close(fds[0]);
+			bn::SharedNetworkImage attached;
+			double sum = NAN;
+			bn::NeuralNetworkCPU network;
+			if(attached.Attach(name) == 0 && network.AttachImage(attached) == 0)
+				sum = Run(network, start, inputs, steps);
+			if(write(fds[1], &sum, sizeof(sum)) != sizeof(sum))
+				_exit(1);
+			_exit(0);
+		}
+		children.emplace_back(pid);
+	}
+	close(fds[1]);
+	
+	int failures = 0;
+	for(uint32_t w=0; w<workers; ++w) {
+		double sum = NAN;
+		if(read(fds[0], &sum, sizeof(sum)) != sizeof(sum))
+			sum = NAN;
+		bool same = sum == expected;
+		failures += !same;
+		printf("worker %u: checksum %.9g %s\n", w, sum,
+				same ? "matches owner" : "differs from owner");
+	}
+	close(fds[0]);
+	for(pid_t pid : children)
+		waitpid(pid, nullptr, 0);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+#include <cstdio>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/ThreadPool.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+#include "BenchmarkCommon.hpp"
+
+static void PrintUsage(const char* name) {
+	printf("Usage: %s [options]\n"
+		"  --threads 1,2,4,8            pool sizes, threads fill one NUMA\n"
+		"                               node before next\n"
+		"  --numa none,first_touch,bind,interleave\n"
+		"                               placement policies\n"
+		"  --replicate 0,1              per node copies of states\n"
+		"  --neurons 4194304\n"
+		"  --fanin 64\n"
+		"  --distribution uniform       uniform, powerlaw or clustered\n"
+		"  --exponent 2.5               power-law exponent\n"
+		"  --radius 4096                clustered window radius\n"
+		"  --steps 8                    steps per repetition\n"
+		"  --warmup 1                   untimed repetitions\n"
+		"  --repetitions 5              timed repetitions\n"
+		"  --format csv|json            output format\n"
+		"  --output FILE                output file, default stdout\n",
+		name);
+}
+
+/*
+ * Host step time over pool sizes and NUMA placements. Speedup is relative
+ * to the first measured configuration, nodes is number of NUMA nodes the
+ * pool's threads run on, so rows with more nodes show scaling across
+ * sockets.
+ */
+int main(int argc, char** argv) {
+	bench::Arguments args(argc, argv);
+	if(args.Has("--help") || args.Has("-h")) {
+		PrintUsage(argv[0]);
+		return 0;
+	}
+	
+	const std::vector<uint32_t> threadsList = args.GetList("--threads",
+			"1,2,4,8");
+	const std::vector<std::string> policies = args.GetNames("--numa",
+			"none,first_touch,bind,interleave");
+	const std::vector<uint32_t> replicateList = args.GetList("--replicate",
+			"0,1");
+	const uint32_t neurons = args.GetUInt("--neurons", 4*1024*1024);
+	const uint32_t fanIn = args.GetUInt("--fanin", 64);
+	const std::string distribution = args.Get("--distribution", "uniform");
+	const float exponent = args.GetDouble("--exponent", 2.5);
+	const uint32_t radius = args.GetUInt("--radius", 4096);
+	const uint32_t steps = std::max(1u, args.GetUInt("--steps", 8));
+	const uint32_t warmup = args.GetUInt("--warmup", 1);
+	const uint32_t repetitions = std::max(1u,
+			args.GetUInt("--repetitions", 5));
+	const uint32_t inputs = 64;
+	
+	std::vector<std::vector<uint32_t>> structure;
+	if(distribution == "powerlaw") {
+		bn::GeneratePowerLawStructure(structure, neurons, fanIn, exponent,
+				inputs, 1);
+	} else if(distribution == "clustered") {
+		bn::GenerateClusteredStructure(structure, neurons, fanIn, radius,
+				inputs, 1);
+	} else {
+		bn::GenerateUniformStructure(structure, neurons, fanIn, inputs, 1);
+	}
+	uint64_t edges = 0;
+	for(const auto& s : structure)
+		edges += s.size();
+	const uint64_t bytes = bench::StepTrafficBytes(neurons, edges,
+			bn::EdgeLayout::SEPARATE);
+	
+	bench::ResultWriter writer(args.Get("--format", "csv"),
+			args.Get("--output", nullptr));
+	double baseline = 0;
+	for(uint32_t threads : threadsList) {
+		bn::ThreadPool pool(threads);
+		std::set<uint32_t> nodes;
+		for(uint32_t t=0; t<pool.GetThreadCount(); ++t)
+			nodes.insert(pool.GetNode(t));
+		
+		bn::NeuralNetworkCPU nn;
+		nn.SetThreadPool(&pool);
+		nn.InitEmptyNetwork(structure);
+		for(const std::string& policyName : policies)
+		for(uint32_t replicate : replicateList) {
+			bn::NumaPolicy policy;
+			if(!bn::NumaPolicyFromName(policyName, policy)) {
+				fprintf(stderr, "Unknown policy: %s\n", policyName.c_str());
+				continue;
+			}
+			nn.SetNumaPolicy(policy, replicate);
+			
+			auto run = [&]() {
+				for(uint32_t s=0; s<steps; ++s) {
+					nn.PerformCalculation(inputs, neurons-inputs);
+					nn.SwapStates();
+				}
+			};
+			for(uint32_t i=0; i<warmup; ++i)
+				run();
+			std::vector<double> seconds;
+			for(uint32_t i=0; i<repetitions; ++i)
+				seconds.emplace_back(bench::MeasureSeconds(run)/steps);
+			bench::Statistics st = bench::Summarize(seconds);
+			if(baseline == 0)
+				baseline = st.mean;
+			
+			writer.Write({
+				{"threads", std::to_string(pool.GetThreadCount())},
+				{"nodes", std::to_string(nodes.size())},
+				{"numa", policyName},
+				{"replicate", std::to_string(replicate)},
+				{"distribution", distribution},
+				{"neurons", std::to_string(neurons)},
+				{"edges", std::to_string(edges)},
+				{"step_ms_mean", bench::Format(st.mean*1e3)},
+				{"step_ms_ci95", bench::Format(st.ci95*1e3)},
+				{"step_ms_min", bench::Format(st.min*1e3)},
+				{"speedup", bench::Format(baseline/st.mean)},
+				{"gb_per_s", bench::Format(bytes/st.mean*1e-9)},
+				{"stolen_tasks", std::to_string(pool.GetStolenTasks())}
+			});
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include <cstdio>
+
+#include <string>
+#include <vector>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+#include "../include/boltzmann/NeuralNetwork.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+#include "BenchmarkCommon.hpp"
+
+static void PrintUsage(const char* name) {
+	printf("Usage: %s [options]\n"
+		"  --neurons 1024               small network, time is dominated\n"
+		"                               by submission\n"
+		"  --fanin 4\n"
+		"  --steps 1000                 steps per repetition\n"
+		"  --repetitions 10             timed repetitions\n"
+		"  --debug-context              report errors with KHR_debug\n"
+		"                               callback instead of glGetError\n"
+		"  --format csv|json            output format\n"
+		"  --output FILE                output file, default stdout\n",
+		name);
+}
+
+/*
+ * CPU time spent issuing steps: PerformCalculation and SwapStates without
+ * waiting for GPU, measured separately from time until GPU finished.
+ * Compare build with NDEBUG (no error checks), default build (glGetError
+ * polling) and default build with --debug-context (callback).
+ */
+int main(int argc, char** argv) {
+	bench::Arguments args(argc, argv);
+	if(args.Has("--help") || args.Has("-h")) {
+		PrintUsage(argv[0]);
+		return 0;
+	}
+	
+	const uint32_t neurons = args.GetUInt("--neurons", 1024);
+	const uint32_t fanIn = args.GetUInt("--fanin", 4);
+	const uint32_t steps = std::max(1u, args.GetUInt("--steps", 1000));
+	const uint32_t repetitions = std::max(1u,
+			args.GetUInt("--repetitions", 10));
+	const bool debugContext = args.Has("--debug-context");
+	
+	gl::openGL.InitHeadless(4, 5, debugContext);
+	
+	{
+		bench::ResultWriter writer(args.Get("--format", "csv"),
+				args.Get("--output", nullptr));
+		
+		std::vector<std::vector<uint32_t>> structure;
+		bn::GenerateUniformStructure(structure, neurons, fanIn, 0, 1);
+		bn::NeuralNetwork nn;
+		nn.InitEmptyNetwork(structure);
+		
+		std::vector<double> submit, total;
+		for(uint32_t r=0; r<=repetitions; ++r) {
+			glFinish();
+			double issued = 0;
+			double finished = bench::MeasureSeconds([&]() {
+					issued = bench::MeasureSeconds([&]() {
+							for(uint32_t i=0; i<steps; ++i) {
+								nn.PerformCalculation(0, neurons);
+								nn.SwapStates();
+							}
+						});
+					glFinish();
+				});
+			// first repetition warms up
+			if(r) {
+				submit.push_back(issued/steps);
+				total.push_back(finished/steps);
+			}
+		}
+		bench::Statistics s = bench::Summarize(submit);
+		bench::Statistics t = bench::Summarize(total);
+		
+#ifdef NDEBUG
+		const char* checks = debugContext ? "debug_callback" : "none";
+#else
+		const char* checks = gl::openGL.IsDebugOutputEnabled() ?
+			"debug_callback" : "polling";
+#endif
+		writer.Write({
+			{"checks", checks},
+			{"neurons", std::to_string(neurons)},
+			{"fanin", std::to_string(fanIn)},
+			{"steps", std::to_string(steps)},
+			{"repetitions", std::to_string(repetitions)},
+			{"submit_us_mean", bench::Format(s.mean*1e6)},
+			{"submit_us_ci95", bench::Format(s.ci95*1e6)},
+			{"submit_us_min", bench::Format(s.min*1e6)},
+			{"step_us_mean", bench::Format(t.mean*1e6)},
+			{"step_us_min", bench::Format(t.min*1e6)},
+			{"errors", std::to_string(gl::openGL.GetErrors().size())}
+		});
+	}
+	
+	gl::openGL.Destroy();
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include <cstdio>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../include/boltzmann/Activation.hpp"
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+
+#include "TestCommon.hpp"
+
+/*
+ * NormalizeActivationGroups and ForEachActivationRange edge cases, and
+ * ranges of random groups against activation looked up per neuron.
+ */
+
+using bn::Activation;
+using bn::ActivationGroup;
+
+struct Range {
+	uint32_t begin;
+	uint32_t end;
+	Activation activation;
+};
+
+static std::vector<Range> Ranges(const std::vector<ActivationGroup>& groups,
+		uint32_t begin, uint32_t end) {
+	std::vector<Range> ranges;
+	bn::ForEachActivationRange(groups, Activation::TANH, begin, end,
+			[&](uint32_t b, uint32_t e, Activation activation) {
+				ranges.push_back({b, e, activation});
+			});
+	return ranges;
+}
+
+static void Normalize() {
+	std::vector<ActivationGroup> groups = {
+		{50, 60, Activation::RELU},
+		{10, 10, Activation::SIGMOID},
+		{30, 20, Activation::SIGMOID},
+		{0, 50, Activation::HARD_TANH}
+	};
+	test::Expect(bn::NormalizeActivationGroups(groups),
+			"adjacent groups rejected");
+	test::Expect(groups.size() == 2 && groups[0].begin == 0
+			&& groups[1].begin == 50, "empty groups kept or not sorted");
+	
+	groups = {{0, 10, Activation::RELU}, {9, 20, Activation::SIGMOID}};
+	test::Expect(!bn::NormalizeActivationGroups(groups),
+			"overlapping groups accepted");
+	groups = {{0, 10, (Activation)bn::ACTIVATION_COUNT}};
+	test::Expect(!bn::NormalizeActivationGroups(groups),
+			"unknown activation accepted");
+	groups = {{5, 5, (Activation)bn::ACTIVATION_COUNT}};
+	test::Expect(bn::NormalizeActivationGroups(groups) && groups.empty(),
+			"empty group with unknown activation not dropped");
+	groups.clear();
+	test::Expect(bn::NormalizeActivationGroups(groups),
+			"no groups rejected");
+}
+
+static void EdgeCases() {
+	std::vector<ActivationGroup> groups;
+	std::vector<Range> ranges = Ranges(groups, 3, 9);
+	test::Expect(ranges.size() == 1 && ranges[0].begin == 3
+			&& ranges[0].end == 9 && ranges[0].activation == Activation::TANH,
+			"range without groups");
+	test::Expect(Ranges(groups, 5, 5).empty(), "empty range visited");
+	
+	groups = {{10, 20, Activation::RELU}, {20, 30, Activation::SIGMOID}};
+	test::Expect(Ranges(groups, 10, 10).empty(),
+			"empty range at group begin visited");
+	ranges = Ranges(groups, 0, 10);
+	test::Expect(ranges.size() == 1 && ranges[0].activation
+			== Activation::TANH, "range ending at group begin");
+	ranges = Ranges(groups, 30, 40);
+	test::Expect(ranges.size() == 1 && ranges[0].activation
+			== Activation::TANH, "range starting at group end");
+	ranges = Ranges(groups, 12, 15);
+	test::Expect(ranges.size() == 1 && ranges[0].begin == 12
+			&& ranges[0].end == 15 && ranges[0].activation == Activation::RELU,
+			"range inside group");
+	ranges = Ranges(groups, 15, 25);
+	test::Expect(ranges.size() == 2 && ranges[0].end == 20
+			&& ranges[1].begin == 20 && ranges[1].activation
+			== Activation::SIGMOID, "range over adjacent groups");
+	ranges = Ranges(groups, 5, 35);
+	test::Expect(ranges.size() == 4 && ranges[0].end == 10
+			&& ranges[3].begin == 30 && ranges[3].end == 35,
+			"range covering groups");
+	
+	bn::NeuralNetworkCPU nn;
+	nn.InitEmptyNetwork(std::vector<std::vector<uint32_t>>(40));
+	test::Expect(nn.SetActivationGroups(groups) == 0, "groups rejected");
+	test::Expect(nn.SetActivationGroups({{0, 15, Activation::RELU},
+				{10, 20, Activation::RELU}}) != 0,
+			"network accepted overlapping groups");
+	test::Expect(nn.GetActivationGroups().size() == 2,
+			"groups not kept after failure");
+}
+
+static void Random() {
+	std::mt19937 gen(17);
+	const uint32_t neurons = 200;
+	for(uint32_t iteration=0; iteration<500; ++iteration) {
+		std::vector<ActivationGroup> groups;
+		std::vector<Activation> lookup(neurons, Activation::TANH);
+		for(uint32_t b=gen()%20; b<neurons; b+=gen()%30) {
+			const uint32_t e = std::min(neurons, b + (uint32_t)(gen()%25));
+			const Activation a = (Activation)(gen()%bn::ACTIVATION_COUNT);
+			groups.push_back({b, e, a});
+			std::fill(lookup.begin()+b, lookup.begin()+e, a);
+			b = e;
+		}
+		std::shuffle(groups.begin(), groups.end(), gen);
+		if(!test::Expect(bn::NormalizeActivationGroups(groups),
+					"random groups rejected"))
+			continue;
+		const uint32_t begin = gen()%neurons;
+		const uint32_t end = begin + gen()%(neurons-begin+1);
+		uint32_t position = begin;
+		bool valid = true;
+		for(const Range& r : Ranges(groups, begin, end)) {
+			valid = valid && r.begin == position && r.begin < r.end;
+			for(uint32_t n=r.begin; n<r.end && valid; ++n)
+				valid = lookup[n] == r.activation;
+			position = r.end;
+		}
+		test::Expect(valid && position == end,
+				"ranges of [%u, %u) differ from groups", begin, end);
+	}
+}
+
+int main() {
+	Normalize();
+	EdgeCases();
+	Random();
+	return test::Result("activation_groups");
+}
@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/ThreadPool.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+#include "TestCommon.hpp"
+
+/*
+ * One step of CPU network against reference summed in double, for every
+ * activation and edge layout, and for fixed degree, tiled, prefetching,
+ * pooled and activation group paths.
+ */
+
+struct Config {
+	bn::EdgeLayout layout;
+	bn::Activation activation;
+	bool fixedDegree = false;
+	bool tiled = false;
+	bool prefetch = false;
+	bool pool = false;
+	bool groups = false;
+	bool leak = false;
+};
+
+static const uint32_t NEURONS = 6000;
+static const uint32_t INPUTS = 64;
+
+static float Activate(bn::Activation activation, float v) {
+	return bn::VisitActivation(activation, [&](auto a) {
+			return bn::cpu::Activate<decltype(a)::value>(v);
+		});
+}
+
+static void Run(const Config& config, bn::ThreadPool& pool) {
+	std::vector<std::vector<uint32_t>> structure;
+	if(config.fixedDegree)
+		bn::GenerateUniformStructure(structure, NEURONS, 12, INPUTS, 7);
+	else
+		bn::GeneratePowerLawStructure(structure, NEURONS, 16, 2.2, INPUTS, 7);
+	
+	bn::NeuralNetworkCPU nn(config.layout);
+	nn.InitEmptyNetwork(structure);
+	if(config.pool)
+		nn.SetThreadPool(&pool);
+	if(config.tiled)
+		nn.SetTiling(1024, 512);
+	if(config.prefetch)
+		nn.prefetchDistance = 16;
+	nn.SetActivation(config.activation);
+	std::vector<bn::Activation> activations(NEURONS, config.activation);
+	if(config.groups) {
+		std::vector<bn::ActivationGroup> groups = {
+			{700, 2100, bn::Activation::SIGMOID},
+			{2100, 2101, bn::Activation::RELU},
+			{4000, NEURONS, bn::Activation::HARD_TANH}
+		};
+		test::Expect(nn.SetActivationGroups(groups) == 0,
+				"activation groups rejected");
+		for(const bn::ActivationGroup& g : groups)
+			std::fill(activations.begin()+g.begin, activations.begin()+g.end,
+					g.activation);
+	}
+	
+	std::vector<float> weights, bias, x, leak(NEURONS);
+	bn::RandomBuffer(weights, nn.weightsCount, -0.4, 0.4);
+	bn::RandomBuffer(bias, NEURONS, -0.2, 0.2);
+	bn::RandomBuffer(x, NEURONS, -1, 1);
+	for(uint32_t i=0; i<NEURONS; ++i)
+		leak[i] = 0.25f + 0.25f*(i%4);
+	nn.UpdateBiasWeights(bias.data(), weights.data());
+	if(config.leak)
+		nn.SetLeakRates(leak.data());
+	nn.UpdateStates(x.data(), 0, NEURONS);
+	const uint32_t seed = nn.samplingSeed;
+	nn.PerformCalculation(INPUTS, NEURONS-INPUTS);
+	std::vector<float> y(NEURONS);
+	nn.FetchStates(y.data(), 0, NEURONS);
+	
+	const bool half = config.layout == bn::EdgeLayout::INTERLEAVED_FP16;
+	uint32_t mismatches = 0;
+	double worst = 0;
+	for(uint32_t n=INPUTS; n<NEURONS; ++n) {
+		const bn::PerNeuronStatic info = nn.perNeuronStatic[n];
+		double sum = bias[n];
+		double magnitude = 0;
+		for(uint32_t i=0; i<info.weights_count; ++i) {
+			const uint32_t e = info.weights_start + i;
+			const double term = (double)weights[e]
+				* x[nn.weightsStructure[e]];
+			sum += term;
+			magnitude += fabs(term);
+		}
+		// summation order, fp16 weights and approximations of activation
+		const double tolerance = 1e-5 + magnitude*(half ? 1.5e-3 : 2e-5);
+		double expected = x[n];
+		if(info.weights_count) {
+			const bn::Activation activation = activations[n];
+			double v = Activate(activation, sum);
+			if(activation == bn::Activation::LOGISTIC_SAMPLING) {
+				const uint32_t h = bn::SamplingHash(n ^ bn::SamplingHash(seed));
+				const double u = (h >> 8) * (1.0 / 16777216.0);
+				// sample may flip when probability is within tolerance
+				if(fabs(u - v) <= tolerance)
+					continue;
+				v = u < v ? 1.0 : 0.0;
+			}
+			const double a = config.leak ? leak[n] : 1.0;
+			expected = x[n]*(1.0-a) + v*a;
+		}
+		const double diff = fabs(y[n] - expected);
+		worst = std::max(worst, diff);
+		if(diff > tolerance)
+			++mismatches;
+	}
+	test::Expect(mismatches == 0, "layout %u activation %s fixed %d tiled %d"
+			" prefetch %d pool %d groups %d leak %d: %u mismatches, worst %g",
+			(uint32_t)config.layout, bn::ActivationName(config.activation),
+			config.fixedDegree, config.tiled, config.prefetch, config.pool,
+			config.groups, config.leak, mismatches, worst);
+	if(config.fixedDegree)
+		test::Expect(nn.fixedDegree == 12, "fixed degree not detected: %u",
+				nn.fixedDegree);
+	if(config.tiled)
+		test::Expect(nn.GetTileNeurons() == 1024, "tiling not enabled");
+}
+
+int main() {
+	bn::ThreadPool pool(3, false);
+	const bn::EdgeLayout layouts[] = {bn::EdgeLayout::SEPARATE,
+		bn::EdgeLayout::INTERLEAVED_FP32, bn::EdgeLayout::INTERLEAVED_FP16};
+	for(bn::EdgeLayout layout : layouts) {
+		for(uint32_t a=0; a<bn::ACTIVATION_COUNT; ++a) {
+			Config config{layout, (bn::Activation)a};
+			config.leak = a % 2;
+			Run(config, pool);
+		}
+		
+		Config config{layout, bn::Activation::TANH_PADE};
+		config.fixedDegree = true;
+		Run(config, pool);
+		config.pool = true;
+		config.leak = true;
+		Run(config, pool);
+		
+		config = Config{layout, bn::Activation::TANH};
+		config.tiled = true;
+		Run(config, pool);
+		config.prefetch = true;
+		Run(config, pool);
+		config.tiled = false;
+		Run(config, pool);
+		
+		config = Config{layout, bn::Activation::LOGISTIC_SAMPLING};
+		config.tiled = true;
+		config.pool = true;
+		config.groups = true;
+		config.leak = true;
+		Run(config, pool);
+		config.tiled = false;
+		config.fixedDegree = true;
+		Run(config, pool);
+	}
+	return test::Result("cpu_kernels");
+}
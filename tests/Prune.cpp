@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <cmath>
+
+#include <random>
+#include <vector>
+
+#include "../OpenGLWrapper/include/openglwrapper/OpenGL.hpp"
+
+#include "../include/boltzmann/NeuralNetwork.hpp"
+
+#include "TestCommon.hpp"
+
+/*
+ * Pruning on device against host selection of kept connections: every
+ * neuron that had inputs keeps at least its strongest one, top-K keeps
+ * ties in order of connection index.
+ */
+
+using Kept = std::vector<std::vector<std::pair<uint32_t, float>>>;
+
+// weights on 0.01 grid of both signs, so magnitudes tie often
+static void Init(bn::NeuralNetwork& nn, uint32_t neurons, uint32_t maxDegree,
+		std::vector<float>& weights) {
+	std::mt19937 gen(5);
+	std::vector<std::vector<uint32_t>> structure(neurons);
+	for(uint32_t i=16; i<neurons; ++i) {
+		structure[i].resize(gen()%maxDegree);
+		for(uint32_t& c : structure[i])
+			c = gen()%neurons;
+	}
+	nn.InitEmptyNetwork(structure);
+	weights.resize(nn.weightsCount);
+	for(float& w : weights)
+		w = ((int)(gen()%2001) - 1000) / 100.0f;
+	std::vector<float> bias(neurons, 0.1f);
+	nn.UpdateBiasWeights(bias.data(), weights.data());
+}
+
+static Kept Expected(const bn::NeuralNetwork& nn,
+		const std::vector<float>& weights, float threshold, uint32_t topK) {
+	Kept kept(nn.neuronsCount);
+	for(uint32_t n=0; n<nn.neuronsCount; ++n) {
+		const bn::PerNeuronStatic info = nn.perNeuronStaticInfoHost[n];
+		const float* w = weights.data() + info.weights_start;
+		int strongest = -1;
+		for(uint32_t i=0; i<info.weights_count; ++i) {
+			bool keep;
+			if(topK) {
+				uint32_t rank = 0;
+				for(uint32_t j=0; j<info.weights_count; ++j)
+					if(fabs(w[j]) > fabs(w[i])
+							|| (fabs(w[j]) == fabs(w[i]) && j < i))
+						++rank;
+				keep = rank < topK;
+			} else {
+				keep = fabs(w[i]) >= threshold;
+			}
+			if(keep)
+				kept[n].emplace_back(nn.structure[n][i], w[i]);
+			if(strongest < 0 || fabs(w[i]) > fabs(w[strongest]))
+				strongest = i;
+		}
+		if(kept[n].empty() && strongest >= 0)
+			kept[n].emplace_back(nn.structure[n][strongest], w[strongest]);
+	}
+	return kept;
+}
+
+static void Compare(const char* name, bn::NeuralNetwork& nn,
+		const Kept& expected, bn::NeuralNetwork::PruneStatistics stats) {
+	std::vector<float> weights(nn.weightsCount);
+	nn.weights.FetchElements(weights.data(), 0, nn.weightsCount);
+	uint32_t total = 0, mismatches = 0;
+	for(uint32_t n=0; n<nn.neuronsCount; ++n) {
+		const bn::PerNeuronStatic info = nn.perNeuronStaticInfoHost[n];
+		if(info.weights_count != expected[n].size()
+				|| (info.weights_count && info.weights_start != total)) {
+			++mismatches;
+			continue;
+		}
+		for(uint32_t i=0; i<info.weights_count; ++i)
+			if(nn.structure[n][i] != expected[n][i].first
+					|| weights[info.weights_start+i] != expected[n][i].second)
+				++mismatches;
+		total += info.weights_count;
+	}
+	test::Expect(mismatches == 0, "%s: %u neurons differ", name, mismatches);
+	test::Expect(stats.edgesAfter == total && nn.weightsCount == total,
+			"%s: %u edges after, %u expected", name, stats.edgesAfter, total);
+}
+
+int main() {
+	if(gl::openGL.InitHeadlessEGL()) {
+		printf("No OpenGL context, skipped\n");
+		return test::SKIPPED;
+	}
+	{
+		std::vector<float> weights;
+		bn::NeuralNetwork nn;
+		Init(nn, 3000, 40, weights);
+		// most neurons have no connection over threshold
+		Kept expected = Expected(nn, weights, 9.5f, 0);
+		Compare("threshold", nn, expected, nn.PruneByThreshold(9.5f));
+		
+		Init(nn, 3000, 40, weights);
+		expected = Expected(nn, weights, 0, 7);
+		Compare("top 7", nn, expected, nn.PruneTopK(7));
+		
+		Init(nn, 2000, 400, weights);
+		expected = Expected(nn, weights, 0, 50);
+		Compare("top 50 of high degree", nn, expected, nn.PruneTopK(50));
+		
+		Init(nn, 2000, 40, weights);
+		const uint32_t before = nn.weightsCount;
+		bn::NeuralNetwork::PruneStatistics stats = nn.PruneTopK(0);
+		test::Expect(stats.edgesBefore == before && stats.edgesAfter == before
+				&& nn.weightsCount == before, "top 0 changed network");
+		test::Expect(gl::openGL.GetErrors().empty(), "OpenGL errors");
+	}
+	gl::openGL.Destroy();
+	return test::Result("prune");
+}
@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/ShardedNetwork.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+#include "TestCommon.hpp"
+
+/*
+ * Sharded host network steps the same as single network over the same
+ * structure, for several shard counts, with leak rates and sampling units.
+ */
+
+static const uint32_t NEURONS = 12000;
+static const uint32_t INPUTS = 32;
+
+static void Compare(const std::vector<std::vector<uint32_t>>& structure,
+		uint32_t shardCount, bn::Activation activation) {
+	bn::NeuralNetworkCPU whole;
+	bn::ShardedNetwork<bn::NeuralNetworkCPU> sharded;
+	whole.InitEmptyNetwork(structure);
+	sharded.InitEmptyNetwork(structure, shardCount);
+	test::Expect(sharded.GetShardCount() == shardCount
+			&& sharded.weightsCount == whole.weightsCount,
+			"%u shards: structure differs", shardCount);
+	
+	std::vector<float> weights, bias, x, leak(NEURONS);
+	bn::RandomBuffer(weights, whole.weightsCount, -0.3, 0.3);
+	bn::RandomBuffer(bias, NEURONS, -0.1, 0.1);
+	bn::RandomBuffer(x, NEURONS, -1, 1);
+	for(uint32_t i=0; i<NEURONS; ++i)
+		leak[i] = 0.3f + 0.7f*(i%5)/4.0f;
+	whole.UpdateBiasWeights(bias.data(), weights.data());
+	sharded.UpdateBiasWeights(bias.data(), weights.data());
+	whole.SetLeakRates(leak.data());
+	sharded.SetLeakRates(leak.data());
+	whole.SetActivation(activation);
+	sharded.SetActivation(activation);
+	whole.UpdateStates(x.data(), 0, NEURONS);
+	sharded.UpdateStates(x.data(), 0, NEURONS);
+	
+	// summation order of shards differs, sampled states must be equal
+	const double tolerance = activation == bn::Activation::LOGISTIC_SAMPLING
+		? 0 : 1e-5;
+	std::vector<float> a(NEURONS), b(NEURONS);
+	double worst = 0;
+	for(uint32_t step=0; step<10; ++step) {
+		whole.PerformCalculation(INPUTS, NEURONS-INPUTS);
+		sharded.PerformCalculation(INPUTS, NEURONS-INPUTS);
+		whole.FetchStates(a.data(), 0, NEURONS);
+		sharded.FetchStates(b.data(), 0, NEURONS);
+		for(uint32_t i=0; i<NEURONS; ++i)
+			worst = std::max(worst, (double)fabs(a[i]-b[i]));
+		whole.SwapStates();
+		sharded.SwapStates();
+	}
+	test::Expect(worst <= tolerance, "%u shards, %s: states differ by %g",
+			shardCount, bn::ActivationName(activation), worst);
+}
+
+int main() {
+	std::vector<std::vector<uint32_t>> structure;
+	bn::GenerateClusteredStructure(structure, NEURONS, 16, 1500, INPUTS, 3);
+	for(uint32_t shards : {1u, 2u, 3u, 5u}) {
+		Compare(structure, shards, bn::Activation::TANH);
+		Compare(structure, shards, bn::Activation::LOGISTIC_SAMPLING);
+	}
+	bn::GenerateUniformStructure(structure, NEURONS, 8, INPUTS, 4);
+	Compare(structure, 4, bn::Activation::SIGMOID);
+	return test::Result("sharded_network");
+}
@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/boltzmann/NeuralNetworkCPU.hpp"
+#include "../include/boltzmann/SharedNetworkImage.hpp"
+#include "../include/boltzmann/StructureGenerators.hpp"
+
+#include "TestCommon.hpp"
+
+/*
+ * Network attached to shared image steps the same as network it was
+ * created from, for every edge layout, with leak rates and activation
+ * groups. Truncated image, input index out of range and mismatched layout
+ * are refused.
+ */
+
+static const uint32_t NEURONS = 8000;
+static const uint32_t INPUTS = 32;
+
+static void RoundTrip(const std::string& name, bn::EdgeLayout layout,
+		bool fixedDegree) {
+	std::vector<std::vector<uint32_t>> structure;
+	if(fixedDegree)
+		bn::GenerateUniformStructure(structure, NEURONS, 10, INPUTS, 3);
+	else
+		bn::GeneratePowerLawStructure(structure, NEURONS, 16, 2.2, INPUTS, 3);
+	bn::NeuralNetworkCPU source(layout);
+	source.InitEmptyNetwork(structure);
+	std::vector<float> weights, bias, x, leak(NEURONS);
+	bn::RandomBuffer(weights, source.weightsCount, -0.3, 0.3);
+	bn::RandomBuffer(bias, NEURONS, -0.1, 0.1);
+	bn::RandomBuffer(x, NEURONS, -1, 1);
+	for(uint32_t i=0; i<NEURONS; ++i)
+		leak[i] = 0.2f + 0.1f*(i%7);
+	source.UpdateBiasWeights(bias.data(), weights.data());
+	source.SetLeakRates(leak.data());
+	source.SetActivation(bn::Activation::TANH_PADE);
+	source.SetActivationGroups({{100, 3000, bn::Activation::SIGMOID},
+			{5000, 6000, bn::Activation::LOGISTIC_SAMPLING}});
+	
+	bn::SharedNetworkImage image, attached;
+	if(!test::Expect(image.Create(name.c_str(), source) == 0,
+				"layout %u: create failed", (uint32_t)layout)
+			|| !test::Expect(attached.Attach(name.c_str()) == 0,
+				"layout %u: attach failed", (uint32_t)layout))
+		return;
+	bn::NeuralNetworkCPU worker(layout);
+	if(!test::Expect(worker.AttachImage(attached) == 0,
+				"layout %u: attaching network failed", (uint32_t)layout))
+		return;
+	test::Expect(worker.GetActivationGroups().size() == 2
+			&& worker.GetActivationGroups()[1].activation
+			== bn::Activation::LOGISTIC_SAMPLING,
+			"layout %u: activation groups lost", (uint32_t)layout);
+	test::Expect(worker.fixedDegree == source.fixedDegree,
+			"layout %u: fixed degree %u, source %u", (uint32_t)layout,
+			worker.fixedDegree, source.fixedDegree);
+	
+	source.UpdateStates(x.data(), 0, NEURONS);
+	worker.UpdateStates(x.data(), 0, NEURONS);
+	std::vector<float> a(NEURONS), b(NEURONS);
+	uint32_t mismatches = 0;
+	for(uint32_t step=0; step<5; ++step) {
+		source.PerformCalculation(INPUTS, NEURONS-INPUTS);
+		worker.PerformCalculation(INPUTS, NEURONS-INPUTS);
+		source.FetchStates(a.data(), 0, NEURONS);
+		worker.FetchStates(b.data(), 0, NEURONS);
+		for(uint32_t i=0; i<NEURONS; ++i)
+			mismatches += a[i] != b[i];
+		source.SwapStates();
+		worker.SwapStates();
+	}
+	test::Expect(mismatches == 0, "layout %u fixed %d: %u states differ",
+			(uint32_t)layout, fixedDegree, mismatches);
+	
+	bn::NeuralNetworkCPU other(layout == bn::EdgeLayout::SEPARATE
+			? bn::EdgeLayout::INTERLEAVED_FP32 : bn::EdgeLayout::SEPARATE);
+	test::Expect(other.AttachImage(attached) != 0,
+			"layout %u: network of other layout attached", (uint32_t)layout);
+	
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	struct stat st;
+	if(test::Expect(fd >= 0 && fstat(fd, &st) == 0, "reopening segment")) {
+		// first stored input index past neuron count, kernels would gather
+		// out of states
+		char* mapped = (char*)mmap(nullptr, st.st_size,
+				PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		const uint32_t* edges = layout == bn::EdgeLayout::SEPARATE
+			? attached.GetConnections() : attached.GetPackedEdges();
+		uint32_t* index = mapped == MAP_FAILED ? nullptr
+			: (uint32_t*)memmem(mapped, st.st_size, edges, 64);
+		if(test::Expect(index != nullptr, "edges not found in segment")) {
+			const uint32_t original = *index;
+			*index = NEURONS;
+			bn::SharedNetworkImage corrupt;
+			test::Expect(corrupt.Attach(name.c_str()) != 0,
+					"layout %u: image with index out of range attached",
+					(uint32_t)layout);
+			*index = original;
+		}
+		if(mapped != MAP_FAILED)
+			munmap(mapped, st.st_size);
+		
+		// segment cut in half, arrays past its end must not be mapped
+		test::Expect(ftruncate(fd, st.st_size/2) == 0, "truncating segment");
+		bn::SharedNetworkImage truncated;
+		test::Expect(truncated.Attach(name.c_str()) != 0,
+				"layout %u: truncated image attached", (uint32_t)layout);
+	}
+	if(fd >= 0)
+		close(fd);
+}
+
+int main() {
+	const std::string name = "/boltzmann_test_" + std::to_string(getpid());
+	RoundTrip(name, bn::EdgeLayout::SEPARATE, false);
+	RoundTrip(name, bn::EdgeLayout::SEPARATE, true);
+	RoundTrip(name, bn::EdgeLayout::INTERLEAVED_FP32, false);
+	RoundTrip(name, bn::EdgeLayout::INTERLEAVED_FP16, false);
+	
+	bn::SharedNetworkImage missing;
+	test::Expect(missing.Attach(name.c_str()) != 0,
+			"image attached after owner closed it");
+	return test::Result("shared_network_image");
+}
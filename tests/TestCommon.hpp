@@ -0,0 +1,43 @@
+#ifndef BOLTZMANNNN_TEST_COMMON_HPP
+#define BOLTZMANNNN_TEST_COMMON_HPP
+
+#include <cstdio>
+#include <cstdarg>
+
+/*
+ * Checks shared by tests. Every test is an executable registered with
+ * CTest, it prints failed checks and returns non zero when any failed.
+ */
+namespace test {
+	// exit code reported to CTest as skipped, when no GL context is available
+	const int SKIPPED = 77;
+	
+	inline int& Failures() {
+		static int failures = 0;
+		return failures;
+	}
+	
+	// counts failure and prints message when condition is false
+	inline bool Expect(bool condition, const char* format, ...) {
+		if(condition)
+			return true;
+		++Failures();
+		va_list args;
+		va_start(args, format);
+		printf("FAILED: ");
+		vprintf(format, args);
+		printf("\n");
+		va_end(args);
+		return false;
+	}
+	
+	inline int Result(const char* name) {
+		if(Failures())
+			printf("%s: %d checks failed\n", name, Failures());
+		else
+			printf("%s: passed\n", name);
+		return Failures() ? 1 : 0;
+	}
+}
+
+#endif